@@ -0,0 +1,529 @@
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "chat_client.h"
+
+using namespace std;
+
+// 채팅 서버 부하 / 지연 측정 도구
+// 연결마다 헤드리스 클라이언트 (chat_client.h) 로 입장한 뒤 정해진 속도로 send_text 를 보내고,
+// 돌아오는 브로드캐스트에 실린 보낸 시각으로 종단 간 지연을 잰다
+// 보낸 시각은 steady_clock 이므로 서버와 같은 머신에서 돌릴 때만 의미가 있다
+
+using BenchClock = chrono::steady_clock;
+
+static uint64_t now_nanos() {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(BenchClock::now().time_since_epoch()).count());
+}
+
+// HdrHistogram 과 같은 로그-선형 버킷, 값은 마이크로초
+// 2의 거듭제곱 구간마다 HIST_SUB_BUCKETS / 2 칸으로 나누어서 어느 크기든 상대 오차가 1% 안쪽
+const int HIST_SUB_BUCKET_BITS = 8;
+const uint64_t HIST_SUB_BUCKETS = 1ull << HIST_SUB_BUCKET_BITS;
+const int HIST_MAX_SHIFT = 32;  // 2^(32 + 8) 마이크로초 (약 12일) 까지
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts_(HIST_SUB_BUCKETS + HIST_MAX_SHIFT * (HIST_SUB_BUCKETS / 2), 0) {}
+
+    void record(uint64_t value) {
+        ++counts_[index_of(value)];
+        ++total_;
+        max_ = max(max_, value);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        max_ = max(max_, other.max_);
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max_value() const { return max_; }
+
+    // 값의 fraction 비율이 이 값 이하 (버킷 윗값)
+    uint64_t percentile(double fraction) const {
+        if (total_ == 0) {
+            return 0;
+        }
+        uint64_t target = static_cast<uint64_t>(ceil(fraction * static_cast<double>(total_)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= target) {
+                return min(value_of(i), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static size_t index_of(uint64_t value) {
+        if (value < HIST_SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 0;
+        while (value >> (msb + 1)) {
+            ++msb;
+        }
+        int shift = min(msb - (HIST_SUB_BUCKET_BITS - 1), HIST_MAX_SHIFT);
+        uint64_t sub = min(value >> shift, HIST_SUB_BUCKETS - 1) - HIST_SUB_BUCKETS / 2;
+        return static_cast<size_t>(HIST_SUB_BUCKETS + (shift - 1) * (HIST_SUB_BUCKETS / 2) + sub);
+    }
+
+    static uint64_t value_of(size_t index) {
+        if (index < HIST_SUB_BUCKETS) {
+            return index;
+        }
+        size_t offset = index - HIST_SUB_BUCKETS;
+        int shift = static_cast<int>(offset / (HIST_SUB_BUCKETS / 2)) + 1;
+        uint64_t sub = offset % (HIST_SUB_BUCKETS / 2) + HIST_SUB_BUCKETS / 2;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+};
+
+// io 스레드마다 따로 기록하고 끝난 뒤에 합친다 (기록 경로에 잠금 없음)
+struct ThreadHistograms {
+    LatencyHistogram broadcast;  // 보낼 예정이던 시각 → 받은 시각
+    LatencyHistogram join;       // 연결 시작 → 자기 입장 알림 수신
+};
+
+class HistogramRegistry {
+public:
+    ThreadHistograms& local() {
+        thread_local ThreadHistograms* histograms = nullptr;
+        if (!histograms) {
+            lock_guard<mutex> lock(mutex_);
+            all_.push_back(make_unique<ThreadHistograms>());
+            histograms = all_.back().get();
+        }
+        return *histograms;
+    }
+
+    // 모든 io 스레드가 끝난 뒤에 호출
+    ThreadHistograms merged() {
+        lock_guard<mutex> lock(mutex_);
+        ThreadHistograms result;
+        for (const auto& histograms : all_) {
+            result.broadcast.merge(histograms->broadcast);
+            result.join.merge(histograms->join);
+        }
+        return result;
+    }
+
+private:
+    mutex mutex_;
+    vector<unique_ptr<ThreadHistograms>> all_;
+};
+
+struct BenchOptions {
+    string host = "127.0.0.1";
+    string port = "12345";
+    string scenario = "steady";
+    int connections = 100;
+    int rooms = 10;
+    double zipf = 0.0;           // 0 이면 방을 고르게, 클수록 앞쪽 방에 몰린다
+    int senders = -1;            // 보내는 연결 수, -1 이면 전부
+    double rate = 1.0;           // 보내는 연결 하나의 초당 메시지 수
+    size_t message_size = 64;    // send_text 본문 최소 크기
+    double slow_fraction = 0.0;  // 아예 읽지 않는 연결 비율
+    double ramp_seconds = 1.0;   // 이 시간에 걸쳐 나누어 연결
+    double duration_seconds = 10.0;
+    int threads = 0;
+    bool binary = false;
+    bool compress = false;       // 바이너리에서 압축을 협상한다 (--compress 는 --binary 를 켠다)
+    int user_id_base = 1000000;
+};
+
+struct BenchCounters {
+    atomic<uint64_t> connected{ 0 };
+    atomic<uint64_t> joined{ 0 };
+    atomic<uint64_t> failed{ 0 };
+    atomic<uint64_t> disconnected{ 0 };
+    atomic<uint64_t> sent{ 0 };
+    atomic<uint64_t> received{ 0 };
+};
+
+// 이번 실행에서 보낸 메시지만 지연 측정에 넣기 위한 표식 (이전 실행의 기록 재전송은 무시)
+// 형식: bench-<run>-<보낼 예정 시각 ns>-xxxx
+const string_view BENCH_TAG = "bench-";
+
+// 연결 하나, 접속 / 핸드셰이크 / 수신 해석 / pong 은 ChatClient 가 하고 여기서는 보내는 속도와 지연만 다룬다
+// 상태 / 이벤트 콜백은 ChatClient 의 strand, 보내기 타이머는 따로 strand 에서 돈다
+// main 이 io 스레드를 모두 멈출 때까지 들고 있으므로 콜백은 this 만 잡는다
+class BenchClient {
+public:
+    BenchClient(boost::asio::io_context& io_context, const BenchOptions& options, BenchCounters& counters,
+        HistogramRegistry& histograms, uint32_t run_id, int user_id, int room_id, bool sender, bool slow)
+        : timer_(boost::asio::make_strand(io_context)), options_(options), counters_(counters), histograms_(histograms),
+        run_id_(run_id), user_id_(user_id), sender_(sender),
+        client_(make_shared<ChatClient>(io_context, client_options(options, user_id, room_id, slow))) {
+        client_->on_state([this](ChatClientState state) { on_state(state); });
+        client_->on_event([this](const ChatEvent& event) { on_event(event); });
+    }
+
+    void start(BenchClock::time_point stop_at) {
+        stop_at_ = stop_at;
+        connect_started_ = now_nanos();
+        client_->start();
+    }
+
+    void stop() {
+        stopping_.store(true, memory_order_relaxed);
+        client_->stop();
+        boost::asio::dispatch(timer_.get_executor(), [this]() { timer_.cancel(); });
+    }
+
+    uint64_t received_bytes() const { return client_->received_bytes(); }
+
+private:
+    // 재접속하지 않는다 (끊긴 연결은 dropped 로 센다), 느린 연결은 아예 읽지 않는다
+    static ChatClientOptions client_options(const BenchOptions& options, int user_id, int room_id, bool slow) {
+        ChatClientOptions client;
+        client.host = options.host;
+        client.port = options.port;
+        client.room_id = room_id;
+        client.user_id = user_id;
+        client.binary = options.binary;
+        client.compress = options.compress;
+        client.reconnect = false;
+        client.receive = !slow;
+        return client;
+    }
+
+    void on_state(ChatClientState state) {
+        switch (state) {
+        case ChatClientState::connected:
+            connected_ = true;
+            counters_.connected.fetch_add(1, memory_order_relaxed);
+            break;
+        case ChatClientState::joined:
+            joined_ = true;
+            counters_.joined.fetch_add(1, memory_order_relaxed);
+            counters_.received.fetch_add(1, memory_order_relaxed);
+            histograms_.local().join.record((now_nanos() - connect_started_) / 1000);
+            boost::asio::dispatch(timer_.get_executor(), [this]() { start_sending(); });
+            break;
+        case ChatClientState::disconnected:
+            if (stopping_.load(memory_order_relaxed)) {
+                break;
+            }
+            (connected_ ? counters_.disconnected : counters_.failed).fetch_add(1, memory_order_relaxed);
+            boost::asio::dispatch(timer_.get_executor(), [this]() { timer_.cancel(); });
+            break;
+        default:
+            break;
+        }
+    }
+
+    // 처음 보낼 시각을 간격 안에서 흩어서 모든 연결이 한꺼번에 보내지 않게 한다
+    void start_sending() {
+        if (!sender_ || options_.rate <= 0) {
+            return;
+        }
+        interval_ = chrono::duration_cast<BenchClock::duration>(chrono::duration<double>(1.0 / max(options_.rate, 1e-9)));
+        next_send_ = BenchClock::now() + chrono::duration_cast<BenchClock::duration>(
+            interval_ * (static_cast<double>(user_id_ % 997) / 997.0));
+        schedule_send();
+    }
+
+    // 보낼 예정 시각을 고정 간격으로 이어 가므로 서버가 밀려서 늦게 보낸 만큼도 지연에 들어간다
+    void schedule_send() {
+        timer_.expires_at(next_send_);
+        timer_.async_wait([this](boost::system::error_code ec) {
+            if (ec || stopping_.load(memory_order_relaxed) || BenchClock::now() >= stop_at_) {
+                return;
+            }
+            send_text(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(next_send_.time_since_epoch()).count()));
+            next_send_ += interval_;
+            schedule_send();
+        });
+    }
+
+    void send_text(uint64_t intended_nanos) {
+        text_ = string(BENCH_TAG) + to_string(run_id_) + "-" + to_string(intended_nanos) + "-";
+        if (text_.size() < options_.message_size) {
+            text_.append(options_.message_size - text_.size(), 'x');
+        }
+        if (client_->send_text(text_)) {
+            counters_.sent.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    // 입장 전에 받는 것은 최근 메시지 재전송이라 지연 측정에서 뺀다
+    void on_event(const ChatEvent& event) {
+        uint64_t now = now_nanos();
+        counters_.received.fetch_add(1, memory_order_relaxed);
+        if (!joined_ || event.type != CommandType::deliver_text) {
+            return;
+        }
+
+        string_view message = event.text;
+        if (message.substr(0, BENCH_TAG.size()) != BENCH_TAG) {
+            return;
+        }
+        message.remove_prefix(BENCH_TAG.size());
+        size_t dash = message.find('-');
+        uint32_t run_id = 0;
+        if (dash == string_view::npos || !parse_int(message.substr(0, dash), run_id) || run_id != run_id_) {
+            return;
+        }
+        message.remove_prefix(dash + 1);
+        uint64_t sent_nanos = 0;
+        if (!parse_int(message.substr(0, message.find('-')), sent_nanos) || sent_nanos > now) {
+            return;
+        }
+        histograms_.local().broadcast.record((now - sent_nanos) / 1000);
+    }
+
+    boost::asio::steady_timer timer_;   // 자기 strand 위에서
+    const BenchOptions& options_;
+    BenchCounters& counters_;
+    HistogramRegistry& histograms_;
+    uint32_t run_id_;
+    int user_id_;
+    bool sender_;
+    shared_ptr<ChatClient> client_;
+    atomic<bool> stopping_{ false };
+
+    // ChatClient strand 에서만
+    bool connected_ = false;
+    bool joined_ = false;
+
+    // 보내기 타이머 strand 에서만
+    string text_;
+    BenchClock::time_point stop_at_;
+    BenchClock::time_point next_send_;
+    BenchClock::duration interval_{};
+    uint64_t connect_started_ = 0;
+};
+
+// 시나리오는 기본값 묶음일 뿐이고, 뒤에 준 옵션이 덮어쓴다
+bool apply_scenario(const string& name, BenchOptions& options) {
+    options.scenario = name;
+    if (name == "steady") {
+        return true;
+    }
+    if (name == "slow-consumers") {
+        options.slow_fraction = 0.1;
+        return true;
+    }
+    if (name == "join-storm") {
+        options.connections = 2000;
+        options.ramp_seconds = 0;
+        options.rate = 0;
+        options.duration_seconds = 5;
+        return true;
+    }
+    if (name == "large-room") {
+        options.connections = 2000;
+        options.rooms = 1;
+        options.senders = 10;
+        options.rate = 10;
+        return true;
+    }
+    return false;
+}
+
+void print_usage() {
+    cerr << "usage: chat_bench [--scenario steady|slow-consumers|join-storm|large-room] [options]\n"
+        "  --host H --port P          server address (127.0.0.1:12345)\n"
+        "  --connections N            connections to open\n"
+        "  --rooms R --zipf S         room count and skew (0 = uniform)\n"
+        "  --senders N --rate R       sending connections and messages/sec each\n"
+        "  --size B                   send_text body size in bytes\n"
+        "  --slow-fraction F          fraction of connections that never read\n"
+        "  --ramp S --duration S      connect ramp and send duration in seconds\n"
+        "  --threads N --binary       io threads, use the binary protocol\n"
+        "  --compress                 binary protocol with compressed server frames\n";
+}
+
+bool parse_options(int argc, char* argv[], BenchOptions& options) {
+    // 시나리오 기본값을 먼저 적용해야 다른 옵션이 덮어쓸 수 있다
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (string_view(argv[i]) == "--scenario" && !apply_scenario(argv[i + 1], options)) {
+            cerr << "Unknown scenario: " << argv[i + 1] << endl;
+            return false;
+        }
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        string_view flag = argv[i];
+        if (flag == "--binary") {
+            options.binary = true;
+            continue;
+        }
+        if (flag == "--compress") {
+            options.binary = true;
+            options.compress = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cerr << "Missing value for " << flag << endl;
+            return false;
+        }
+        string value = argv[++i];
+        if (flag == "--scenario") {}
+        else if (flag == "--host") { options.host = value; }
+        else if (flag == "--port") { options.port = value; }
+        else if (flag == "--connections") { options.connections = stoi(value); }
+        else if (flag == "--rooms") { options.rooms = max(1, stoi(value)); }
+        else if (flag == "--zipf") { options.zipf = stod(value); }
+        else if (flag == "--senders") { options.senders = stoi(value); }
+        else if (flag == "--rate") { options.rate = stod(value); }
+        else if (flag == "--size") { options.message_size = static_cast<size_t>(stoul(value)); }
+        else if (flag == "--slow-fraction") { options.slow_fraction = stod(value); }
+        else if (flag == "--ramp") { options.ramp_seconds = stod(value); }
+        else if (flag == "--duration") { options.duration_seconds = stod(value); }
+        else if (flag == "--threads") { options.threads = stoi(value); }
+        else if (flag == "--user-id-base") { options.user_id_base = stoi(value); }
+        else {
+            cerr << "Unknown option: " << flag << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// room 1..rooms 중 하나, zipf 가 0 이면 고르게
+class RoomPicker {
+public:
+    RoomPicker(int rooms, double zipf) {
+        double total = 0;
+        for (int rank = 1; rank <= rooms; ++rank) {
+            total += 1.0 / pow(static_cast<double>(rank), zipf);
+            cumulative_.push_back(total);
+        }
+    }
+
+    int pick(mt19937& random) const {
+        uniform_real_distribution<double> uniform(0.0, cumulative_.back());
+        auto it = lower_bound(cumulative_.begin(), cumulative_.end(), uniform(random));
+        return static_cast<int>(it - cumulative_.begin()) + 1;
+    }
+
+private:
+    vector<double> cumulative_;
+};
+
+void print_latency(const char* name, const LatencyHistogram& histogram) {
+    printf("%-10s count=%llu  p50=%lluus  p99=%lluus  p999=%lluus  max=%lluus\n", name,
+        static_cast<unsigned long long>(histogram.count()),
+        static_cast<unsigned long long>(histogram.percentile(0.50)),
+        static_cast<unsigned long long>(histogram.percentile(0.99)),
+        static_cast<unsigned long long>(histogram.percentile(0.999)),
+        static_cast<unsigned long long>(histogram.max_value()));
+}
+
+// 사용법은 print_usage 참고
+// 연결을 ramp 동안 나누어 열고, 모든 연결이 열린 뒤 duration 동안 보내고, 1초 더 받은 뒤 결과를 출력
+int main(int argc, char* argv[]) {
+    try {
+        BenchOptions options;
+        if (!parse_options(argc, argv, options)) {
+            print_usage();
+            return 1;
+        }
+        unsigned thread_count = options.threads > 0 ? static_cast<unsigned>(options.threads) : max(1u, thread::hardware_concurrency());
+        int senders = options.senders < 0 ? options.connections : min(options.senders, options.connections);
+
+        boost::asio::io_context io_context(static_cast<int>(thread_count));
+        auto work = boost::asio::make_work_guard(io_context);
+
+        BenchCounters counters;
+        HistogramRegistry histograms;
+        mt19937 random(12345);
+        uint32_t run_id = static_cast<uint32_t>(now_nanos() & 0x7FFFFFFF);
+        RoomPicker rooms(options.rooms, options.zipf);
+
+        vector<thread> workers;
+        for (unsigned i = 0; i < thread_count; ++i) {
+            workers.emplace_back([&io_context]() { io_context.run(); });
+        }
+
+        printf("scenario=%s connections=%d rooms=%d zipf=%.2f senders=%d rate=%.2f/s size=%zu slow=%.2f %s\n",
+            options.scenario.c_str(), options.connections, options.rooms, options.zipf, senders, options.rate,
+            options.message_size, options.slow_fraction, options.compress ? "binary+lz4" : options.binary ? "binary" : "text");
+
+        auto started = BenchClock::now();
+        auto stop_at = started + chrono::duration_cast<BenchClock::duration>(chrono::duration<double>(options.ramp_seconds + options.duration_seconds));
+        bernoulli_distribution slow(options.slow_fraction);
+
+        vector<unique_ptr<BenchClient>> clients;
+        clients.reserve(static_cast<size_t>(options.connections));
+        for (int i = 0; i < options.connections; ++i) {
+            // ramp 동안 고르게 연결 시작
+            if (options.ramp_seconds > 0) {
+                this_thread::sleep_until(started + chrono::duration_cast<BenchClock::duration>(
+                    chrono::duration<double>(options.ramp_seconds * i / options.connections)));
+            }
+            auto client = make_unique<BenchClient>(io_context, options, counters, histograms, run_id,
+                options.user_id_base + i, rooms.pick(random), i < senders, slow(random));
+            client->start(stop_at);
+            clients.push_back(move(client));
+        }
+
+        // 1초마다 진행 상황
+        uint64_t last_sent = 0;
+        uint64_t last_received = 0;
+        auto drain_until = stop_at + chrono::seconds(1);
+        for (int second = 1; BenchClock::now() < drain_until; ++second) {
+            this_thread::sleep_until(min(started + chrono::seconds(second), drain_until));
+            uint64_t sent = counters.sent.load();
+            uint64_t received = counters.received.load();
+            printf("[%3ds] connected=%llu joined=%llu failed=%llu dropped=%llu sent/s=%llu recv/s=%llu\n", second,
+                static_cast<unsigned long long>(counters.connected.load()), static_cast<unsigned long long>(counters.joined.load()),
+                static_cast<unsigned long long>(counters.failed.load()), static_cast<unsigned long long>(counters.disconnected.load()),
+                static_cast<unsigned long long>(sent - last_sent), static_cast<unsigned long long>(received - last_received));
+            fflush(stdout);
+            last_sent = sent;
+            last_received = received;
+        }
+
+        for (auto& client : clients) {
+            client->stop();
+        }
+        work.reset();
+        io_context.stop();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        double seconds = chrono::duration<double>(BenchClock::now() - started).count();
+        ThreadHistograms result = histograms.merged();
+        uint64_t received_bytes = 0;
+        for (auto& client : clients) {
+            received_bytes += client->received_bytes();
+        }
+        printf("\nsent=%llu received=%llu (%.0f msg/s, %.1f MB/s in) over %.1fs\n",
+            static_cast<unsigned long long>(counters.sent.load()), static_cast<unsigned long long>(counters.received.load()),
+            counters.received.load() / seconds, received_bytes / seconds / (1024 * 1024), seconds);
+        print_latency("broadcast", result.broadcast);
+        print_latency("join", result.join);
+    }
+    catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
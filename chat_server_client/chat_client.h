@@ -0,0 +1,769 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "chat_buffer.h"
+#include "chat_compress.h"
+#include "chat_pool.h"
+#include "chat_protocol.h"
+
+// 헤드리스 채팅 클라이언트 (봇, 연동 서비스, 부하 도구용)
+// 보내는 명령은 chat_protocol.h 의 encode_command 로 만들고, 받은 줄 / 프레임은 서버와 같은 split_text_command / BinaryReader 로 읽는다
+//
+// - send 는 어느 스레드에서든 부를 수 있고 응답을 기다리지 않는다, 쓰는 중에 쌓인 명령은 다음 async_write 한 번에 나간다
+// - 서버의 ping 에는 알아서 pong 으로 답한다, 텍스트로 접속하면 핸드셰이크 뒤에 ping 을 한 번 보내서 서버의 heartbeat 를 켠다
+// - 연결이 끊기면 간격을 늘려 가며 다시 접속한다, 서버가 내려가기 전에 준 재접속 토큰이 있으면 hello 대신 resume 으로 들어간다
+// - 끊긴 동안 보낸 명령은 쌓아 두었다가 다시 접속하면 보낸다, 끊길 때 쓰고 있던 명령은 다시 보내지 않는다 (최대 한 번)
+
+struct ChatClientOptions {
+    std::string host = "127.0.0.1";
+    std::string port = "12345";
+    int room_id = 1;
+    int user_id = 1;
+    bool binary = true;
+    bool compress = true;               // 바이너리일 때만, 서버에 codecs 를 보낸다 (chat_compress.h)
+    bool reconnect = true;
+    bool receive = true;                // false 면 읽지 않는다 (부하 도구의 느린 수신자), 입장 / 끊김 알림도 받지 못한다
+    std::chrono::milliseconds reconnect_min{ 100 };   // 첫 재접속 대기, 실패할 때마다 두 배 (지터 포함)
+    std::chrono::milliseconds reconnect_max{ 10000 };
+    size_t max_pending = 4 * 1024 * 1024;           // 아직 보내지 못한 바이트가 이보다 많으면 send 가 false
+    size_t receive_buffer = BINARY_HEADER_SIZE + BINARY_MAX_PAYLOAD;  // 한 줄 / 한 프레임의 최대 크기
+};
+
+// 기록 조회 / 검색 결과의 메시지 하나
+struct ChatTalk {
+    int64_t id = 0;
+    int user_id = 0;
+    int64_t published = 0;
+    std::string text;
+};
+
+// unread_summary 결과의 방 하나
+struct ChatUnread {
+    int room_id = 0;
+    int64_t last_read_id = 0;
+    uint64_t unread = 0;
+};
+
+// 접속해 있지 않은 동안 온 귓속말 / 초대 하나
+struct ChatNotice {
+    CommandType kind = CommandType::unknown;  // deliver_direct 또는 deliver_invite
+    int user_id = 0;                          // 보낸 사람 / 초대한 사람
+    int room_id = 0;                          // 초대만
+    int64_t published = 0;
+    std::string text;                         // 귓속말만
+};
+
+// 서버에서 온 메시지 하나, type 에 맞는 필드만 채워진다
+// text 는 수신 버퍼를 가리키므로 이벤트 콜백 안에서만 유효하다
+struct ChatEvent {
+    CommandType type = CommandType::unknown;
+    int room_id = 0;
+    int user_id = 0;        // deliver_direct 보낸 사람, deliver_invite 초대한 사람, auth_result 로그인한 유저
+    int status = 0;         // auth_result, chat_auth.h 의 AuthStatus
+    int offset = 0;         // search_result
+    uint64_t joined = 0;    // deliver_presence
+    uint64_t left = 0;
+    std::vector<int> joined_ids;
+    std::vector<int> left_ids;
+    std::string_view text;  // deliver_text / deliver_direct 본문, resume_token 토큰
+    std::vector<ChatTalk> talks;        // history_result / search_result
+    std::vector<ChatUnread> unread;     // unread_result
+    std::vector<ChatNotice> inbox;      // deliver_inbox
+
+    void clear() {
+        type = CommandType::unknown;
+        room_id = user_id = status = offset = 0;
+        joined = left = 0;
+        joined_ids.clear();
+        left_ids.clear();
+        text = {};
+        talks.clear();
+        unread.clear();
+        inbox.clear();
+    }
+};
+
+// 서버 → 클라이언트 메시지 해석 (형식은 chat_protocol.h)
+// 텍스트의 여러 줄 응답 (history? / search? / unread? / inbox? 뒤의 count 줄) 은 마지막 줄에서 이벤트 하나로 나온다
+class ChatEventDecoder {
+public:
+    // 바이너리 프레임 하나 (압축은 풀린 payload), 모르는 opcode 이거나 형식이 틀리면 false
+    bool decode_frame(CommandType type, std::string_view payload, ChatEvent& event) {
+        event.clear();
+        event.type = type;
+        BinaryReader reader(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+        uint64_t count = 0;
+        bool ok = false;
+        switch (type) {
+        case CommandType::deliver_text:
+            event.text = payload;
+            return true;
+        case CommandType::deliver_direct:
+            ok = reader.read_int(event.user_id) && reader.read_string(event.text);
+            break;
+        case CommandType::deliver_invite:
+            ok = reader.read_int(event.room_id) && reader.read_int(event.user_id);
+            break;
+        case CommandType::auth_result:
+            ok = reader.read_int(event.status) && reader.read_int(event.user_id);
+            break;
+        case CommandType::deliver_presence:
+            ok = reader.read_int(event.room_id) && reader.read_varint(event.joined) && reader.read_varint(event.left)
+                && read_ids(reader, event.joined_ids) && read_ids(reader, event.left_ids);
+            break;
+        case CommandType::resume_token:
+            ok = reader.read_string(event.text);
+            break;
+        case CommandType::history_result:
+        case CommandType::search_result:
+            ok = reader.read_int(event.room_id)
+                && (type == CommandType::history_result || reader.read_int(event.offset))
+                && reader.read_varint(count);
+            for (uint64_t i = 0; ok && i < count; ++i) {
+                ChatTalk talk;
+                std::string_view text;
+                ok = reader.read_int(talk.id) && reader.read_int(talk.user_id) && reader.read_int(talk.published)
+                    && reader.read_string(text);
+                talk.text = text;
+                event.talks.push_back(std::move(talk));
+            }
+            break;
+        case CommandType::unread_result:
+            ok = reader.read_varint(count);
+            for (uint64_t i = 0; ok && i < count; ++i) {
+                ChatUnread room;
+                ok = reader.read_int(room.room_id) && reader.read_int(room.last_read_id) && reader.read_varint(room.unread);
+                event.unread.push_back(room);
+            }
+            break;
+        case CommandType::deliver_inbox:
+            ok = reader.read_varint(count);
+            for (uint64_t i = 0; ok && i < count; ++i) {
+                ChatNotice notice;
+                uint64_t kind = 0;
+                std::string_view text;
+                ok = reader.read_varint(kind) && reader.read_int(notice.user_id) && reader.read_int(notice.room_id)
+                    && reader.read_int(notice.published) && reader.read_string(text);
+                notice.kind = static_cast<CommandType>(kind);
+                notice.text = text;
+                event.inbox.push_back(std::move(notice));
+            }
+            break;
+        case CommandType::ping:
+        case CommandType::pong:
+            ok = true;
+            break;
+        default:
+            break;
+        }
+        return ok && reader.at_end();
+    }
+
+    // 텍스트 줄 하나 (줄바꿈 제외), 이벤트가 완성됐으면 true
+    // 알림 형식이 아닌 줄은 모두 deliver_text
+    bool decode_line(std::string_view line, ChatEvent& event) {
+        if (group_left_ > 0) {
+            add_group_line(line);
+            if (--group_left_ > 0) {
+                return false;
+            }
+            std::swap(event, group_);
+            group_.clear();
+            return true;
+        }
+
+        event.clear();
+        std::string_view name;
+        std::string_view text;
+        TextParams params;
+        CommandType type = split_notice(line, name, text, params) ? notice_type(name) : CommandType::unknown;
+        if (type == CommandType::unknown) {
+            event.type = CommandType::deliver_text;
+            event.text = line;
+            return true;
+        }
+
+        event.type = type;
+        uint64_t count = 0;
+        switch (type) {
+        case CommandType::deliver_direct:
+            params.get_int("user_id", event.user_id);
+            event.text = text;
+            break;
+        case CommandType::deliver_invite:
+            params.get_int("room_id", event.room_id);
+            params.get_int("user_id", event.user_id);
+            break;
+        case CommandType::auth_result:
+            params.get_int("status", event.status);
+            params.get_int("user_id", event.user_id);
+            break;
+        case CommandType::deliver_presence:
+            params.get_int("room_id", event.room_id);
+            params.get_int("joined", event.joined);
+            params.get_int("left", event.left);
+            parse_ids(params.get("joined_ids"), event.joined_ids);
+            parse_ids(params.get("left_ids"), event.left_ids);
+            break;
+        case CommandType::resume_token:
+            event.text = params.get("token");
+            break;
+        case CommandType::history_result:
+        case CommandType::search_result:
+        case CommandType::unread_result:
+        case CommandType::deliver_inbox:
+            params.get_int("room_id", event.room_id);
+            params.get_int("offset", event.offset);
+            params.get_int("count", count);
+            if (count > 0) {
+                std::swap(group_, event);
+                event.clear();
+                group_left_ = count;
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    // 연결이 바뀌면 받다 만 여러 줄 응답을 버린다
+    void reset() {
+        group_.clear();
+        group_left_ = 0;
+    }
+
+private:
+    static bool read_ids(BinaryReader& reader, std::vector<int>& ids) {
+        uint64_t count = 0;
+        if (!reader.read_varint(count)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            int id = 0;
+            if (!reader.read_int(id)) {
+                return false;
+            }
+            ids.push_back(id);
+        }
+        return true;
+    }
+
+    static void parse_ids(std::string_view list, std::vector<int>& ids) {
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            int id = 0;
+            if (parse_int(list.substr(0, comma), id)) {
+                ids.push_back(id);
+            }
+            if (comma == std::string_view::npos) {
+                break;
+            }
+            list.remove_prefix(comma + 1);
+        }
+    }
+
+    // 본문 (text:) 은 항상 마지막 필드이고 '/' 가 들어 있을 수 있어서 나머지 필드와 따로 떼어 낸다
+    static bool split_notice(std::string_view line, std::string_view& name, std::string_view& text, TextParams& params) {
+        size_t question = line.find('?');
+        if (question == std::string_view::npos) {
+            return false;
+        }
+        size_t text_pos = line.find("text:", question + 1);
+        while (text_pos != std::string_view::npos && line[text_pos - 1] != '?' && line[text_pos - 1] != '/') {
+            text_pos = line.find("text:", text_pos + 1);
+        }
+        if (text_pos != std::string_view::npos) {
+            text = line.substr(text_pos + 5);
+            line = line.substr(0, text_pos - 1);
+        }
+        return split_text_command(line, name, params);
+    }
+
+    static CommandType notice_type(std::string_view name) {
+        static const std::pair<std::string_view, CommandType> names[] = {
+            { "direct", CommandType::deliver_direct },
+            { "invite", CommandType::deliver_invite },
+            { "auth", CommandType::auth_result },
+            { "presence", CommandType::deliver_presence },
+            { "resume", CommandType::resume_token },
+            { "history", CommandType::history_result },
+            { "search", CommandType::search_result },
+            { "unread", CommandType::unread_result },
+            { "inbox", CommandType::deliver_inbox },
+            { "ping", CommandType::ping },
+            { "pong", CommandType::pong },
+        };
+        for (const auto& entry : names) {
+            if (entry.first == name) {
+                return entry.second;
+            }
+        }
+        return CommandType::unknown;
+    }
+
+    void add_group_line(std::string_view line) {
+        std::string_view name;
+        std::string_view text;
+        TextParams params;
+        if (!split_notice(line, name, text, params)) {
+            return;
+        }
+        if (name == "talk") {
+            ChatTalk talk;
+            params.get_int("id", talk.id);
+            params.get_int("user_id", talk.user_id);
+            params.get_int("published", talk.published);
+            talk.text = text;
+            group_.talks.push_back(std::move(talk));
+        }
+        else if (name == "room") {
+            ChatUnread room;
+            params.get_int("room_id", room.room_id);
+            params.get_int("last_read_id", room.last_read_id);
+            params.get_int("unread", room.unread);
+            group_.unread.push_back(room);
+        }
+        else if (name == "direct" || name == "invite") {
+            ChatNotice notice;
+            notice.kind = notice_type(name);
+            params.get_int("user_id", notice.user_id);
+            params.get_int("room_id", notice.room_id);
+            params.get_int("published", notice.published);
+            notice.text = text;
+            group_.inbox.push_back(std::move(notice));
+        }
+    }
+
+    ChatEvent group_;           // 모으는 중인 여러 줄 응답
+    uint64_t group_left_ = 0;   // 남은 줄 수
+};
+
+enum class ChatClientState {
+    connecting,     // 접속 중, 재접속에 연달아 실패해도 한 번만
+    connected,      // TCP 연결이 되어 핸드셰이크를 보냈다
+    joined,         // 입장 알림 (JOIN_NOTICE) 을 받았다
+    disconnected    // 연결이 끊겼다, reconnect 면 곧 다시 connecting
+};
+
+// 콜백은 클라이언트의 strand 에서 호출되므로 오래 붙잡지 않는다
+// make_shared 로 만들고, start 전에 콜백을 건다
+class ChatClient : public std::enable_shared_from_this<ChatClient> {
+public:
+    using EventHandler = std::function<void(const ChatEvent&)>;
+    using StateHandler = std::function<void(ChatClientState)>;
+
+    ChatClient(boost::asio::io_context& io_context, ChatClientOptions options)
+        : strand_(boost::asio::make_strand(io_context)), resolver_(strand_), socket_(strand_), timer_(strand_),
+          options_(std::move(options)), buffer_(options_.receive_buffer), random_(std::random_device()()) {
+        if (!options_.binary) {
+            options_.compress = false;
+        }
+    }
+
+    void on_event(EventHandler handler) { event_handler_ = std::move(handler); }
+    void on_state(StateHandler handler) { state_handler_ = std::move(handler); }
+
+    void start() {
+        boost::asio::post(strand_, [this, self = shared_from_this()]() { connect(); });
+    }
+
+    // 다시 접속하지 않고 닫는다, 아직 보내지 못한 명령은 버린다
+    void stop() {
+        boost::asio::post(strand_, [this, self = shared_from_this()]() {
+            stopped_ = true;
+            timer_.cancel();
+            resolver_.cancel();
+            boost::system::error_code ignored;
+            socket_.close(ignored);
+        });
+    }
+
+    // 어느 스레드에서든, 인코딩할 수 없거나 쌓인 바이트가 max_pending 을 넘으면 false
+    bool send(const ChatCommand& command) {
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            if (pending_.size() >= options_.max_pending || !encode_command(options_.binary, command, pending_)) {
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            sent_.fetch_add(1, std::memory_order_relaxed);
+            if (flush_posted_ || !ready_) {
+                return true;
+            }
+            flush_posted_ = true;
+        }
+        boost::asio::post(strand_, [this, self = shared_from_this()]() { flush(); });
+        return true;
+    }
+
+    bool send_text(std::string_view text) {
+        ChatCommand command;
+        command.type = CommandType::send_text;
+        command.room_id = options_.room_id;
+        command.user_id = options_.user_id;
+        command.text = text;
+        return send(command);
+    }
+
+    bool send_direct(int target_user_id, std::string_view text) {
+        ChatCommand command;
+        command.type = CommandType::send_direct;
+        command.user_id = options_.user_id;
+        command.target_user_id = target_user_id;
+        command.text = text;
+        return send(command);
+    }
+
+    // before_id 가 0 이면 가장 최근부터
+    bool fetch_history(int64_t before_id, int limit) {
+        ChatCommand command;
+        command.type = CommandType::fetch_history;
+        command.room_id = options_.room_id;
+        command.before_id = before_id;
+        command.limit = limit;
+        return send(command);
+    }
+
+    bool search(std::string_view query, int offset, int limit) {
+        ChatCommand command;
+        command.type = CommandType::search_text;
+        command.room_id = options_.room_id;
+        command.offset = offset;
+        command.limit = limit;
+        command.text = query;
+        return send(command);
+    }
+
+    // last_read_id 가 0 이면 지금까지 받은 메시지 전부
+    bool mark_read(int64_t last_read_id = 0) {
+        ChatCommand command;
+        command.type = CommandType::mark_read;
+        command.room_id = options_.room_id;
+        command.last_read_id = last_read_id;
+        return send(command);
+    }
+
+    bool unread_summary() {
+        ChatCommand command;
+        command.type = CommandType::unread_summary;
+        return send(command);
+    }
+
+    const ChatClientOptions& options() const { return options_; }
+    uint64_t sent() const { return sent_.load(std::memory_order_relaxed); }
+    uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); }
+    uint64_t received() const { return received_.load(std::memory_order_relaxed); }
+    uint64_t received_bytes() const { return received_bytes_.load(std::memory_order_relaxed); }
+    uint64_t reconnects() const { return reconnects_.load(std::memory_order_relaxed); }
+
+private:
+    void connect() {
+        if (stopped_) {
+            return;
+        }
+        notify(ChatClientState::connecting);
+        auto self = shared_from_this();
+        uint64_t generation = generation_;
+        resolver_.async_resolve(options_.host, options_.port,
+            [this, self, generation](boost::system::error_code ec, boost::asio::ip::tcp::resolver::results_type results) {
+                if (generation != generation_) {
+                    return;
+                }
+                if (ec) {
+                    on_disconnected();
+                    return;
+                }
+                boost::asio::async_connect(socket_, results,
+                    [this, self, generation](boost::system::error_code ec, const boost::asio::ip::tcp::endpoint&) {
+                        if (generation != generation_) {
+                            return;
+                        }
+                        if (ec) {
+                            on_disconnected();
+                            return;
+                        }
+                        boost::system::error_code ignored;
+                        socket_.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+                        connected_ = true;
+                        send_handshake();
+                        notify(ChatClientState::connected);
+                        if (options_.receive) {
+                            do_read();
+                        }
+                    });
+            });
+    }
+
+    // 핸드셰이크는 끊긴 동안 쌓인 명령보다 앞에 나가야 한다
+    void send_handshake() {
+        ChatCommand command;
+        resuming_ = !resume_token_.empty();
+        if (resuming_) {
+            command.type = CommandType::resume;
+            command.token = resume_token_;
+        }
+        else {
+            command.type = CommandType::hello;
+            command.room_id = options_.room_id;
+            command.user_id = options_.user_id;
+        }
+        if (options_.compress) {
+            command.codecs = CODEC_LZ4_CHAT;
+        }
+
+        std::string handshake;
+        if (options_.binary) {
+            handshake.push_back(static_cast<char>(BINARY_PROTOCOL_MAGIC));
+        }
+        encode_command(options_.binary, command, handshake);
+        // 텍스트 세션은 ping 을 한 번 보내야 서버도 heartbeat 를 건다 (답할 수 있을 때만)
+        if (!options_.binary && options_.receive) {
+            ChatCommand ping;
+            ping.type = CommandType::ping;
+            encode_command(false, ping, handshake);
+        }
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            pending_.insert(0, handshake);
+            ready_ = true;
+            flush_posted_ = false;
+        }
+        flush();
+    }
+
+    // strand 에서만, 쓰기는 한 번에 하나
+    void flush() {
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            flush_posted_ = false;
+            if (writing_ || !connected_ || pending_.empty()) {
+                return;
+            }
+            sending_.swap(pending_);
+            pending_.clear();
+        }
+        writing_ = true;
+        auto self = shared_from_this();
+        uint64_t generation = generation_;
+        boost::asio::async_write(socket_, boost::asio::buffer(sending_), make_custom_alloc_handler(write_memory_,
+            [this, self, generation](boost::system::error_code ec, size_t) {
+                if (generation != generation_) {
+                    return;
+                }
+                writing_ = false;
+                sending_.clear();
+                if (ec) {
+                    on_disconnected();
+                    return;
+                }
+                flush();
+            }));
+    }
+
+    void do_read() {
+        auto self = shared_from_this();
+        uint64_t generation = generation_;
+        size_t writable;
+        char* target = buffer_.prepare(writable);
+        socket_.async_read_some(boost::asio::buffer(target, writable), make_custom_alloc_handler(read_memory_,
+            [this, self, generation](boost::system::error_code ec, size_t length) {
+                if (generation != generation_) {
+                    return;
+                }
+                if (ec) {
+                    on_disconnected();
+                    return;
+                }
+                buffer_.commit(length);
+                received_bytes_.fetch_add(length, std::memory_order_relaxed);
+                if (options_.binary ? process_frames() : process_lines()) {
+                    do_read();
+                }
+                else {
+                    on_disconnected();
+                }
+            }));
+    }
+
+    // 버퍼보다 긴 줄을 받으면 false
+    bool process_lines() {
+        for (;;) {
+            std::string_view data = buffer_.data();
+            size_t newline = data.find('\n');
+            if (newline == std::string_view::npos) {
+                return !buffer_.full();
+            }
+            std::string_view line = data.substr(0, newline);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (decoder_.decode_line(line, event_)) {
+                handle_event();
+            }
+            buffer_.consume(newline + 1);
+        }
+    }
+
+    // 압축을 풀 수 없으면 false, 모르는 opcode 나 해석할 수 없는 프레임은 건너뛴다 (새 서버의 알림)
+    bool process_frames() {
+        for (;;) {
+            std::string_view data = buffer_.data();
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+            CommandType type;
+            size_t payload_size;
+            uint8_t flags;
+            if (!decode_frame_header(bytes, data.size(), type, payload_size, flags) || data.size() < BINARY_HEADER_SIZE + payload_size) {
+                return true;
+            }
+            std::string_view payload = data.substr(BINARY_HEADER_SIZE, payload_size);
+            if (flags & FRAME_FLAG_COMPRESSED) {
+                if (!decompress_message(payload, decompressed_)) {
+                    return false;
+                }
+                payload = decompressed_;
+            }
+            if (decoder_.decode_frame(type, payload, event_)) {
+                handle_event();
+            }
+            buffer_.consume(BINARY_HEADER_SIZE + payload_size);
+        }
+    }
+
+    void handle_event() {
+        received_.fetch_add(1, std::memory_order_relaxed);
+        switch (event_.type) {
+        case CommandType::ping: {
+            ChatCommand pong;
+            pong.type = CommandType::pong;
+            send(pong);
+            return;
+        }
+        case CommandType::pong:
+            return;
+        case CommandType::resume_token:
+            resume_token_.assign(event_.text.data(), event_.text.size());
+            break;
+        case CommandType::deliver_text:
+            if (!joined_ && event_.text == JOIN_NOTICE) {
+                joined_ = true;
+                resuming_ = false;
+                resume_token_.clear();  // 토큰은 한 번만 쓴다
+                attempts_ = 0;
+                notify(ChatClientState::joined);
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+        if (event_handler_) {
+            event_handler_(event_);
+        }
+    }
+
+    void on_disconnected() {
+        ++generation_;
+        bool was_connected = connected_;
+        if (resuming_ && !joined_) {
+            resume_token_.clear();  // 토큰이 틀렸거나 만료돼서 서버가 닫았다, 다음은 hello
+        }
+        resuming_ = false;
+        connected_ = false;
+        joined_ = false;
+        writing_ = false;
+        sending_.clear();
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            ready_ = false;
+            flush_posted_ = false;
+        }
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        buffer_.consume(buffer_.size());
+        decoder_.reset();
+        if (was_connected || stopped_ || !options_.reconnect) {
+            notify(ChatClientState::disconnected);
+        }
+
+        if (stopped_ || !options_.reconnect) {
+            return;
+        }
+        auto base = options_.reconnect_min * (int64_t(1) << std::min(attempts_, 16u));
+        auto delay = std::min<std::chrono::milliseconds>(base, options_.reconnect_max);
+        std::uniform_real_distribution<double> jitter(0.5, 1.0);  // 한꺼번에 끊긴 클라이언트가 같은 순간에 몰리지 않게
+        ++attempts_;
+        timer_.expires_after(std::chrono::duration_cast<std::chrono::milliseconds>(delay * jitter(random_)));
+        timer_.async_wait([this, self = shared_from_this()](boost::system::error_code ec) {
+            if (ec || stopped_) {
+                return;
+            }
+            reconnects_.fetch_add(1, std::memory_order_relaxed);
+            connect();
+        });
+    }
+
+    void notify(ChatClientState state) {
+        if (state == state_) {
+            return;
+        }
+        state_ = state;
+        if (state_handler_) {
+            state_handler_(state);
+        }
+    }
+
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    boost::asio::ip::tcp::resolver resolver_;
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    ChatClientOptions options_;
+    EventHandler event_handler_;
+    StateHandler state_handler_;
+
+    // strand 안에서만
+    ReceiveBuffer buffer_;
+    ChatEventDecoder decoder_;
+    ChatEvent event_;
+    std::string decompressed_;  // 압축된 프레임을 푼 결과, 다음 프레임에서 다시 쓴다
+    std::string sending_;       // 쓰는 중인 바이트
+    std::string resume_token_;
+    std::mt19937 random_;
+    uint64_t generation_ = 0;   // 연결마다 늘어난다, 앞 연결의 콜백은 무시
+    ChatClientState state_ = ChatClientState::disconnected;
+    unsigned attempts_ = 0;     // 입장하지 못하고 연달아 실패한 접속 수
+    bool connected_ = false;
+    bool joined_ = false;
+    bool writing_ = false;
+    bool resuming_ = false;
+    bool stopped_ = false;
+    HandlerMemory read_memory_;
+    HandlerMemory write_memory_;
+
+    // send 는 어느 스레드에서든 부르므로 mutex 로
+    std::mutex pending_mutex_;
+    std::string pending_;       // 다음 쓰기에 나갈 바이트
+    bool ready_ = false;        // 핸드셰이크를 보냈다, 아니면 쌓아 두기만 한다
+    bool flush_posted_ = false;
+
+    std::atomic<uint64_t> sent_{ 0 };
+    std::atomic<uint64_t> rejected_{ 0 };
+    std::atomic<uint64_t> received_{ 0 };
+    std::atomic<uint64_t> received_bytes_{ 0 };
+    std::atomic<uint64_t> reconnects_{ 0 };
+};
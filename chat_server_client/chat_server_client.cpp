@@ -1,180 +1,211 @@
-﻿// chat_server_client.cpp : 애플리케이션에 대한 진입점을 정의합니다.
-//
-
-#include "framework.h"
-#include "chat_server_client.h"
-
-#define MAX_LOADSTRING 100
-
-// 전역 변수:
-HINSTANCE hInst;                                // 현재 인스턴스입니다.
-WCHAR szTitle[MAX_LOADSTRING];                  // 제목 표시줄 텍스트입니다.
-WCHAR szWindowClass[MAX_LOADSTRING];            // 기본 창 클래스 이름입니다.
-
-// 이 코드 모듈에 포함된 함수의 선언을 전달합니다:
-ATOM                MyRegisterClass(HINSTANCE hInstance);
-BOOL                InitInstance(HINSTANCE, int);
-LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
-INT_PTR CALLBACK    About(HWND, UINT, WPARAM, LPARAM);
-
-int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
-                     _In_opt_ HINSTANCE hPrevInstance,
-                     _In_ LPWSTR    lpCmdLine,
-                     _In_ int       nCmdShow)
-{
-    UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
-
-    // TODO: 여기에 코드를 입력합니다.
-
-    // 전역 문자열을 초기화합니다.
-    LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_LOADSTRING);
-    LoadStringW(hInstance, IDC_CHATSERVERCLIENT, szWindowClass, MAX_LOADSTRING);
-    MyRegisterClass(hInstance);
-
-    // 애플리케이션 초기화를 수행합니다:
-    if (!InitInstance (hInstance, nCmdShow))
-    {
-        return FALSE;
-    }
-
-    HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_CHATSERVERCLIENT));
-
-    MSG msg;
+﻿#include <boost/asio.hpp>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "chat_client.h"
+
+using namespace std;
+
+// 헤드리스 채팅 클라이언트 (chat_client.h) 를 쓰는 콘솔 도구
+// 표준 입력 한 줄을 채팅으로 보내고, 받은 것을 한 줄씩 출력한다, '/' 로 시작하는 줄은 명령 (print_usage 참고)
+// 표준 입력이 끝나면 닫는다
+
+void print_usage() {
+    cerr << "usage: chat_server_client [options]\n"
+        "  --host H --port P          server address (127.0.0.1:12345)\n"
+        "  --room R --user U          room and user to join (1, 1)\n"
+        "  --text                     use the text protocol (default binary)\n"
+        "  --no-compress              don't ask for compressed server frames\n"
+        "  --no-reconnect             exit instead of reconnecting\n"
+        "stdin lines are sent as chat, except:\n"
+        "  /dm USER TEXT              direct message\n"
+        "  /history [BEFORE_ID] [N]   recent messages (newest first)\n"
+        "  /search [OFFSET] QUERY     full text search in the room\n"
+        "  /read [LAST_READ_ID]       mark the room read (0 = everything so far)\n"
+        "  /unread                    unread counts for every read-marked room\n";
+}
 
-    // 기본 메시지 루프입니다:
-    while (GetMessage(&msg, nullptr, 0, 0))
-    {
-        if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
-        {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
+bool parse_options(int argc, char* argv[], ChatClientOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        string_view flag = argv[i];
+        if (flag == "--text") {
+            options.binary = false;
+            options.compress = false;
+            continue;
+        }
+        if (flag == "--no-compress") {
+            options.compress = false;
+            continue;
+        }
+        if (flag == "--no-reconnect") {
+            options.reconnect = false;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cerr << "Missing value for " << flag << endl;
+            return false;
+        }
+        string value = argv[++i];
+        if (flag == "--host") { options.host = value; }
+        else if (flag == "--port") { options.port = value; }
+        else if (flag == "--room") { options.room_id = stoi(value); }
+        else if (flag == "--user") { options.user_id = stoi(value); }
+        else {
+            cerr << "Unknown option: " << flag << endl;
+            return false;
         }
     }
-
-    return (int) msg.wParam;
-}
-
-
-
-//
-//  함수: MyRegisterClass()
-//
-//  용도: 창 클래스를 등록합니다.
-//
-ATOM MyRegisterClass(HINSTANCE hInstance)
-{
-    WNDCLASSEXW wcex;
-
-    wcex.cbSize = sizeof(WNDCLASSEX);
-
-    wcex.style          = CS_HREDRAW | CS_VREDRAW;
-    wcex.lpfnWndProc    = WndProc;
-    wcex.cbClsExtra     = 0;
-    wcex.cbWndExtra     = 0;
-    wcex.hInstance      = hInstance;
-    wcex.hIcon          = LoadIcon(hInstance, MAKEINTRESOURCE(IDI_CHATSERVERCLIENT));
-    wcex.hCursor        = LoadCursor(nullptr, IDC_ARROW);
-    wcex.hbrBackground  = (HBRUSH)(COLOR_WINDOW+1);
-    wcex.lpszMenuName   = MAKEINTRESOURCEW(IDC_CHATSERVERCLIENT);
-    wcex.lpszClassName  = szWindowClass;
-    wcex.hIconSm        = LoadIcon(wcex.hInstance, MAKEINTRESOURCE(IDI_SMALL));
-
-    return RegisterClassExW(&wcex);
+    return true;
 }
 
-//
-//   함수: InitInstance(HINSTANCE, int)
-//
-//   용도: 인스턴스 핸들을 저장하고 주 창을 만듭니다.
-//
-//   주석:
-//
-//        이 함수를 통해 인스턴스 핸들을 전역 변수에 저장하고
-//        주 프로그램 창을 만든 다음 표시합니다.
-//
-BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
-{
-   hInst = hInstance; // 인스턴스 핸들을 전역 변수에 저장합니다.
-
-   HWND hWnd = CreateWindowW(szWindowClass, szTitle, WS_OVERLAPPEDWINDOW,
-      CW_USEDEFAULT, 0, CW_USEDEFAULT, 0, nullptr, nullptr, hInstance, nullptr);
-
-   if (!hWnd)
-   {
-      return FALSE;
-   }
-
-   ShowWindow(hWnd, nCmdShow);
-   UpdateWindow(hWnd);
-
-   return TRUE;
+void print_talks(const char* kind, const ChatEvent& event) {
+    printf("[%s room %d] %zu messages\n", kind, event.room_id, event.talks.size());
+    for (const auto& talk : event.talks) {
+        printf("  #%lld user %d: %s\n", static_cast<long long>(talk.id), talk.user_id, talk.text.c_str());
+    }
 }
 
-//
-//  함수: WndProc(HWND, UINT, WPARAM, LPARAM)
-//
-//  용도: 주 창의 메시지를 처리합니다.
-//
-//  WM_COMMAND  - 애플리케이션 메뉴를 처리합니다.
-//  WM_PAINT    - 주 창을 그립니다.
-//  WM_DESTROY  - 종료 메시지를 게시하고 반환합니다.
-//
-//
-LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
-{
-    switch (message)
-    {
-    case WM_COMMAND:
-        {
-            int wmId = LOWORD(wParam);
-            // 메뉴 선택을 구문 분석합니다:
-            switch (wmId)
-            {
-            case IDM_ABOUT:
-                DialogBox(hInst, MAKEINTRESOURCE(IDD_ABOUTBOX), hWnd, About);
-                break;
-            case IDM_EXIT:
-                DestroyWindow(hWnd);
-                break;
-            default:
-                return DefWindowProc(hWnd, message, wParam, lParam);
-            }
-        }
+void print_event(const ChatEvent& event) {
+    string text(event.text);
+    switch (event.type) {
+    case CommandType::deliver_text:
+        printf("%s\n", text.c_str());
+        break;
+    case CommandType::deliver_direct:
+        printf("[dm from %d] %s\n", event.user_id, text.c_str());
         break;
-    case WM_PAINT:
-        {
-            PAINTSTRUCT ps;
-            HDC hdc = BeginPaint(hWnd, &ps);
-            // TODO: 여기에 hdc를 사용하는 그리기 코드를 추가합니다...
-            EndPaint(hWnd, &ps);
+    case CommandType::deliver_invite:
+        printf("[invite] user %d invited you to room %d\n", event.user_id, event.room_id);
+        break;
+    case CommandType::auth_result:
+        printf("[auth] status %d user %d\n", event.status, event.user_id);
+        break;
+    case CommandType::deliver_presence:
+        printf("[presence room %d] %llu joined, %llu left\n", event.room_id,
+            static_cast<unsigned long long>(event.joined), static_cast<unsigned long long>(event.left));
+        break;
+    case CommandType::resume_token:
+        printf("[server draining, will resume]\n");
+        break;
+    case CommandType::history_result:
+        print_talks("history", event);
+        break;
+    case CommandType::search_result:
+        print_talks("search", event);
+        break;
+    case CommandType::unread_result:
+        for (const auto& room : event.unread) {
+            printf("[unread room %d] %llu (last read #%lld)\n", room.room_id,
+                static_cast<unsigned long long>(room.unread), static_cast<long long>(room.last_read_id));
+        }
+        if (event.unread.empty()) {
+            printf("[unread] none\n");
         }
         break;
-    case WM_DESTROY:
-        PostQuitMessage(0);
+    case CommandType::deliver_inbox:
+        for (const auto& notice : event.inbox) {
+            if (notice.kind == CommandType::deliver_invite) {
+                printf("[while away] user %d invited you to room %d\n", notice.user_id, notice.room_id);
+            }
+            else {
+                printf("[while away, dm from %d] %s\n", notice.user_id, notice.text.c_str());
+            }
+        }
         break;
     default:
-        return DefWindowProc(hWnd, message, wParam, lParam);
+        break;
     }
-    return 0;
+    fflush(stdout);
+}
+
+// 숫자로 시작하면 떼어 낸다
+bool take_number(string_view& rest, long long& value) {
+    size_t end = rest.find(' ');
+    if (!parse_int(rest.substr(0, end), value)) {
+        return false;
+    }
+    rest = end == string_view::npos ? string_view() : rest.substr(end + 1);
+    return true;
+}
+
+bool run_command(ChatClient& client, string_view line) {
+    size_t space = line.find(' ');
+    string_view name = line.substr(0, space);
+    string_view rest = space == string_view::npos ? string_view() : line.substr(space + 1);
+    long long number = 0;
+    if (name == "/dm") {
+        return take_number(rest, number) && !rest.empty() && client.send_direct(static_cast<int>(number), rest);
+    }
+    if (name == "/history") {
+        long long before_id = 0;
+        long long limit = 20;
+        take_number(rest, before_id);
+        take_number(rest, limit);
+        return client.fetch_history(before_id, static_cast<int>(limit));
+    }
+    if (name == "/search") {
+        take_number(rest, number);
+        return !rest.empty() && client.search(rest, static_cast<int>(number), 20);
+    }
+    if (name == "/read") {
+        take_number(rest, number);
+        return client.mark_read(number);
+    }
+    if (name == "/unread") {
+        return client.unread_summary();
+    }
+    return false;
 }
 
-// 정보 대화 상자의 메시지 처리기입니다.
-INT_PTR CALLBACK About(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
-{
-    UNREFERENCED_PARAMETER(lParam);
-    switch (message)
-    {
-    case WM_INITDIALOG:
-        return (INT_PTR)TRUE;
+int main(int argc, char* argv[]) {
+    try {
+        ChatClientOptions options;
+        if (!parse_options(argc, argv, options)) {
+            print_usage();
+            return 1;
+        }
 
-    case WM_COMMAND:
-        if (LOWORD(wParam) == IDOK || LOWORD(wParam) == IDCANCEL)
-        {
-            EndDialog(hDlg, LOWORD(wParam));
-            return (INT_PTR)TRUE;
+        boost::asio::io_context io_context(1);
+        auto work = boost::asio::make_work_guard(io_context);
+        auto client = make_shared<ChatClient>(io_context, options);
+        client->on_event(print_event);
+        client->on_state([&options](ChatClientState state) {
+            if (state == ChatClientState::joined) {
+                printf("[joined room %d as user %d]\n", options.room_id, options.user_id);
+            }
+            else if (state == ChatClientState::disconnected) {
+                printf("[disconnected]\n");
+            }
+            fflush(stdout);
+        });
+        client->start();
+        thread worker([&io_context]() { io_context.run(); });
+
+        string line;
+        while (getline(cin, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+            bool ok = line[0] == '/' ? run_command(*client, line) : client->send_text(line);
+            if (!ok) {
+                fprintf(stderr, "not sent: %s\n", line.c_str());
+            }
         }
-        break;
+
+        client->stop();
+        work.reset();
+        worker.join();
     }
-    return (INT_PTR)FALSE;
+    catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
 }
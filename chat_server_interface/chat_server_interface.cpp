@@ -1,180 +1,217 @@
-﻿// chat_server_interface.cpp : 애플리케이션에 대한 진입점을 정의합니다.
-//
+﻿#include <boost/asio.hpp>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
 
-#include "framework.h"
-#include "chat_server_interface.h"
-
-#define MAX_LOADSTRING 100
-
-// 전역 변수:
-HINSTANCE hInst;                                // 현재 인스턴스입니다.
-WCHAR szTitle[MAX_LOADSTRING];                  // 제목 표시줄 텍스트입니다.
-WCHAR szWindowClass[MAX_LOADSTRING];            // 기본 창 클래스 이름입니다.
-
-// 이 코드 모듈에 포함된 함수의 선언을 전달합니다:
-ATOM                MyRegisterClass(HINSTANCE hInstance);
-BOOL                InitInstance(HINSTANCE, int);
-LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
-INT_PTR CALLBACK    About(HWND, UINT, WPARAM, LPARAM);
-
-int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
-                     _In_opt_ HINSTANCE hPrevInstance,
-                     _In_ LPWSTR    lpCmdLine,
-                     _In_ int       nCmdShow)
-{
-    UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
-
-    // TODO: 여기에 코드를 입력합니다.
-
-    // 전역 문자열을 초기화합니다.
-    LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_LOADSTRING);
-    LoadStringW(hInstance, IDC_CHATSERVERINTERFACE, szWindowClass, MAX_LOADSTRING);
-    MyRegisterClass(hInstance);
-
-    // 애플리케이션 초기화를 수행합니다:
-    if (!InitInstance (hInstance, nCmdShow))
-    {
-        return FALSE;
-    }
+#include "chat_client.h"
 
-    HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_CHATSERVERINTERFACE));
+using namespace std;
 
-    MSG msg;
+// 연동 서비스용 파이프 브리지, 헤드리스 채팅 클라이언트 (chat_client.h) 위에서 돈다
+// 다른 프로세스가 표준 입출력으로 붙여 쓰도록 사람이 읽는 chat_server_client 와 달리 한 줄에 한 항목, 탭으로 나눈 필드로만 주고받는다
+//
+// 입력: 서버의 텍스트 명령 한 줄 (send_direct?user_id:1/target_user_id:2/text:hi 처럼, 형식은 chat_protocol.h)
+//       명령 형식이 아닌 줄은 입장한 방에 보내는 채팅
+// 출력: 종류 \t 필드... , 본문 (text) 은 항상 마지막 필드이고 \t \n \\ 는 \t \n \\ 로 이스케이프한다
+//   state     connecting | connected | joined | disconnected
+//   text      본문
+//   direct    보낸 user_id, 본문
+//   invite    room_id, 초대한 user_id
+//   auth      status, user_id
+//   presence  room_id, 들어온 수, 나간 수
+//   talk      history | search, room_id, id, user_id, published, 본문 (결과 한 건마다, 다음 줄에 end)
+//   unread    room_id, last_read_id, 안 읽은 수 (방마다, 다음 줄에 end)
+//   away      direct | invite, user_id, room_id, published, 본문 (접속하지 않은 동안 온 것마다, 다음 줄에 end)
+//   end       history | search | unread | inbox, 건수
+//   rejected  보내지 못한 입력 줄
+// 표준 입력이 끝나면 닫는다
+
+void print_usage() {
+    cerr << "usage: chat_server_interface [options]\n"
+        "  --host H --port P          server address (127.0.0.1:12345)\n"
+        "  --room R --user U          room and user to join (1, 1)\n"
+        "  --text                     use the text protocol (default binary)\n"
+        "  --no-reconnect             exit instead of reconnecting\n"
+        "stdin: one text protocol command per line, anything else is chat\n"
+        "stdout: one tab separated event per line\n";
+}
 
-    // 기본 메시지 루프입니다:
-    while (GetMessage(&msg, nullptr, 0, 0))
-    {
-        if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
-        {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
+bool parse_options(int argc, char* argv[], ChatClientOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        string_view flag = argv[i];
+        if (flag == "--text") {
+            options.binary = false;
+            options.compress = false;
+            continue;
+        }
+        if (flag == "--no-reconnect") {
+            options.reconnect = false;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cerr << "Missing value for " << flag << endl;
+            return false;
+        }
+        string value = argv[++i];
+        if (flag == "--host") { options.host = value; }
+        else if (flag == "--port") { options.port = value; }
+        else if (flag == "--room") { options.room_id = stoi(value); }
+        else if (flag == "--user") { options.user_id = stoi(value); }
+        else {
+            cerr << "Unknown option: " << flag << endl;
+            return false;
         }
     }
-
-    return (int) msg.wParam;
+    return true;
 }
 
+// 한 줄 출력 버퍼, 필드를 붙이고 emit 으로 한 번에 쓴다 (출력은 모두 io 스레드 하나에서 하므로 줄이 섞이지 않는다)
+class EventLine {
+public:
+    explicit EventLine(string_view kind) : line_(kind) {}
 
+    EventLine& field(long long value) {
+        line_ += '\t';
+        line_ += to_string(value);
+        return *this;
+    }
 
-//
-//  함수: MyRegisterClass()
-//
-//  용도: 창 클래스를 등록합니다.
-//
-ATOM MyRegisterClass(HINSTANCE hInstance)
-{
-    WNDCLASSEXW wcex;
-
-    wcex.cbSize = sizeof(WNDCLASSEX);
-
-    wcex.style          = CS_HREDRAW | CS_VREDRAW;
-    wcex.lpfnWndProc    = WndProc;
-    wcex.cbClsExtra     = 0;
-    wcex.cbWndExtra     = 0;
-    wcex.hInstance      = hInstance;
-    wcex.hIcon          = LoadIcon(hInstance, MAKEINTRESOURCE(IDI_CHATSERVERINTERFACE));
-    wcex.hCursor        = LoadCursor(nullptr, IDC_ARROW);
-    wcex.hbrBackground  = (HBRUSH)(COLOR_WINDOW+1);
-    wcex.lpszMenuName   = MAKEINTRESOURCEW(IDC_CHATSERVERINTERFACE);
-    wcex.lpszClassName  = szWindowClass;
-    wcex.hIconSm        = LoadIcon(wcex.hInstance, MAKEINTRESOURCE(IDI_SMALL));
-
-    return RegisterClassExW(&wcex);
-}
-
-//
-//   함수: InitInstance(HINSTANCE, int)
-//
-//   용도: 인스턴스 핸들을 저장하고 주 창을 만듭니다.
-//
-//   주석:
-//
-//        이 함수를 통해 인스턴스 핸들을 전역 변수에 저장하고
-//        주 프로그램 창을 만든 다음 표시합니다.
-//
-BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
-{
-   hInst = hInstance; // 인스턴스 핸들을 전역 변수에 저장합니다.
-
-   HWND hWnd = CreateWindowW(szWindowClass, szTitle, WS_OVERLAPPEDWINDOW,
-      CW_USEDEFAULT, 0, CW_USEDEFAULT, 0, nullptr, nullptr, hInstance, nullptr);
+    EventLine& field(string_view text) {
+        line_ += '\t';
+        for (char c : text) {
+            switch (c) {
+            case '\t': line_ += "\\t"; break;
+            case '\n': line_ += "\\n"; break;
+            case '\\': line_ += "\\\\"; break;
+            default: line_ += c; break;
+            }
+        }
+        return *this;
+    }
 
-   if (!hWnd)
-   {
-      return FALSE;
-   }
+    void emit() {
+        line_ += '\n';
+        fwrite(line_.data(), 1, line_.size(), stdout);
+    }
 
-   ShowWindow(hWnd, nCmdShow);
-   UpdateWindow(hWnd);
+private:
+    string line_;
+};
 
-   return TRUE;
+void emit_talks(string_view kind, const ChatEvent& event) {
+    for (const auto& talk : event.talks) {
+        EventLine("talk").field(kind).field(event.room_id).field(talk.id).field(talk.user_id).field(talk.published)
+            .field(talk.text).emit();
+    }
+    EventLine("end").field(kind).field(static_cast<long long>(event.talks.size())).emit();
 }
 
-//
-//  함수: WndProc(HWND, UINT, WPARAM, LPARAM)
-//
-//  용도: 주 창의 메시지를 처리합니다.
-//
-//  WM_COMMAND  - 애플리케이션 메뉴를 처리합니다.
-//  WM_PAINT    - 주 창을 그립니다.
-//  WM_DESTROY  - 종료 메시지를 게시하고 반환합니다.
-//
-//
-LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
-{
-    switch (message)
-    {
-    case WM_COMMAND:
-        {
-            int wmId = LOWORD(wParam);
-            // 메뉴 선택을 구문 분석합니다:
-            switch (wmId)
-            {
-            case IDM_ABOUT:
-                DialogBox(hInst, MAKEINTRESOURCE(IDD_ABOUTBOX), hWnd, About);
-                break;
-            case IDM_EXIT:
-                DestroyWindow(hWnd);
-                break;
-            default:
-                return DefWindowProc(hWnd, message, wParam, lParam);
-            }
-        }
+void emit_event(const ChatEvent& event) {
+    switch (event.type) {
+    case CommandType::deliver_text:
+        EventLine("text").field(event.text).emit();
+        break;
+    case CommandType::deliver_direct:
+        EventLine("direct").field(event.user_id).field(event.text).emit();
+        break;
+    case CommandType::deliver_invite:
+        EventLine("invite").field(event.room_id).field(event.user_id).emit();
+        break;
+    case CommandType::auth_result:
+        EventLine("auth").field(event.status).field(event.user_id).emit();
         break;
-    case WM_PAINT:
-        {
-            PAINTSTRUCT ps;
-            HDC hdc = BeginPaint(hWnd, &ps);
-            // TODO: 여기에 hdc를 사용하는 그리기 코드를 추가합니다...
-            EndPaint(hWnd, &ps);
+    case CommandType::deliver_presence:
+        EventLine("presence").field(event.room_id).field(static_cast<long long>(event.joined))
+            .field(static_cast<long long>(event.left)).emit();
+        break;
+    case CommandType::history_result:
+        emit_talks("history", event);
+        break;
+    case CommandType::search_result:
+        emit_talks("search", event);
+        break;
+    case CommandType::unread_result:
+        for (const auto& room : event.unread) {
+            EventLine("unread").field(room.room_id).field(room.last_read_id).field(static_cast<long long>(room.unread)).emit();
         }
+        EventLine("end").field("unread").field(static_cast<long long>(event.unread.size())).emit();
         break;
-    case WM_DESTROY:
-        PostQuitMessage(0);
+    case CommandType::deliver_inbox:
+        for (const auto& notice : event.inbox) {
+            EventLine("away").field(notice.kind == CommandType::deliver_invite ? "invite" : "direct")
+                .field(notice.user_id).field(notice.room_id).field(notice.published).field(notice.text).emit();
+        }
+        EventLine("end").field("inbox").field(static_cast<long long>(event.inbox.size())).emit();
         break;
     default:
-        return DefWindowProc(hWnd, message, wParam, lParam);
+        return;
     }
-    return 0;
+    fflush(stdout);
+}
+
+void emit_state(ChatClientState state) {
+    static const char* const NAMES[] = { "connecting", "connected", "joined", "disconnected" };
+    EventLine("state").field(NAMES[static_cast<int>(state)]).emit();
+    fflush(stdout);
 }
 
-// 정보 대화 상자의 메시지 처리기입니다.
-INT_PTR CALLBACK About(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
-{
-    UNREFERENCED_PARAMETER(lParam);
-    switch (message)
-    {
-    case WM_INITDIALOG:
-        return (INT_PTR)TRUE;
-
-    case WM_COMMAND:
-        if (LOWORD(wParam) == IDOK || LOWORD(wParam) == IDCANCEL)
-        {
-            EndDialog(hDlg, LOWORD(wParam));
-            return (INT_PTR)TRUE;
+// 서버가 받는 텍스트 명령이면 서버와 같은 파서로 읽어서 보낸다 (바이너리 연결이면 프레임으로 바뀐다)
+bool send_line(ChatClient& client, string_view line) {
+    string_view name;
+    TextParams params;
+    ChatCommand command;
+    if (!split_text_command(line, name, params)) {
+        return client.send_text(line);
+    }
+    command.type = lookup_text_command(name);
+    if (command.type == CommandType::unknown) {
+        return client.send_text(line);
+    }
+    return build_text_command(command.type, params, command) && client.send(command);
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        ChatClientOptions options;
+        if (!parse_options(argc, argv, options)) {
+            print_usage();
+            return 1;
         }
-        break;
+
+        boost::asio::io_context io_context(1);
+        auto work = boost::asio::make_work_guard(io_context);
+        auto client = make_shared<ChatClient>(io_context, options);
+        client->on_event(emit_event);
+        client->on_state(emit_state);
+        client->start();
+        thread worker([&io_context]() { io_context.run(); });
+
+        string line;
+        while (getline(cin, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+            if (!send_line(*client, line)) {
+                boost::asio::post(io_context, [line]() {
+                    EventLine("rejected").field(line).emit();
+                    fflush(stdout);
+                });
+            }
+        }
+
+        client->stop();
+        work.reset();
+        worker.join();
+    }
+    catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
     }
-    return (INT_PTR)FALSE;
+    return 0;
 }
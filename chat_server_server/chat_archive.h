@@ -0,0 +1,506 @@
+#pragma once
+
+#include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "chat_config.h"
+#include "chat_db.h"
+#include "chat_log.h"
+#include "chat_metrics.h"
+#include "chat_protocol.h"
+
+// talks 월별 보관
+// talks 에는 최근 몇 달만 두고, 그보다 오래된 달은 data/archive/talks_YYYY_MM.db 로 옮긴 뒤 정리 (VACUUM) 해서 읽기 전용으로 얼린다
+// talks 가 작게 유지되므로 기록 배치의 삽입 / 색인 비용과 백업 크기가 쌓인 기록 양에 따라 늘지 않는다
+// 얼린 파일은 다시 바뀌지 않으므로 immutable 로 열어서 잠금 없이 읽고, 백업도 한 번만 하면 된다
+// 얼린 파일 목록은 본 DB 의 talk_partitions 에 남긴다
+//
+// 기록 조회 / 검색은 talks 를 먼저 읽고, 모자라면 최신 달의 파일부터 이어 읽는다 (load_room_history, search_history)
+//
+// 한 달을 옮기는 순서, 어디서 멈춰도 다음 실행이 이어서 끝낸다
+//   1. 보관 파일에 복사하고 검색 색인을 만든다 (INSERT OR IGNORE 라 다시 해도 된다)
+//   2. 파일을 정리하고 읽기 전용으로 바꾼 뒤 talk_partitions 에 등록, 이때부터 읽는 쪽이 이 파일을 본다
+//   3. talks 에서 보관 파일에 들어간 행만 id 구간씩 나눠 지운다, 기록 스레드는 쓰기 잠금을 잠깐씩만 기다린다
+
+inline const std::string ARCHIVE_DIR = "data/archive";
+
+struct TalkPartition {
+    std::string month;         // "YYYY-MM"
+    std::string path;
+    sqlite3_int64 min_id = 0;
+    sqlite3_int64 max_id = 0;
+    sqlite3_int64 rows = 0;
+};
+
+// 얼린 보관 파일 목록, 최신 달 (max_id 가 큰 것) 이 앞
+// 보관 스레드가 쓰고 io / 검색 스레드가 읽는다
+class TalkPartitions {
+public:
+    // 시작할 때 한 번
+    bool load(DBConnection& db) {
+        DBStatement stmt = db.prepare("SELECT month, path, min_id, max_id, rows FROM talk_partitions ORDER BY max_id DESC;");
+        if (!stmt) {
+            return false;
+        }
+        std::vector<TalkPartition> partitions;
+        int rc;
+        while ((rc = stmt.step()) == SQLITE_ROW) {
+            TalkPartition partition;
+            partition.month = column_string(stmt, 0);
+            partition.path = column_string(stmt, 1);
+            partition.min_id = sqlite3_column_int64(stmt.get(), 2);
+            partition.max_id = sqlite3_column_int64(stmt.get(), 3);
+            partition.rows = sqlite3_column_int64(stmt.get(), 4);
+            partitions.push_back(std::move(partition));
+        }
+        if (rc != SQLITE_DONE) {
+            CHAT_LOG_ERROR << "Failed to load talk partitions: " << db.last_error();
+            return false;
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        partitions_ = std::move(partitions);
+        return true;
+    }
+
+    void add(TalkPartition partition) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        partitions_.erase(std::remove_if(partitions_.begin(), partitions_.end(),
+            [&](const TalkPartition& existing) { return existing.month == partition.month; }), partitions_.end());
+        auto position = std::find_if(partitions_.begin(), partitions_.end(),
+            [&](const TalkPartition& existing) { return existing.max_id < partition.max_id; });
+        partitions_.insert(position, std::move(partition));
+    }
+
+    // before_id 보다 작은 id 가 들어 있는 파일들, 최신 것부터
+    std::vector<TalkPartition> older_than(sqlite3_int64 before_id) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        std::vector<TalkPartition> result;
+        for (const auto& partition : partitions_) {
+            if (partition.min_id < before_id) {
+                result.push_back(partition);
+            }
+        }
+        return result;
+    }
+
+    std::vector<TalkPartition> all() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return partitions_;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return partitions_.size();
+    }
+
+    // 얼린 행 중 가장 큰 id, 없으면 0
+    sqlite3_int64 newest_max_id() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return partitions_.empty() ? 0 : partitions_.front().max_id;
+    }
+
+private:
+    static std::string column_string(DBStatement& stmt, int index) {
+        const unsigned char* text = sqlite3_column_text(stmt.get(), index);
+        return std::string(text ? reinterpret_cast<const char*>(text) : "", static_cast<size_t>(sqlite3_column_bytes(stmt.get(), index)));
+    }
+
+    mutable std::shared_mutex mutex_;
+    std::vector<TalkPartition> partitions_;
+};
+
+inline TalkPartitions& talk_partitions() {
+    static TalkPartitions partitions;
+    return partitions;
+}
+
+// 호출한 스레드 전용 보관 파일 연결, 처음 읽을 때 열린다
+// 등록된 파일은 바뀌지 않으므로 immutable (잠금 / 변경 확인 없음)
+inline DBConnection& partition_connection(const std::string& path) {
+    thread_local std::unordered_map<std::string, std::unique_ptr<DBConnection>> connections;
+    std::unique_ptr<DBConnection>& connection = connections[path];
+    if (!connection) {
+        connection = std::make_unique<DBConnection>("file:" + path + "?immutable=1", SQLITE_OPEN_READONLY | SQLITE_OPEN_URI);
+    }
+    return *connection;
+}
+
+// load_talks 와 같은 순서 / 형식, talks 에서 모자라면 보관 파일로 이어서 읽는다
+inline std::vector<StoredTalk> load_room_history(int room_id, sqlite3_int64 before_id, int limit) {
+    std::vector<StoredTalk> talks = load_talks(room_id, before_id, limit);
+    sqlite3_int64 cursor = talks.empty() ? before_id : talks.back().id;
+    for (const TalkPartition& partition : talk_partitions().older_than(cursor)) {
+        if (talks.size() >= static_cast<size_t>(limit)) {
+            break;
+        }
+        DBConnection& db = partition_connection(partition.path);
+        if (!db.is_open()) {
+            continue;
+        }
+        std::vector<StoredTalk> older = load_talks(db, room_id, cursor, limit - static_cast<int>(talks.size()));
+        if (!older.empty()) {
+            cursor = older.back().id;
+        }
+        talks.insert(talks.end(), std::make_move_iterator(older.begin()), std::make_move_iterator(older.end()));
+    }
+    return talks;
+}
+
+// search_talks 를 talks 부터 최신 달 순으로, 관련도 순서는 파일 안에서만 매겨진다
+// 옮기는 도중에는 같은 행이 talks 와 보관 파일에 함께 있을 수 있어서 id 로 거른다
+inline bool search_history(int room_id, std::string_view query, int offset, int limit, std::vector<StoredTalk>& talks) {
+    size_t wanted = static_cast<size_t>(offset) + static_cast<size_t>(limit);
+    if (!search_talks(DBConnection::read_only_for_this_thread(), room_id, query, 0, static_cast<int>(wanted), talks)) {
+        return false;
+    }
+    std::unordered_set<sqlite3_int64> seen;
+    for (const auto& talk : talks) {
+        seen.insert(talk.id);
+    }
+    for (const TalkPartition& partition : talk_partitions().all()) {
+        if (talks.size() >= wanted) {
+            break;
+        }
+        DBConnection& db = partition_connection(partition.path);
+        std::vector<StoredTalk> found;
+        if (!db.is_open() || !search_talks(db, room_id, query, 0, static_cast<int>(wanted - talks.size()), found)) {
+            continue;
+        }
+        for (auto& talk : found) {
+            if (seen.insert(talk.id).second) {
+                talks.push_back(std::move(talk));
+            }
+        }
+    }
+    talks.erase(talks.begin(), talks.begin() + std::min(talks.size(), static_cast<size_t>(offset)));
+    if (talks.size() > static_cast<size_t>(limit)) {
+        talks.resize(static_cast<size_t>(limit));
+    }
+    return true;
+}
+
+// talks 에 없으면 최신 달의 파일부터 찾는다
+inline sqlite3_int64 latest_room_talk_id(int room_id) {
+    sqlite3_int64 latest = latest_talk_id(DBConnection::for_this_thread(), room_id);
+    for (const TalkPartition& partition : talk_partitions().all()) {
+        if (latest != 0) {
+            break;
+        }
+        DBConnection& db = partition_connection(partition.path);
+        if (db.is_open()) {
+            latest = latest_talk_id(db, room_id);
+        }
+    }
+    return latest;
+}
+
+// after_id < id <= until_id 인 메시지 수를 talks 부터 최신 달 순으로 센다, limit 에서 멈춘다
+// load_room_history 처럼 앞에서 센 가장 작은 id 아래만 이어 세므로 옮기는 도중의 행을 두 번 세지 않는다
+inline int count_room_history(int room_id, sqlite3_int64 after_id, sqlite3_int64 until_id, int limit) {
+    sqlite3_int64 cursor = until_id + 1;
+    int count = count_talks(DBConnection::for_this_thread(), room_id, after_id, cursor, limit, cursor);
+    for (const TalkPartition& partition : talk_partitions().older_than(cursor)) {
+        if (count >= limit || partition.max_id <= after_id) {
+            break;
+        }
+        DBConnection& db = partition_connection(partition.path);
+        if (db.is_open()) {
+            count += count_talks(db, room_id, after_id, cursor, limit - count, cursor);
+        }
+    }
+    return count;
+}
+
+// 캐시하지 않는 한 번짜리 조회 (붙였다 뗄 보관 파일을 가리키는 문장), 첫 행의 정수 열들을 values 에
+inline bool query_int64s(DBConnection& db, const std::string& sql, sqlite3_int64* values, int count) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db.handle(), sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    bool ok = sqlite3_step(stmt) == SQLITE_ROW;
+    for (int i = 0; ok && i < count; ++i) {
+        values[i] = sqlite3_column_int64(stmt, i);
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// "YYYY-MM" 형식의 달 계산 (UTC, published_date 와 같은 기준)
+inline std::string format_month(int year, int month) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%04d-%02d", year, month);
+    return text;
+}
+
+inline std::string add_months(std::string_view month, int delta) {
+    int year = 0;
+    int number = 0;
+    parse_int(month.substr(0, 4), year);
+    parse_int(month.substr(5, 2), number);
+    int total = year * 12 + (number - 1) + delta;
+    return format_month(total / 12, total % 12 + 1);
+}
+
+inline std::string current_month() {
+    std::time_t now = std::time(nullptr);
+    std::tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &now);
+#else
+    gmtime_r(&now, &utc);
+#endif
+    return format_month(utc.tm_year + 1900, utc.tm_mon + 1);
+}
+
+// 보관 스레드, interval 마다 hot_months 보다 오래된 달을 하나씩 옮긴다
+class TalkArchiver {
+public:
+    explicit TalkArchiver(const ArchiveOptions& options) : options_(options) {}
+
+    TalkArchiver(const TalkArchiver&) = delete;
+    TalkArchiver& operator=(const TalkArchiver&) = delete;
+
+    ~TalkArchiver() {
+        stop();
+    }
+
+    void start() {
+        if (!options_.enabled || thread_.joinable()) {
+            return;
+        }
+        stopping_.store(false);
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    // 옮기던 달은 그 자리에서 멈추고 다음 실행에서 이어 간다
+    void stop() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            stopping_.store(true);
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    uint64_t archived_rows() const { return archived_rows_.value(); }
+    uint64_t failures() const { return failures_.value(); }
+
+private:
+    void run() {
+        DBConnection& db = DBConnection::for_this_thread();
+        for (;;) {
+            archive_old_months(db);
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            if (wake_.wait_for(lock, options_.interval, [this]() { return stopping_.load(); })) {
+                break;
+            }
+        }
+    }
+
+    void archive_old_months(DBConnection& db) {
+        // 지난 번에 등록만 하고 talks 에서 다 지우지 못한 달부터 마저 지운다
+        for (const TalkPartition& partition : talk_partitions().all()) {
+            sqlite3_int64 leftover = 0;
+            std::string probe = "SELECT id FROM talks WHERE id >= " + std::to_string(partition.min_id)
+                + " AND id <= " + std::to_string(partition.max_id) + " LIMIT 1;";
+            if (query_int64s(db, probe, &leftover, 1) && !purge_hot(db, partition)) {
+                return;
+            }
+        }
+
+        std::string keep_from = add_months(current_month(), -static_cast<int>(std::max(options_.hot_months, 1u) - 1)) + "-01 00:00:00";
+        while (!stopping_.load()) {
+            // 얼린 행 다음의 가장 오래된 행이 속한 달
+            sqlite3_int64 first_id = 0;
+            std::string oldest;
+            if (!first_row_after(db, talk_partitions().newest_max_id(), first_id, oldest) || oldest >= keep_from) {
+                return;
+            }
+            if (!archive_month(db, oldest.substr(0, 7), first_id) && !stopping_.load()) {
+                failures_.add();
+                return;
+            }
+        }
+    }
+
+    // id 가 after 보다 큰 첫 행
+    bool first_row_after(DBConnection& db, sqlite3_int64 after, sqlite3_int64& id, std::string& published) {
+        DBStatement stmt = db.prepare("SELECT id, published_date FROM talks WHERE id > ? ORDER BY id LIMIT 1;");
+        if (!stmt) {
+            return false;
+        }
+        stmt.bind(1, after);
+        if (stmt.step() != SQLITE_ROW) {
+            return false;
+        }
+        id = sqlite3_column_int64(stmt.get(), 0);
+        const unsigned char* text = sqlite3_column_text(stmt.get(), 1);
+        published.assign(text ? reinterpret_cast<const char*>(text) : "", static_cast<size_t>(sqlite3_column_bytes(stmt.get(), 1)));
+        return true;
+    }
+
+    // id 는 기록 순서대로 늘어나므로 달이 끝나는 지점 (end 이후 첫 행의 id) 을 rowid 로 이분 탐색한다
+    // published_date 에 색인을 두지 않아도 되므로 기록 배치가 색인 하나를 덜 갱신한다
+    sqlite3_int64 month_end_id(DBConnection& db, sqlite3_int64 first_id, const std::string& end) {
+        sqlite3_int64 last_id = first_id;
+        query_int64s(db, "SELECT MAX(id) FROM talks;", &last_id, 1);
+        sqlite3_int64 low = first_id;
+        sqlite3_int64 high = last_id + 1;
+        while (low < high) {
+            sqlite3_int64 middle = low + (high - low) / 2;
+            sqlite3_int64 id = 0;
+            std::string published;
+            if (!first_row_after(db, middle - 1, id, published) || published >= end) {
+                high = middle;
+            }
+            else {
+                low = id + 1;
+            }
+        }
+        return low;
+    }
+
+    bool archive_month(DBConnection& db, const std::string& month, sqlite3_int64 first_id) {
+        std::string start = month + "-01 00:00:00";
+        std::string end = add_months(month, 1) + "-01 00:00:00";
+        std::string file = "talks_" + month + ".db";
+        std::replace(file.begin(), file.end(), '-', '_');
+        std::string path = ARCHIVE_DIR + "/" + file;
+
+        std::error_code ec;
+        std::filesystem::create_directories(ARCHIVE_DIR, ec);
+        if (std::filesystem::exists(path, ec)) {
+            // 얼리고 등록하기 전에 멈췄던 파일
+            std::filesystem::permissions(path, std::filesystem::perms::owner_write, std::filesystem::perm_options::add, ec);
+        }
+
+        sqlite3_int64 end_id = month_end_id(db, first_id, end);
+        CHAT_LOG_INFO << "Archiving talks of " << month << " (id " << first_id << " ~ " << end_id - 1 << ") to " << path;
+
+        TalkPartition partition;
+        partition.month = month;
+        partition.path = path;
+        {
+            std::string attach = "ATTACH DATABASE '" + path + "' AS archive;";
+            if (!db.exec(attach.c_str())) {
+                CHAT_LOG_ERROR << "Failed to attach " << path << ": " << db.last_error();
+                return false;
+            }
+            std::string copy = "INSERT OR IGNORE INTO archive.talks (id, room_id, user_id, text, published_date) "
+                "SELECT id, room_id, user_id, text, published_date FROM main.talks WHERE id >= " + std::to_string(first_id)
+                + " AND id < " + std::to_string(end_id) + " AND published_date >= '" + start + "' AND published_date < '" + end + "';";
+            sqlite3_int64 stats[3] = {};
+            bool copied = db.exec("PRAGMA archive.journal_mode=DELETE;")
+                && db.exec("CREATE TABLE IF NOT EXISTS archive.talks ("
+                    "id INTEGER PRIMARY KEY, room_id INTEGER NOT NULL, user_id INTEGER NOT NULL,"
+                    "text TEXT NOT NULL, published_date TEXT NOT NULL);"
+                    "CREATE INDEX IF NOT EXISTS archive.idx_talks_room_history ON talks(room_id, id);"
+                    "CREATE VIRTUAL TABLE IF NOT EXISTS archive.talks_fts USING fts5(text, room_id UNINDEXED, content='talks', content_rowid='id');")
+                && db.exec("BEGIN;") && db.exec(copy.c_str())
+                && db.exec("INSERT INTO archive.talks_fts(talks_fts) VALUES('rebuild');") && db.exec("COMMIT;")
+                && query_int64s(db, "SELECT COUNT(*), MIN(id), MAX(id) FROM archive.talks;", stats, 3);
+            if (!copied) {
+                CHAT_LOG_ERROR << "Failed to copy talks of " << month << ": " << db.last_error();
+                db.exec("ROLLBACK;");
+            }
+            db.exec("DETACH DATABASE archive;");
+            if (!copied) {
+                return false;
+            }
+            partition.rows = stats[0];
+            partition.min_id = stats[1];
+            partition.max_id = stats[2];
+        }
+
+        // 정리하고 얼린다, 등록한 뒤에는 읽는 쪽이 immutable 로 열기 때문에 다시 쓰면 안 된다
+        {
+            DBConnection archive(path);
+            if (!archive.exec("INSERT INTO talks_fts(talks_fts) VALUES('optimize');") || !archive.exec("VACUUM;")) {
+                CHAT_LOG_ERROR << "Failed to compact " << path << ": " << archive.last_error();
+                return false;
+            }
+        }
+        std::filesystem::permissions(path, std::filesystem::perms::owner_read | std::filesystem::perms::group_read
+            | std::filesystem::perms::others_read, ec);
+
+        {
+            DBStatement stmt = db.prepare("INSERT OR REPLACE INTO talk_partitions (month, path, min_id, max_id, rows) VALUES (?, ?, ?, ?, ?);");
+            if (!stmt) {
+                return false;
+            }
+            stmt.bind(1, std::string_view(partition.month));
+            stmt.bind(2, std::string_view(partition.path));
+            stmt.bind(3, partition.min_id);
+            stmt.bind(4, partition.max_id);
+            stmt.bind(5, partition.rows);
+            if (stmt.step() != SQLITE_DONE) {
+                CHAT_LOG_ERROR << "Failed to register partition " << month << ": " << db.last_error();
+                return false;
+            }
+        }
+        talk_partitions().add(partition);
+        return purge_hot(db, partition);
+    }
+
+    // talks 와 검색 색인에서 보관 파일에 들어 있는 행만 지운다
+    // 외부 내용 FTS5 색인은 지울 행의 값을 그대로 넘겨야 해서 'delete' 명령으로 먼저 뺀다
+    bool purge_hot(DBConnection& db, const TalkPartition& partition) {
+        std::string attach = "ATTACH DATABASE '" + partition.path + "' AS archive;";
+        if (!db.exec(attach.c_str())) {
+            CHAT_LOG_ERROR << "Failed to attach " << partition.path << ": " << db.last_error();
+            return false;
+        }
+        bool ok = true;
+        size_t batch = std::max<size_t>(options_.delete_batch, 1);
+        for (sqlite3_int64 low = partition.min_id; ok && low <= partition.max_id && !stopping_.load(); low += static_cast<sqlite3_int64>(batch)) {
+            std::string range = "id >= " + std::to_string(low) + " AND id < " + std::to_string(low + static_cast<sqlite3_int64>(batch));
+            std::string archived = range + " AND id IN (SELECT id FROM archive.talks WHERE " + range + ")";
+            std::string unindex = "INSERT INTO main.talks_fts(talks_fts, rowid, text, room_id) "
+                "SELECT 'delete', id, text, room_id FROM main.talks WHERE " + archived + ";";
+            std::string remove = "DELETE FROM main.talks WHERE " + archived + ";";
+            ok = db.exec("BEGIN IMMEDIATE;") && db.exec(unindex.c_str()) && db.exec(remove.c_str());
+            sqlite3_int64 removed = sqlite3_changes(db.handle());
+            if (ok && db.exec("COMMIT;")) {
+                archived_rows_.add(static_cast<uint64_t>(removed));
+            }
+            else {
+                ok = false;
+                CHAT_LOG_ERROR << "Failed to purge archived talks of " << partition.month << ": " << db.last_error();
+                db.exec("ROLLBACK;");
+            }
+        }
+        db.exec("DETACH DATABASE archive;");
+        if (ok && !stopping_.load()) {
+            CHAT_LOG_INFO << "Archived " << partition.rows << " talks of " << partition.month;
+        }
+        return ok && !stopping_.load();
+    }
+
+    const ArchiveOptions& options_;
+    std::thread thread_;
+    std::atomic<bool> stopping_{ false };
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+
+    ShardedCounter archived_rows_;   // talks 에서 보관 파일로 옮겨 지운 행
+    ShardedCounter failures_;
+};
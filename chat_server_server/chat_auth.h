@@ -0,0 +1,604 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include "chat_db.h"
+#include "chat_log.h"
+#include "chat_metrics.h"
+#include "chat_protocol.h"
+
+// 계정 확인
+// 비밀번호는 PBKDF2-HMAC-SHA256 으로 늘려서 저장하고, 해시 계산과 users 조회는 io 스레드가 아닌 인증 전용 스레드 풀에서 한다
+// 사용자 레코드는 login_id / user_id 로 찾는 LRU 캐시에 두고, 시작할 때 최근 계정으로 미리 채운다
+// 재시작 직후 로그인이 몰려도 같은 login_id 조회는 하나로 합치고, 풀 크기만큼만 SQLite 에 동시에 간다
+
+const uint32_t AUTH_PBKDF2_ITERATIONS = 100000;
+const size_t AUTH_SALT_SIZE = 16;
+const size_t AUTH_CACHE_CAPACITY = 10000;   // 캐시에 두는 사용자 수
+const size_t AUTH_CACHE_WARM = 2000;        // 시작할 때 미리 읽는 최근 계정 수
+const size_t AUTH_MAX_PENDING = 1024;       // 풀에 쌓인 요청이 이보다 많으면 바로 unavailable
+
+// 저장 형식: pbkdf2-sha256$반복 횟수$salt(hex)$hash(hex)
+const std::string_view PASSWORD_HASH_SCHEME = "pbkdf2-sha256";
+
+// FIPS 180-4 SHA-256
+class Sha256 {
+public:
+    static const size_t DIGEST_SIZE = 32;
+    static const size_t BLOCK_SIZE = 64;
+    using Digest = std::array<uint8_t, DIGEST_SIZE>;
+
+    Sha256() = default;
+
+    void update(const uint8_t* data, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        total_ += size;
+        if (buffered_ > 0) {
+            size_t take = std::min(BLOCK_SIZE - buffered_, size);
+            std::memcpy(buffer_ + buffered_, data, take);
+            buffered_ += take;
+            data += take;
+            size -= take;
+            if (buffered_ < BLOCK_SIZE) {
+                return;
+            }
+            compress(buffer_);
+            buffered_ = 0;
+        }
+        for (; size >= BLOCK_SIZE; data += BLOCK_SIZE, size -= BLOCK_SIZE) {
+            compress(data);
+        }
+        std::memcpy(buffer_, data, size);
+        buffered_ = size;
+    }
+
+    void update(std::string_view data) {
+        update(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    }
+
+    Digest finish() {
+        uint64_t bits = total_ * 8;
+        buffer_[buffered_++] = 0x80;
+        if (buffered_ > BLOCK_SIZE - 8) {
+            std::memset(buffer_ + buffered_, 0, BLOCK_SIZE - buffered_);
+            compress(buffer_);
+            buffered_ = 0;
+        }
+        std::memset(buffer_ + buffered_, 0, BLOCK_SIZE - 8 - buffered_);
+        for (int i = 0; i < 8; ++i) {
+            buffer_[BLOCK_SIZE - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+        compress(buffer_);
+
+        Digest digest;
+        for (size_t i = 0; i < state_.size(); ++i) {
+            digest[4 * i] = static_cast<uint8_t>(state_[i] >> 24);
+            digest[4 * i + 1] = static_cast<uint8_t>(state_[i] >> 16);
+            digest[4 * i + 2] = static_cast<uint8_t>(state_[i] >> 8);
+            digest[4 * i + 3] = static_cast<uint8_t>(state_[i]);
+        }
+        return digest;
+    }
+
+private:
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress(const uint8_t* block) {
+        static const uint32_t K[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (static_cast<uint32_t>(block[4 * i]) << 24) | (static_cast<uint32_t>(block[4 * i + 1]) << 16)
+                | (static_cast<uint32_t>(block[4 * i + 2]) << 8) | static_cast<uint32_t>(block[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+        uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state_[0] += a;
+        state_[1] += b;
+        state_[2] += c;
+        state_[3] += d;
+        state_[4] += e;
+        state_[5] += f;
+        state_[6] += g;
+        state_[7] += h;
+    }
+
+    std::array<uint32_t, 8> state_ = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    uint8_t buffer_[BLOCK_SIZE] = {};
+    size_t buffered_ = 0;
+    uint64_t total_ = 0;
+};
+
+// RFC 8018 PBKDF2, HMAC 의 ipad / opad 블록은 한 번만 압축해 두고 반복마다 복사해서 쓴다
+inline void pbkdf2_hmac_sha256(std::string_view password, const uint8_t* salt, size_t salt_size,
+    uint32_t iterations, uint8_t* out, size_t out_size) {
+    uint8_t key[Sha256::BLOCK_SIZE] = {};
+    if (password.size() > Sha256::BLOCK_SIZE) {
+        Sha256 hasher;
+        hasher.update(password);
+        Sha256::Digest digest = hasher.finish();
+        std::memcpy(key, digest.data(), digest.size());
+    }
+    else {
+        std::memcpy(key, password.data(), password.size());
+    }
+
+    uint8_t pad[Sha256::BLOCK_SIZE];
+    Sha256 inner_base;
+    Sha256 outer_base;
+    for (size_t i = 0; i < Sha256::BLOCK_SIZE; ++i) {
+        pad[i] = key[i] ^ 0x36;
+    }
+    inner_base.update(pad, sizeof(pad));
+    for (size_t i = 0; i < Sha256::BLOCK_SIZE; ++i) {
+        pad[i] = key[i] ^ 0x5c;
+    }
+    outer_base.update(pad, sizeof(pad));
+
+    auto hmac = [&](const uint8_t* data, size_t size, const uint8_t* tail, size_t tail_size) {
+        Sha256 inner = inner_base;
+        inner.update(data, size);
+        inner.update(tail, tail_size);
+        Sha256::Digest inner_digest = inner.finish();
+        Sha256 outer = outer_base;
+        outer.update(inner_digest.data(), inner_digest.size());
+        return outer.finish();
+    };
+
+    for (uint32_t block = 1, produced = 0; produced < out_size; ++block) {
+        uint8_t counter[4] = {
+            static_cast<uint8_t>(block >> 24), static_cast<uint8_t>(block >> 16),
+            static_cast<uint8_t>(block >> 8), static_cast<uint8_t>(block)
+        };
+        Sha256::Digest u = hmac(salt, salt_size, counter, sizeof(counter));
+        Sha256::Digest t = u;
+        for (uint32_t i = 1; i < iterations; ++i) {
+            u = hmac(u.data(), u.size(), nullptr, 0);
+            for (size_t j = 0; j < t.size(); ++j) {
+                t[j] ^= u[j];
+            }
+        }
+        size_t take = std::min(t.size(), out_size - produced);
+        std::memcpy(out + produced, t.data(), take);
+        produced += static_cast<uint32_t>(take);
+    }
+}
+
+// RFC 2104 HMAC, 짧은 메시지 서명용 (재접속 토큰 등)
+inline Sha256::Digest hmac_sha256(std::string_view key, std::string_view message) {
+    uint8_t block[Sha256::BLOCK_SIZE] = {};
+    if (key.size() > Sha256::BLOCK_SIZE) {
+        Sha256 hasher;
+        hasher.update(key);
+        Sha256::Digest digest = hasher.finish();
+        std::memcpy(block, digest.data(), digest.size());
+    }
+    else {
+        std::memcpy(block, key.data(), key.size());
+    }
+
+    uint8_t pad[Sha256::BLOCK_SIZE];
+    for (size_t i = 0; i < Sha256::BLOCK_SIZE; ++i) {
+        pad[i] = block[i] ^ 0x36;
+    }
+    Sha256 inner;
+    inner.update(pad, sizeof(pad));
+    inner.update(message);
+    Sha256::Digest inner_digest = inner.finish();
+
+    for (size_t i = 0; i < Sha256::BLOCK_SIZE; ++i) {
+        pad[i] = block[i] ^ 0x5c;
+    }
+    Sha256 outer;
+    outer.update(pad, sizeof(pad));
+    outer.update(inner_digest.data(), inner_digest.size());
+    return outer.finish();
+}
+
+inline std::string to_hex(const uint8_t* data, size_t size) {
+    static const char DIGITS[] = "0123456789abcdef";
+    std::string out(size * 2, '0');
+    for (size_t i = 0; i < size; ++i) {
+        out[2 * i] = DIGITS[data[i] >> 4];
+        out[2 * i + 1] = DIGITS[data[i] & 0x0f];
+    }
+    return out;
+}
+
+inline bool from_hex(std::string_view hex, std::string& out) {
+    auto digit = [](char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    if (hex.size() % 2 != 0) {
+        return false;
+    }
+    out.resize(hex.size() / 2);
+    for (size_t i = 0; i < out.size(); ++i) {
+        int high = digit(hex[2 * i]);
+        int low = digit(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        out[i] = static_cast<char>((high << 4) | low);
+    }
+    return true;
+}
+
+// 비교에 걸리는 시간이 어디서 달라지는지 드러나지 않게 끝까지 비교한다
+inline bool constant_time_equal(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    unsigned char diff = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        diff |= static_cast<unsigned char>(a[i] ^ b[i]);
+    }
+    return diff == 0;
+}
+
+inline std::string hash_password(std::string_view password, uint32_t iterations = AUTH_PBKDF2_ITERATIONS) {
+    uint8_t salt[AUTH_SALT_SIZE];
+    std::random_device random;
+    for (size_t i = 0; i < sizeof(salt); i += 4) {
+        uint32_t value = random();
+        std::memcpy(salt + i, &value, std::min<size_t>(4, sizeof(salt) - i));
+    }
+    uint8_t hash[Sha256::DIGEST_SIZE];
+    pbkdf2_hmac_sha256(password, salt, sizeof(salt), iterations, hash, sizeof(hash));
+
+    std::string out(PASSWORD_HASH_SCHEME);
+    out += '$';
+    out += std::to_string(iterations);
+    out += '$';
+    out += to_hex(salt, sizeof(salt));
+    out += '$';
+    out += to_hex(hash, sizeof(hash));
+    return out;
+}
+
+// 해시 형식이 아닌 값은 이전 DB 의 평문 비밀번호로 보고 그대로 비교한다
+// 맞았는데 평문이거나 반복 횟수가 지금 설정보다 적으면 needs_rehash
+inline bool verify_password(std::string_view password, std::string_view stored, bool& needs_rehash) {
+    needs_rehash = false;
+    std::string_view rest = stored;
+    if (rest.substr(0, PASSWORD_HASH_SCHEME.size() + 1) != std::string(PASSWORD_HASH_SCHEME) + "$") {
+        bool matched = constant_time_equal(password, stored);
+        needs_rehash = matched;
+        return matched;
+    }
+    rest.remove_prefix(PASSWORD_HASH_SCHEME.size() + 1);
+
+    size_t iterations_end = rest.find('$');
+    size_t salt_end = iterations_end == std::string_view::npos ? std::string_view::npos : rest.find('$', iterations_end + 1);
+    uint32_t iterations = 0;
+    std::string salt;
+    std::string expected;
+    if (salt_end == std::string_view::npos
+        || !parse_int(rest.substr(0, iterations_end), iterations) || iterations == 0
+        || !from_hex(rest.substr(iterations_end + 1, salt_end - iterations_end - 1), salt)
+        || !from_hex(rest.substr(salt_end + 1), expected) || expected.empty()) {
+        CHAT_LOG_WARN << "Malformed password hash";
+        return false;
+    }
+
+    std::string actual(expected.size(), '\0');
+    pbkdf2_hmac_sha256(password, reinterpret_cast<const uint8_t*>(salt.data()), salt.size(), iterations,
+        reinterpret_cast<uint8_t*>(&actual[0]), actual.size());
+    bool matched = constant_time_equal(actual, expected);
+    needs_rehash = matched && iterations < AUTH_PBKDF2_ITERATIONS;
+    return matched;
+}
+
+// login_id, user_id 두 키로 찾는 LRU 캐시
+// 레코드는 바꾸지 않고 통째로 교체하므로 꺼내 간 쪽은 잠금 없이 읽을 수 있다
+class UserCache {
+public:
+    using Entry = std::shared_ptr<const UserRecord>;
+
+    explicit UserCache(size_t capacity) : capacity_(capacity) {}
+
+    Entry find(std::string_view login_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = by_login_.find(login_id);
+        if (it == by_login_.end()) {
+            return nullptr;
+        }
+        order_.splice(order_.begin(), order_, it->second);
+        return *it->second;
+    }
+
+    Entry find(int user_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = by_id_.find(user_id);
+        if (it == by_id_.end()) {
+            return nullptr;
+        }
+        order_.splice(order_.begin(), order_, it->second);
+        return *it->second;
+    }
+
+    // 같은 user_id 나 login_id 가 있으면 새 레코드로 바꾼다
+    void insert(Entry user) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto by_id = by_id_.find(user->id);
+        if (by_id != by_id_.end()) {
+            erase(by_id->second);
+        }
+        auto by_login = by_login_.find(user->login_id);
+        if (by_login != by_login_.end()) {
+            erase(by_login->second);
+        }
+
+        order_.push_front(std::move(user));
+        const Entry& inserted = order_.front();
+        by_login_.emplace(inserted->login_id, order_.begin());
+        by_id_.emplace(inserted->id, order_.begin());
+        while (order_.size() > capacity_) {
+            erase(std::prev(order_.end()));
+        }
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return order_.size();
+    }
+
+private:
+    using Iterator = std::list<Entry>::iterator;
+
+    void erase(Iterator it) {
+        by_login_.erase((*it)->login_id);
+        by_id_.erase((*it)->id);
+        order_.erase(it);
+    }
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::list<Entry> order_;                                // 앞쪽이 최근에 쓴 것
+    std::unordered_map<std::string_view, Iterator> by_login_;  // 키는 목록에 있는 레코드의 login_id 를 가리킨다
+    std::unordered_map<int, Iterator> by_id_;
+};
+
+enum class AuthStatus : uint8_t {
+    ok = 0,
+    invalid_credentials = 1,
+    already_exists = 2,
+    invalid_request = 3,  // login_id 나 password 가 비어 있음
+    unavailable = 4,      // DB 오류 또는 요청이 너무 많이 밀림
+};
+
+struct AuthResult {
+    AuthStatus status = AuthStatus::unavailable;
+    int user_id = 0;
+};
+
+class AuthService {
+public:
+    using Callback = std::function<void(AuthResult)>;
+
+    AuthService(size_t workers, size_t cache_capacity)
+        : pool_(workers), cache_(cache_capacity), dummy_hash_(hash_password("")) {
+    }
+
+    // 아직 시작하지 않은 요청은 버리고, 처리 중인 요청이 끝날 때까지 기다린다
+    ~AuthService() {
+        pool_.stop();
+        pool_.join();
+    }
+
+    // 최근 계정을 캐시에 미리 넣는다, 호출한 스레드에서 DB 를 읽는다
+    void warm(size_t count) {
+        std::vector<UserRecord> users = load_recent_users(static_cast<int>(count));
+        // 오래된 것부터 넣어서 최근 계정이 LRU 앞쪽에 오게 한다
+        for (auto it = users.rbegin(); it != users.rend(); ++it) {
+            cache_.insert(std::make_shared<const UserRecord>(std::move(*it)));
+        }
+        CHAT_LOG_INFO << "User cache warmed with " << users.size() << " accounts";
+    }
+
+    // done 은 인증 스레드에서 호출된다
+    void login(std::string login_id, std::string password, Callback done) {
+        submit([this, login_id = std::move(login_id), password = std::move(password)]() {
+            return verify_login(login_id, password);
+        }, std::move(done));
+    }
+
+    void create_user(std::string login_id, std::string password, Callback done) {
+        submit([this, login_id = std::move(login_id), password = std::move(password)]() {
+            return register_user(login_id, password);
+        }, std::move(done));
+    }
+
+    UserCache& cache() { return cache_; }
+
+    uint64_t cache_hits() const { return cache_hits_.value(); }
+    uint64_t cache_misses() const { return cache_misses_.value(); }
+    uint64_t coalesced_loads() const { return coalesced_loads_.value(); }
+    uint64_t rejected() const { return rejected_.value(); }
+    const ShardedHistogram& latency() const { return latency_; }
+
+private:
+    using LoadResult = std::pair<DBResult, UserCache::Entry>;
+
+    template <typename Work>
+    void submit(Work work, Callback done) {
+        if (pending_.fetch_add(1, std::memory_order_relaxed) >= AUTH_MAX_PENDING) {
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            rejected_.add();
+            done(AuthResult{ AuthStatus::unavailable, 0 });
+            return;
+        }
+        boost::asio::post(pool_, [this, work = std::move(work), done = std::move(done)]() {
+            AuthResult result;
+            {
+                ScopedLatency timing(latency_);
+                result = work();
+            }
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            done(result);
+        });
+    }
+
+    // 캐시에 없으면 DB 에서 읽는다, 같은 login_id 를 이미 읽는 중이면 그 결과를 기다린다
+    LoadResult find_user(const std::string& login_id) {
+        if (UserCache::Entry user = cache_.find(login_id)) {
+            cache_hits_.add();
+            return { DBResult::ok, user };
+        }
+
+        std::promise<LoadResult> loading;
+        std::shared_future<LoadResult> pending;
+        {
+            std::lock_guard<std::mutex> lock(inflight_mutex_);
+            auto it = inflight_.find(login_id);
+            if (it != inflight_.end()) {
+                pending = it->second;
+            }
+            else {
+                inflight_.emplace(login_id, loading.get_future().share());
+            }
+        }
+        if (pending.valid()) {
+            coalesced_loads_.add();
+            return pending.get();
+        }
+
+        cache_misses_.add();
+        UserRecord record;
+        LoadResult loaded{ load_user(login_id, record), nullptr };
+        if (loaded.first == DBResult::ok) {
+            loaded.second = std::make_shared<const UserRecord>(std::move(record));
+            cache_.insert(loaded.second);
+        }
+        loading.set_value(loaded);
+
+        std::lock_guard<std::mutex> lock(inflight_mutex_);
+        inflight_.erase(login_id);
+        return loaded;
+    }
+
+    AuthResult verify_login(const std::string& login_id, const std::string& password) {
+        if (login_id.empty() || password.empty()) {
+            return { AuthStatus::invalid_request, 0 };
+        }
+        LoadResult found = find_user(login_id);
+        if (found.first == DBResult::failed) {
+            return { AuthStatus::unavailable, 0 };
+        }
+
+        bool needs_rehash = false;
+        if (!found.second) {
+            // 없는 계정도 같은 시간이 걸리게 해서 어떤 login_id 가 있는지 응답 시간으로 알 수 없게 한다
+            verify_password(password, dummy_hash_, needs_rehash);
+            return { AuthStatus::invalid_credentials, 0 };
+        }
+        const UserCache::Entry& user = found.second;
+        if (!verify_password(password, user->password_hash, needs_rehash)) {
+            return { AuthStatus::invalid_credentials, 0 };
+        }
+
+        if (needs_rehash) {
+            auto upgraded = std::make_shared<UserRecord>(*user);
+            upgraded->password_hash = hash_password(password);
+            if (update_password_hash(user->id, upgraded->password_hash)) {
+                cache_.insert(std::move(upgraded));
+            }
+        }
+        return { AuthStatus::ok, user->id };
+    }
+
+    // 프로토콜에 표시 이름이 없으므로 name 은 login_id 와 같게 만든다
+    AuthResult register_user(const std::string& login_id, const std::string& password) {
+        if (login_id.empty() || password.empty()) {
+            return { AuthStatus::invalid_request, 0 };
+        }
+        // 이미 있는 계정이면 해시를 계산하지 않는다
+        LoadResult found = find_user(login_id);
+        if (found.first == DBResult::failed) {
+            return { AuthStatus::unavailable, 0 };
+        }
+        if (found.second) {
+            return { AuthStatus::already_exists, 0 };
+        }
+
+        UserRecord record;
+        record.login_id = login_id;
+        record.name = login_id;
+        record.password_hash = hash_password(password);
+        switch (insert_user(record)) {
+        case DBResult::ok:
+            break;
+        case DBResult::conflict:
+            return { AuthStatus::already_exists, 0 };
+        default:
+            return { AuthStatus::unavailable, 0 };
+        }
+
+        int user_id = record.id;
+        cache_.insert(std::make_shared<const UserRecord>(std::move(record)));
+        return { AuthStatus::ok, user_id };
+    }
+
+    boost::asio::thread_pool pool_;
+    UserCache cache_;
+    const std::string dummy_hash_;
+    std::atomic<size_t> pending_{ 0 };
+
+    std::mutex inflight_mutex_;
+    std::unordered_map<std::string, std::shared_future<LoadResult>> inflight_;
+
+    ShardedCounter cache_hits_;
+    ShardedCounter cache_misses_;
+    ShardedCounter coalesced_loads_;   // 다른 요청이 읽는 중이라 기다린 조회
+    ShardedCounter rejected_;
+    ShardedHistogram latency_;         // 요청 하나를 처리하는 시간 (해시 계산 포함)
+};
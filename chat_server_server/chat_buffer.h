@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "chat_pool.h"
+
+// 브로드캐스트 메시지는 한 번만 만들어 모든 수신자의 송신 큐가 같은 버퍼를 가리킨다
+using SharedMessage = std::shared_ptr<const std::string>;
+
+inline SharedMessage make_shared_message(std::string text) {
+    return std::allocate_shared<std::string>(PoolAllocator<std::string>(), std::move(text));
+}
+
+// 함수 안 static 으로 만들어 두고 같이 쓰는 메시지용
+// 프로그램이 끝날 때 풀려나는데, 그때는 스레드별 풀이 이미 사라졌을 수 있으므로 풀을 쓰지 않는다
+inline SharedMessage make_static_message(std::string text) {
+    return std::make_shared<const std::string>(std::move(text));
+}
+
+// 세션별 고정 크기 수신 버퍼
+// 소켓에서 읽은 바이트를 뒤에 이어 붙이고, 완성된 프레임은 앞에서부터 view 로 꺼내 쓴다
+// 뒤쪽 공간이 다 찼을 때만 남은 미완성 프레임을 맨 앞으로 옮기므로
+// 한 번 읽을 때 여러 프레임이 들어와도 프레임마다 memmove / 할당이 생기지 않는다
+// 용량이 곧 최대 프레임 크기라서 끝없이 긴 줄을 보내는 클라이언트도 메모리를 더 쓰지 못한다
+// 메모리는 BufferCache 에서 빌려 오므로 재접속이 반복돼도 새로 할당하지 않는다
+class ReceiveBuffer {
+public:
+    explicit ReceiveBuffer(size_t capacity)
+        : storage_(BufferCache::acquire(capacity)), capacity_(capacity) {
+    }
+
+    ReceiveBuffer(const ReceiveBuffer&) = delete;
+    ReceiveBuffer& operator=(const ReceiveBuffer&) = delete;
+
+    ~ReceiveBuffer() {
+        BufferCache::release(storage_, capacity_);
+    }
+
+    // 아직 처리하지 않은 바이트 (consume 또는 prepare 전까지 유효)
+    std::string_view data() const {
+        return std::string_view(storage_ + begin_, end_ - begin_);
+    }
+
+    size_t size() const { return end_ - begin_; }
+    size_t capacity() const { return capacity_; }
+    bool full() const { return size() == capacity_; }
+
+    // 다음 read 가 채울 공간, 뒤쪽이 다 찼으면 남은 데이터를 앞으로 옮긴다
+    char* prepare(size_t& writable) {
+        if (end_ == capacity_ && begin_ > 0) {
+            std::memmove(storage_, storage_ + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        writable = capacity_ - end_;
+        return storage_ + end_;
+    }
+
+    void commit(size_t length) { end_ += length; }
+
+    void consume(size_t length) {
+        begin_ += length;
+        if (begin_ == end_) {
+            begin_ = end_ = 0;
+        }
+    }
+
+private:
+    char* storage_;
+    size_t capacity_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+};
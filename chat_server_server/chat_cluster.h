@@ -0,0 +1,717 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "chat_auth.h"
+#include "chat_buffer.h"
+#include "chat_log.h"
+#include "chat_protocol.h"
+
+// 클러스터 모드
+//
+// 방마다 room_id 의 consistent hash 로 소유 노드가 정해지고, 그 방 메시지의 순서와 기록은 소유 노드가 맡는다
+//   다른 노드에 접속한 세션이 보낸 메시지는 소유 노드로 publish 된다
+//   소유 노드는 자기 멤버에게 보내고 기록한 뒤, 그 방에 멤버가 있는 노드마다 한 번씩 deliver 한다
+//   각 노드는 소유하지 않은 방의 자기 쪽 입장 인원을 소유 노드에 membership 으로 알린다 (0 이면 구독 해제)
+//
+// 노드 사이에는 노드마다 보내는 연결(ClusterLink) 하나와 받는 연결(ClusterInbound) 하나를 둔다
+// 레코드는 바이너리 프로토콜과 같은 프레임 형식이고, 한 번 쓸 때 그동안 쌓인 레코드를 모두 묶어서 보낸다
+//
+// 클러스터 포트는 자기 노드 줄의 host 에서만 받고, 받는 쪽은 hello 가 확인될 때까지 다른 레코드를 받지 않는다
+//   hello 의 node_id 는 설정 파일에 있는 다른 노드여야 하고, 공유 secret 으로 만든 HMAC-SHA256 이 맞아야 한다
+//   HMAC 에는 받는 노드와 보낸 시각을 넣어서, 다른 노드로 가는 hello 나 CLUSTER_HELLO_MAX_SKEW 보다 오래된 hello 를 다시 써먹지 못하게 한다
+
+enum class RelayType : uint8_t {
+    hello = 1,       // node_id (연결한 노드), 받는 node_id, 보낸 시각 (유닉스 ms), HMAC
+    publish = 2,     // room_id, user_id, text (소유 노드로)
+    deliver = 3,     // room_id, text (소유 노드에서 구독 노드로)
+    membership = 4   // room_id, count (보낸 노드에 들어와 있는 세션 수, 소유 노드로)
+};
+
+const int CLUSTER_VIRTUAL_NODES = 64;                        // 노드당 해시 링 위의 점 수
+const size_t CLUSTER_LINK_HIGH_WATER = 4 * 1024 * 1024;      // 링크당 보내지 못하고 쌓아 두는 최대 바이트
+const std::chrono::seconds CLUSTER_RECONNECT_INTERVAL{ 1 };
+const std::chrono::seconds CLUSTER_HELLO_MAX_SKEW{ 60 };     // hello 의 보낸 시각이 이보다 차이 나면 거절
+const size_t CLUSTER_SECRET_MIN_SIZE = 16;
+
+struct ClusterNode {
+    int node_id = 0;
+    std::string host;
+    uint16_t client_port = 0;
+    uint16_t cluster_port = 0;
+};
+
+struct ClusterConfig {
+    int self_id = 0;
+    std::vector<ClusterNode> nodes;  // 자기 자신 포함
+    std::string secret;              // 모든 노드가 같은 값, hello 의 HMAC 키
+
+    bool enabled() const { return !nodes.empty(); }
+
+    const ClusterNode* find(int node_id) const {
+        for (const auto& node : nodes) {
+            if (node.node_id == node_id) {
+                return &node;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// 파일 형식, '#' 뒤는 주석
+//   self 1
+//   secret 0123456789abcdef0123   (모든 노드가 같은 값, 공백 없이 CLUSTER_SECRET_MIN_SIZE 자 이상, 노드가 둘 이상이면 필수)
+//   node 1 10.0.0.1 12345 12400   (node_id host client_port cluster_port, 클러스터 포트는 host 에서만 받는다)
+//   node 2 10.0.0.2 12345 12400
+inline ClusterConfig load_cluster_config(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Can't open cluster config: " + path);
+    }
+
+    ClusterConfig config;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string keyword;
+        if (!(fields >> keyword)) {
+            continue;
+        }
+        if (keyword == "self") {
+            fields >> config.self_id;
+        }
+        else if (keyword == "secret") {
+            fields >> config.secret;
+        }
+        else if (keyword == "node") {
+            ClusterNode node;
+            fields >> node.node_id >> node.host >> node.client_port >> node.cluster_port;
+            if (fields.fail() || node.node_id <= 0) {
+                throw std::runtime_error("Invalid cluster node line: " + line);
+            }
+            config.nodes.push_back(node);
+        }
+        else {
+            throw std::runtime_error("Unknown cluster config keyword: " + keyword);
+        }
+    }
+
+    if (!config.find(config.self_id)) {
+        throw std::runtime_error("Cluster config has no node line for self " + std::to_string(config.self_id));
+    }
+    if (config.nodes.size() > 1 && config.secret.size() < CLUSTER_SECRET_MIN_SIZE) {
+        throw std::runtime_error("Cluster config needs a secret of at least " + std::to_string(CLUSTER_SECRET_MIN_SIZE) + " characters");
+    }
+    return config;
+}
+
+// 노드가 늘거나 줄어도 대부분의 방은 소유 노드가 바뀌지 않도록 하는 해시 링
+class HashRing {
+public:
+    explicit HashRing(const std::vector<ClusterNode>& nodes) {
+        for (const auto& node : nodes) {
+            for (int replica = 0; replica < CLUSTER_VIRTUAL_NODES; ++replica) {
+                points_.emplace_back(mix(static_cast<uint32_t>(node.node_id) * 0x9E3779B1u + static_cast<uint32_t>(replica)),
+                    node.node_id);
+            }
+        }
+        std::sort(points_.begin(), points_.end());
+    }
+
+    // 노드가 하나도 없으면 0
+    int owner_of(int room_id) const {
+        if (points_.empty()) {
+            return 0;
+        }
+        uint32_t hash = mix(static_cast<uint32_t>(room_id));
+        auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(hash, INT32_MIN));
+        return it != points_.end() ? it->second : points_.front().second;
+    }
+
+private:
+    // murmur3 finalizer, 연속된 room_id 도 링 위에 고르게 흩어진다
+    static uint32_t mix(uint32_t h) {
+        h ^= h >> 16;
+        h *= 0x85EBCA6Bu;
+        h ^= h >> 13;
+        h *= 0xC2B2AE35u;
+        h ^= h >> 16;
+        return h;
+    }
+
+    std::vector<std::pair<uint32_t, int>> points_;
+};
+
+// out 뒤에 레코드 하나를 붙인다, payload 가 프레임 한도를 넘으면 되돌리고 false
+template <typename Fill>
+inline bool append_relay_record(std::string& out, RelayType type, Fill fill) {
+    size_t start = out.size();
+    out.append(BINARY_HEADER_SIZE, '\0');
+    BinaryWriter writer(out);
+    fill(writer);
+
+    size_t payload_size = out.size() - start - BINARY_HEADER_SIZE;
+    if (payload_size > BINARY_MAX_PAYLOAD) {
+        out.resize(start);
+        return false;
+    }
+    out[start] = static_cast<char>(type);
+    out[start + 1] = 0;
+    out[start + 2] = static_cast<char>((payload_size >> 8) & 0xFF);
+    out[start + 3] = static_cast<char>(payload_size & 0xFF);
+    return true;
+}
+
+// hello 의 HMAC 입력, 보내는 노드와 받는 노드와 보낸 시각을 고정 길이로 이어 붙인다
+inline Sha256::Digest cluster_hello_mac(std::string_view secret, int from_id, int to_id, uint64_t sent_at_ms) {
+    std::string message = "chat-cluster-hello";
+    BinaryWriter writer(message);
+    writer.write_varint(static_cast<uint64_t>(from_id));
+    writer.write_varint(static_cast<uint64_t>(to_id));
+    writer.write_varint(sent_at_ms);
+    return hmac_sha256(secret, message);
+}
+
+inline uint64_t cluster_now_ms() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+// 다른 노드로 보내는 연결, 끊기면 CLUSTER_RECONNECT_INTERVAL 마다 다시 연결한다
+// send 는 어느 스레드에서든 호출 가능하고, 레코드는 링크 strand 에서 pending_ 에 이어 붙였다가
+// 진행 중인 쓰기가 끝나면 한꺼번에 보낸다
+class ClusterLink : public std::enable_shared_from_this<ClusterLink> {
+public:
+    // 연결될 때마다 다른 레코드보다 먼저 보낼 내용 (hello, membership) 을 채운다
+    using ConnectedHandler = std::function<void(std::string& out)>;
+
+    ClusterLink(boost::asio::io_context& io_context, ClusterNode peer, ConnectedHandler on_connected)
+        : strand_(boost::asio::make_strand(io_context)), socket_(strand_), resolver_(strand_), timer_(strand_),
+        peer_(std::move(peer)), on_connected_(std::move(on_connected)) {
+    }
+
+    void start() {
+        auto self = shared_from_this();
+        boost::asio::dispatch(strand_, [this, self]() { connect(); });
+    }
+
+    // 연결이 끊겨 있거나 너무 밀려 있으면 버린다
+    void send(SharedMessage record) {
+        auto self = shared_from_this();
+        boost::asio::dispatch(strand_, [this, self, record]() {
+            if (!connected_ || pending_.size() + record->size() > CLUSTER_LINK_HIGH_WATER) {
+                ++dropped_;
+                return;
+            }
+            pending_ += *record;
+            // 같은 차례에 들어온 레코드가 모두 모인 뒤에 보내도록 한 번 미룬다
+            if (!writing_ && !flush_posted_) {
+                flush_posted_ = true;
+                boost::asio::post(strand_, [this, self]() {
+                    flush_posted_ = false;
+                    flush();
+                });
+            }
+        });
+    }
+
+    int peer_id() const { return peer_.node_id; }
+
+private:
+    void connect() {
+        auto self = shared_from_this();
+        resolver_.async_resolve(peer_.host, std::to_string(peer_.cluster_port),
+            [this, self](boost::system::error_code ec, boost::asio::ip::tcp::resolver::results_type results) {
+                if (ec) {
+                    schedule_reconnect();
+                    return;
+                }
+                boost::asio::async_connect(socket_, results,
+                    [this, self](boost::system::error_code ec, const boost::asio::ip::tcp::endpoint&) {
+                        if (ec) {
+                            schedule_reconnect();
+                            return;
+                        }
+                        boost::system::error_code ignored;
+                        socket_.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+                        connected_ = true;
+                        ++generation_;
+                        CHAT_LOG_INFO << "Cluster link to node " << peer_.node_id << " is up";
+
+                        pending_.clear();
+                        on_connected_(pending_);
+                        watch();
+                        flush();
+                    });
+            });
+    }
+
+    // 상대는 이 연결로 아무것도 보내지 않으므로 읽기가 끝나면 끊긴 것
+    void watch() {
+        auto self = shared_from_this();
+        uint64_t generation = generation_;
+        socket_.async_read_some(boost::asio::buffer(&watch_byte_, 1),
+            [this, self, generation](boost::system::error_code ec, size_t) {
+                if (ec) {
+                    disconnect(generation);
+                }
+                else {
+                    watch();
+                }
+            });
+    }
+
+    void flush() {
+        if (!connected_ || writing_ || pending_.empty()) {
+            return;
+        }
+        writing_ = true;
+        sending_.swap(pending_);
+        pending_.clear();
+
+        auto self = shared_from_this();
+        uint64_t generation = generation_;
+        boost::asio::async_write(socket_, boost::asio::buffer(sending_),
+            [this, self, generation](boost::system::error_code ec, size_t) {
+                writing_ = false;
+                sending_.clear();
+                if (ec) {
+                    disconnect(generation);
+                    return;
+                }
+                flush();
+            });
+    }
+
+    void disconnect(uint64_t generation) {
+        if (!connected_ || generation != generation_) {
+            return;
+        }
+        CHAT_LOG_WARN << "Cluster link to node " << peer_.node_id << " is down";
+        connected_ = false;
+        pending_.clear();
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        schedule_reconnect();
+    }
+
+    void schedule_reconnect() {
+        auto self = shared_from_this();
+        timer_.expires_after(CLUSTER_RECONNECT_INTERVAL);
+        timer_.async_wait([this, self](boost::system::error_code ec) {
+            if (!ec) {
+                connect();
+            }
+        });
+    }
+
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::ip::tcp::resolver resolver_;
+    boost::asio::steady_timer timer_;
+    ClusterNode peer_;
+    ConnectedHandler on_connected_;
+
+    std::string pending_;   // 다음 쓰기에 보낼 레코드
+    std::string sending_;   // 쓰는 중인 레코드
+    bool connected_ = false;
+    bool writing_ = false;
+    bool flush_posted_ = false;
+    uint64_t generation_ = 0;   // 이전 연결의 핸들러가 새 연결을 끊지 않도록
+    uint64_t dropped_ = 0;
+    char watch_byte_ = 0;
+};
+
+// 다른 노드가 연결해 온 받는 쪽 연결, 첫 레코드는 hello
+class ClusterInbound : public std::enable_shared_from_this<ClusterInbound> {
+public:
+    // 형식이 맞지 않으면 false 를 돌려주고, 연결을 끊는다
+    using RecordHandler = std::function<bool(int peer_id, RelayType type, const uint8_t* payload, size_t size)>;
+    // hello 를 확인하고 보낸 노드의 node_id 를 돌려준다, 거절하면 0
+    using HelloHandler = std::function<int(const uint8_t* payload, size_t size, const ClusterInbound* connection)>;
+    // connection 은 같은 노드가 다시 연결했을 때 이전 연결과 구분하는 용도
+    using PeerHandler = std::function<void(int peer_id, const ClusterInbound* connection)>;
+
+    ClusterInbound(boost::asio::ip::tcp::socket socket, RecordHandler on_record, HelloHandler on_hello, PeerHandler on_close)
+        : socket_(std::move(socket)), buffer_(BINARY_HEADER_SIZE + BINARY_MAX_PAYLOAD),
+        on_record_(std::move(on_record)), on_hello_(std::move(on_hello)), on_close_(std::move(on_close)) {
+    }
+
+    void start() {
+        do_read();
+    }
+
+private:
+    void do_read() {
+        auto self = shared_from_this();
+        size_t writable;
+        char* target = buffer_.prepare(writable);
+        socket_.async_read_some(boost::asio::buffer(target, writable), make_custom_alloc_handler(read_memory_,
+            [this, self](boost::system::error_code ec, size_t length) {
+                if (!ec) {
+                    buffer_.commit(length);
+                    if (process_records()) {
+                        do_read();
+                        return;
+                    }
+                }
+                boost::system::error_code ignored;
+                socket_.close(ignored);
+                if (peer_id_ != 0) {
+                    on_close_(peer_id_, this);
+                }
+            }));
+    }
+
+    bool process_records() {
+        for (;;) {
+            std::string_view data = buffer_.data();
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+            if (data.size() < BINARY_HEADER_SIZE) {
+                return true;
+            }
+            RelayType type = static_cast<RelayType>(bytes[0]);
+            size_t payload_size = (static_cast<size_t>(bytes[2]) << 8) | bytes[3];
+            if (data.size() < BINARY_HEADER_SIZE + payload_size) {
+                return true;
+            }
+
+            const uint8_t* payload = bytes + BINARY_HEADER_SIZE;
+            if (type == RelayType::hello) {
+                if (peer_id_ != 0 || (peer_id_ = on_hello_(payload, payload_size, this)) == 0) {
+                    CHAT_LOG_WARN << "Rejected cluster hello";
+                    return false;
+                }
+            }
+            else if (peer_id_ == 0 || !on_record_(peer_id_, type, payload, payload_size)) {
+                CHAT_LOG_WARN << "Invalid cluster record (type " << static_cast<int>(type) << ")";
+                return false;
+            }
+            buffer_.consume(BINARY_HEADER_SIZE + payload_size);
+        }
+    }
+
+    boost::asio::ip::tcp::socket socket_;
+    ReceiveBuffer buffer_;
+    HandlerMemory read_memory_;
+    RecordHandler on_record_;
+    HelloHandler on_hello_;
+    PeerHandler on_close_;
+    int peer_id_ = 0;
+};
+
+// 노드 사이 메시지 버스
+class ClusterBus {
+public:
+    // 소유 노드에서 호출, 다른 노드에 접속한 세션이 보낸 메시지
+    using PublishHandler = std::function<void(int room_id, int user_id, SharedMessage text)>;
+    // 구독 노드에서 호출, 소유 노드가 순서를 정해 다시 보낸 메시지
+    using DeliverHandler = std::function<void(int room_id, SharedMessage text)>;
+
+    ClusterBus(boost::asio::io_context& io_context, ClusterConfig config)
+        : io_context_(io_context), config_(std::move(config)), ring_(config_.nodes), acceptor_(boost::asio::make_strand(io_context)) {
+    }
+
+    ClusterBus(const ClusterBus&) = delete;
+    ClusterBus& operator=(const ClusterBus&) = delete;
+
+    // start 전에 설정
+    void set_handlers(PublishHandler on_publish, DeliverHandler on_deliver) {
+        on_publish_ = std::move(on_publish);
+        on_deliver_ = std::move(on_deliver);
+    }
+
+    void start() {
+        const ClusterNode* self = config_.find(config_.self_id);
+        boost::asio::ip::tcp::resolver resolver(io_context_);
+        boost::asio::ip::tcp::endpoint endpoint = resolver.resolve(self->host, std::to_string(self->cluster_port))->endpoint();
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+        // 재시작할 때 새 프로세스가 같은 포트로 먼저 뜰 수 있게 한다 (chat_server_server.cpp 의 open_listeners 와 같다)
+        acceptor_.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+        do_accept();
+
+        for (const auto& node : config_.nodes) {
+            if (node.node_id == config_.self_id) {
+                continue;
+            }
+            int peer_id = node.node_id;
+            auto link = std::make_shared<ClusterLink>(io_context_, node, [this, peer_id](std::string& out) {
+                on_link_connected(peer_id, out);
+            });
+            links_.emplace(peer_id, link);
+            link->start();
+        }
+    }
+
+    // drain 할 때 어느 스레드에서든, 새 피어 연결은 같은 포트로 뜬 새 프로세스가 받고 이미 맺은 연결은 그대로 둔다
+    void close_listener() {
+        boost::asio::dispatch(acceptor_.get_executor(), [this]() {
+            boost::system::error_code ignored;
+            acceptor_.close(ignored);
+        });
+    }
+
+    int node_id() const { return config_.self_id; }
+    int owner_of(int room_id) const { return ring_.owner_of(room_id); }
+    bool owns(int room_id) const { return owner_of(room_id) == config_.self_id; }
+
+    // 다른 노드가 소유한 방에 보낸 메시지를 소유 노드로 넘긴다
+    void publish(int room_id, int user_id, const SharedMessage& text) {
+        auto record = std::make_shared<std::string>();
+        if (!append_relay_record(*record, RelayType::publish, [&](BinaryWriter& writer) {
+                writer.write_varint(static_cast<uint64_t>(room_id));
+                writer.write_varint(static_cast<uint64_t>(user_id));
+                writer.write_string(*text);
+            })) {
+            CHAT_LOG_WARN << "Message too large to relay (" << text->size() << " bytes), dropped";
+            return;
+        }
+        send_to(owner_of(room_id), record);
+    }
+
+    // 소유 노드에서 호출, 그 방에 멤버가 있는 노드마다 한 번씩 (레코드는 한 번만 만든다)
+    void deliver_to_subscribers(int room_id, const SharedMessage& text) {
+        std::vector<int> targets;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = subscribers_.find(room_id);
+            if (it == subscribers_.end()) {
+                return;
+            }
+            for (const auto& entry : it->second) {
+                targets.push_back(entry.first);
+            }
+        }
+
+        auto record = std::make_shared<std::string>();
+        if (!append_relay_record(*record, RelayType::deliver, [&](BinaryWriter& writer) {
+                writer.write_varint(static_cast<uint64_t>(room_id));
+                writer.write_string(*text);
+            })) {
+            CHAT_LOG_WARN << "Message too large to relay (" << text->size() << " bytes), dropped";
+            return;
+        }
+        for (int node_id : targets) {
+            send_to(node_id, record);
+        }
+    }
+
+    // 소유하지 않은 방의 이 노드 입장 인원이 바뀌었을 때 호출
+    // 같은 방에 대한 호출은 호출한 쪽에서 순서를 보장해야 한다 (ChatServer::rooms_mutex_)
+    void report_membership(int room_id, size_t count) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (count > 0) {
+                local_counts_[room_id] = count;
+            }
+            else {
+                local_counts_.erase(room_id);
+            }
+        }
+        auto record = std::make_shared<std::string>();
+        append_membership(*record, room_id, count);
+        send_to(owner_of(room_id), record);
+    }
+
+    // 이 노드가 소유한 방에 다른 노드로 들어와 있는 세션 수
+    size_t remote_member_count(int room_id) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t total = 0;
+        auto it = subscribers_.find(room_id);
+        if (it != subscribers_.end()) {
+            for (const auto& entry : it->second) {
+                total += entry.second;
+            }
+        }
+        return total;
+    }
+
+private:
+    static void append_membership(std::string& out, int room_id, size_t count) {
+        append_relay_record(out, RelayType::membership, [&](BinaryWriter& writer) {
+            writer.write_varint(static_cast<uint64_t>(room_id));
+            writer.write_varint(count);
+        });
+    }
+
+    void send_to(int node_id, const SharedMessage& record) {
+        auto it = links_.find(node_id);
+        if (it != links_.end()) {
+            it->second->send(record);
+        }
+    }
+
+    void do_accept() {
+        acceptor_.async_accept(boost::asio::make_strand(io_context_),
+            [this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
+                if (!ec) {
+                    boost::system::error_code ignored;
+                    socket.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+                    std::make_shared<ClusterInbound>(std::move(socket),
+                        [this](int peer_id, RelayType type, const uint8_t* payload, size_t size) {
+                            return handle_record(peer_id, type, payload, size);
+                        },
+                        [this](const uint8_t* payload, size_t size, const ClusterInbound* connection) {
+                            return accept_hello(payload, size, connection);
+                        },
+                        [this](int peer_id, const ClusterInbound* connection) { peer_disconnected(peer_id, connection); })->start();
+                }
+                if (acceptor_.is_open()) {
+                    do_accept();
+                }
+            });
+    }
+
+    // 다시 연결되면 그 노드가 소유한 방의 인원을 처음부터 다시 알린다
+    void on_link_connected(int peer_id, std::string& out) {
+        uint64_t sent_at_ms = cluster_now_ms();
+        Sha256::Digest mac = cluster_hello_mac(config_.secret, config_.self_id, peer_id, sent_at_ms);
+        append_relay_record(out, RelayType::hello, [&](BinaryWriter& writer) {
+            writer.write_varint(static_cast<uint64_t>(config_.self_id));
+            writer.write_varint(static_cast<uint64_t>(peer_id));
+            writer.write_varint(sent_at_ms);
+            writer.write_string(std::string_view(reinterpret_cast<const char*>(mac.data()), mac.size()));
+        });
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : local_counts_) {
+            if (owner_of(entry.first) == peer_id) {
+                append_membership(out, entry.first, entry.second);
+            }
+        }
+    }
+
+    bool handle_record(int peer_id, RelayType type, const uint8_t* payload, size_t size) {
+        BinaryReader reader(payload, size);
+        int room_id = 0;
+        switch (type) {
+        case RelayType::publish: {
+            int user_id = 0;
+            std::string_view text;
+            if (!reader.read_int(room_id) || !reader.read_int(user_id) || !reader.read_string(text) || !reader.at_end()) {
+                return false;
+            }
+            on_publish_(room_id, user_id, make_shared_message(std::string(text)));
+            return true;
+        }
+        case RelayType::deliver: {
+            std::string_view text;
+            if (!reader.read_int(room_id) || !reader.read_string(text) || !reader.at_end()) {
+                return false;
+            }
+            on_deliver_(room_id, make_shared_message(std::string(text)));
+            return true;
+        }
+        case RelayType::membership: {
+            uint64_t count = 0;
+            if (!reader.read_int(room_id) || !reader.read_varint(count) || !reader.at_end()) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& nodes = subscribers_[room_id];
+            if (count > 0) {
+                nodes[peer_id] = static_cast<size_t>(count);
+            }
+            else {
+                nodes.erase(peer_id);
+                if (nodes.empty()) {
+                    subscribers_.erase(room_id);
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // 설정에 있는 다른 노드가 이 노드 앞으로 최근에 만든 hello 여야 받는다
+    int accept_hello(const uint8_t* payload, size_t size, const ClusterInbound* connection) {
+        BinaryReader reader(payload, size);
+        int peer_id = 0;
+        int target_id = 0;
+        uint64_t sent_at_ms = 0;
+        std::string_view mac;
+        if (!reader.read_int(peer_id) || !reader.read_int(target_id) || !reader.read_varint(sent_at_ms)
+            || !reader.read_string(mac) || !reader.at_end()) {
+            return 0;
+        }
+        if (peer_id == config_.self_id || !config_.find(peer_id)) {
+            CHAT_LOG_WARN << "Cluster hello from unknown node " << peer_id;
+            return 0;
+        }
+        if (target_id != config_.self_id) {
+            CHAT_LOG_WARN << "Cluster hello from node " << peer_id << " was meant for node " << target_id;
+            return 0;
+        }
+        uint64_t now_ms = cluster_now_ms();
+        uint64_t skew_ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(CLUSTER_HELLO_MAX_SKEW).count());
+        Sha256::Digest expected = cluster_hello_mac(config_.secret, peer_id, target_id, sent_at_ms);
+        if ((sent_at_ms > now_ms ? sent_at_ms - now_ms : now_ms - sent_at_ms) > skew_ms
+            || !constant_time_equal(mac, std::string_view(reinterpret_cast<const char*>(expected.data()), expected.size()))) {
+            CHAT_LOG_WARN << "Cluster hello from node " << peer_id << " failed authentication";
+            return 0;
+        }
+        peer_connected(peer_id, connection);
+        return peer_id;
+    }
+
+    // 다시 연결한 노드는 구독을 처음부터 다시 알려 오므로 이전 것은 지운다
+    void peer_connected(int peer_id, const ClusterInbound* connection) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        inbound_[peer_id] = connection;
+        clear_subscriptions(peer_id);
+    }
+
+    // 받는 연결이 끊기면 그 노드의 구독은 다시 연결되어 알려 올 때까지 없는 것으로 본다
+    // 그 사이 새 연결이 들어왔으면 그대로 둔다
+    void peer_disconnected(int peer_id, const ClusterInbound* connection) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = inbound_.find(peer_id);
+        if (it == inbound_.end() || it->second != connection) {
+            return;
+        }
+        inbound_.erase(it);
+        clear_subscriptions(peer_id);
+    }
+
+    // mutex_ 를 잡은 상태에서 호출
+    void clear_subscriptions(int peer_id) {
+        for (auto it = subscribers_.begin(); it != subscribers_.end();) {
+            it->second.erase(peer_id);
+            it = it->second.empty() ? subscribers_.erase(it) : std::next(it);
+        }
+    }
+
+    boost::asio::io_context& io_context_;
+    ClusterConfig config_;
+    HashRing ring_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::unordered_map<int, std::shared_ptr<ClusterLink>> links_;  // start 이후 바뀌지 않음
+    PublishHandler on_publish_;
+    DeliverHandler on_deliver_;
+
+    mutable std::mutex mutex_;  // subscribers_, local_counts_, inbound_ 보호
+    std::unordered_map<int, std::unordered_map<int, size_t>> subscribers_;  // room_id → (node_id → 인원), 소유한 방만
+    std::unordered_map<int, size_t> local_counts_;  // room_id → 이 노드 인원, 소유하지 않은 방만
+    std::unordered_map<int, const ClusterInbound*> inbound_;  // node_id → 지금 받고 있는 연결
+};
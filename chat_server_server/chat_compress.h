@@ -0,0 +1,212 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "chat_buffer.h"
+#include "chat_protocol.h"
+
+// 서버 → 클라이언트 프레임 압축 (바이너리 프로토콜만, 형식은 chat_protocol.h)
+// LZ4 block format 그대로라서 다른 언어의 클라이언트는 liblz4 의 LZ4_decompress_safe_usingDict 에 CHAT_DICTIONARY 를 주면 풀 수 있다
+// 채팅 메시지는 짧아서 혼자서는 잘 줄지 않으므로, 자주 나오는 문자열을 모은 사전을 압축 창 앞에 깔고 시작한다
+// 압축된 payload: [원래 크기 varint][LZ4 block]
+//
+// 사전을 바꾸면 이전 클라이언트가 풀 수 없으므로 새 codec 비트를 추가한다
+
+const uint64_t CODEC_LZ4_CHAT = 1;           // hello / resume 의 codecs 비트
+const size_t MAX_DECOMPRESSED_SIZE = 1 << 20;
+
+// 한국어는 소스 파일 인코딩과 상관없이 같은 바이트가 되도록 UTF-8 바이트를 그대로 적었다
+inline constexpr std::string_view CHAT_DICTIONARY =
+    "the and you that this what have with for are just not but was can will I think I don't knowdo you "
+    "are you is it it's I'm don't can't going to right nowthanksthank youhello hi hey yes no okay ok lol haha"
+    "hahaha good nice sorry please let me tomorrow today tonight morning meeting everyone anyone someone "
+    "http://https://www..com/A new user has joined the chat.A user has left the chat.has been kicked."
+    "is now the host."
+    "\xEC\x95\x88\xEB\x85\x95\xED\x95\x98\xEC\x84\xB8\xEC\x9A\x94\x20" "\xEA\xB0\x90\xEC\x82\xAC\xED\x95\xA9\xEB\x8B\x88\xEB\x8B\xA4\x20"  // 안녕하세요, 감사합니다
+    "\xE3\x85\x8B\xE3\x85\x8B\xE3\x85\x8B\xE3\x85\x8B\xE3\x85\x8B\xE3\x85\x8B" "\xE3\x85\x8E\xE3\x85\x8E\xE3\x85\x8E"  // ㅋㅋㅋㅋㅋㅋ, ㅎㅎㅎ
+    "\xEB\x84\xA4\x20" "\xEC\x95\x84\xEB\x8B\x88\xEC\x9A\x94\x20"  // 네, 아니요
+    "\xEA\xB4\x9C\xEC\xB0\xAE\xEC\x95\x84\xEC\x9A\x94\x20" "\xEC\xA3\x84\xEC\x86\xA1\xED\x95\xA9\xEB\x8B\x88\xEB\x8B\xA4\x20"  // 괜찮아요, 죄송합니다
+    "\xEC\x9E\xA0\xEC\x8B\x9C\xEB\xA7\x8C\xEC\x9A\x94\x20" "\xED\x98\xB9\xEC\x8B\x9C\x20"  // 잠시만요, 혹시
+    "\xEC\xA7\x84\xEC\xA7\x9C\x20" "\xEC\xA7\x80\xEA\xB8\x88\x20"  // 진짜, 지금
+    "\xEC\x98\xA4\xEB\x8A\x98\x20" "\xEB\x82\xB4\xEC\x9D\xBC\x20"  // 오늘, 내일
+    "\xEA\xB7\xB8\xEB\x9E\x98\xEC\x84\x9C\x20" "\xEA\xB7\xBC\xEB\x8D\xB0\x20"  // 그래서, 근데
+    "\xEC\x9E\x88\xEC\x96\xB4\xEC\x9A\x94\x20" "\xED\x96\x88\xEC\x96\xB4\xEC\x9A\x94\x20"  // 있어요, 했어요
+    "\xED\x95\xA9\xEB\x8B\x88\xEB\x8B\xA4\x20" "\xEC\x9E\x85\xEB\x8B\x88\xEB\x8B\xA4\x20";  // 합니다, 입니다
+
+const size_t LZ4_MIN_MATCH = 4;
+const size_t LZ4_LAST_LITERALS = 5;      // 마지막 5 바이트는 항상 리터럴
+const size_t LZ4_MATCH_FIND_LIMIT = 12;  // 끝에서 12 바이트 안에서는 매치를 시작하지 않는다
+const size_t LZ4_MAX_DISTANCE = 65535;
+const unsigned LZ4_HASH_BITS = 12;
+const uint32_t LZ4_NO_POSITION = UINT32_MAX;
+
+using Lz4HashTable = std::array<uint32_t, size_t(1) << LZ4_HASH_BITS>;
+
+inline uint32_t lz4_read32(const char* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+inline uint32_t lz4_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// 15 를 넘는 길이는 255 씩 끊어서 이어 붙인다
+inline void lz4_write_length(std::string& out, size_t length) {
+    for (length -= 15; length >= 255; length -= 255) {
+        out.push_back(static_cast<char>(255));
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+inline void lz4_write_literals(std::string& out, uint8_t match_nibble, const char* literals, size_t count) {
+    out.push_back(static_cast<char>((std::min<size_t>(count, 15) << 4) | match_nibble));
+    if (count >= 15) {
+        lz4_write_length(out, count);
+    }
+    out.append(literals, count);
+}
+
+// 사전 위치로 채워 둔 해시 테이블, 압축할 때마다 복사해서 쓴다
+inline const Lz4HashTable& lz4_dictionary_table() {
+    static const Lz4HashTable table = []() {
+        Lz4HashTable built;
+        built.fill(LZ4_NO_POSITION);
+        for (size_t pos = 0; pos + LZ4_MIN_MATCH <= CHAT_DICTIONARY.size(); ++pos) {
+            built[lz4_hash(lz4_read32(CHAT_DICTIONARY.data() + pos))] = static_cast<uint32_t>(pos);
+        }
+        return built;
+    }();
+    return table;
+}
+
+// 사전 + input 을 이어 붙인 창에서 input 부분만 압축해 out 뒤에 붙인다 (greedy, 한 번 훑기)
+inline void lz4_compress_with_dictionary(std::string_view input, std::string& out) {
+    thread_local std::string window;
+    thread_local Lz4HashTable table;
+    window.assign(CHAT_DICTIONARY.data(), CHAT_DICTIONARY.size());
+    window.append(input.data(), input.size());
+    table = lz4_dictionary_table();
+
+    const char* src = window.data();
+    size_t end = window.size();
+    size_t anchor = CHAT_DICTIONARY.size();
+    if (input.size() > LZ4_MATCH_FIND_LIMIT) {
+        size_t match_limit = end - LZ4_MATCH_FIND_LIMIT;
+        size_t extend_limit = end - LZ4_LAST_LITERALS;
+        for (size_t pos = anchor; pos < match_limit;) {
+            uint32_t sequence = lz4_read32(src + pos);
+            uint32_t& slot = table[lz4_hash(sequence)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(pos);
+            if (candidate == LZ4_NO_POSITION || pos - candidate > LZ4_MAX_DISTANCE || lz4_read32(src + candidate) != sequence) {
+                ++pos;
+                continue;
+            }
+
+            size_t match_end = pos + LZ4_MIN_MATCH;
+            while (match_end < extend_limit && src[match_end] == src[candidate + (match_end - pos)]) {
+                ++match_end;
+            }
+            size_t match_length = match_end - pos - LZ4_MIN_MATCH;
+            size_t offset = pos - candidate;
+            lz4_write_literals(out, static_cast<uint8_t>(std::min<size_t>(match_length, 15)), src + anchor, pos - anchor);
+            out.push_back(static_cast<char>(offset & 0xFF));
+            out.push_back(static_cast<char>(offset >> 8));
+            if (match_length >= 15) {
+                lz4_write_length(out, match_length);
+            }
+            pos = anchor = match_end;
+        }
+    }
+    lz4_write_literals(out, 0, src + anchor, end - anchor);
+}
+
+// 형식이 맞지 않거나 크기가 raw_size 와 다르면 false
+inline bool lz4_decompress_with_dictionary(std::string_view block, size_t raw_size, std::string& out) {
+    std::string window;
+    window.reserve(CHAT_DICTIONARY.size() + raw_size);
+    window.assign(CHAT_DICTIONARY.data(), CHAT_DICTIONARY.size());
+    size_t limit = CHAT_DICTIONARY.size() + raw_size;
+
+    auto read_length = [&](size_t& i, size_t& length) {
+        if (length != 15) {
+            return true;
+        }
+        uint8_t byte;
+        do {
+            if (i >= block.size()) {
+                return false;
+            }
+            byte = static_cast<uint8_t>(block[i++]);
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    size_t i = 0;
+    while (i < block.size()) {
+        uint8_t token = static_cast<uint8_t>(block[i++]);
+        size_t literals = token >> 4;
+        if (!read_length(i, literals) || literals > block.size() - i || literals > limit - window.size()) {
+            return false;
+        }
+        window.append(block.data() + i, literals);
+        i += literals;
+        if (i == block.size()) {
+            break;  // 마지막 sequence 는 리터럴만 있다
+        }
+
+        if (block.size() - i < 2) {
+            return false;
+        }
+        size_t offset = static_cast<uint8_t>(block[i]) | (static_cast<size_t>(static_cast<uint8_t>(block[i + 1])) << 8);
+        i += 2;
+        size_t match_length = token & 0x0F;
+        if (offset == 0 || offset > window.size() || !read_length(i, match_length)) {
+            return false;
+        }
+        match_length += LZ4_MIN_MATCH;
+        if (match_length > limit - window.size()) {
+            return false;
+        }
+        // 겹치는 매치 (offset < 길이) 가 있으므로 한 바이트씩
+        for (size_t from = window.size() - offset, k = 0; k < match_length; ++k) {
+            char byte = window[from + k];
+            window.push_back(byte);
+        }
+    }
+    if (window.size() != limit) {
+        return false;
+    }
+    out.assign(window, CHAT_DICTIONARY.size(), std::string::npos);
+    return true;
+}
+
+// 압축해서 줄지 않으면 nullptr, 그대로 보내면 된다
+inline SharedMessage compress_message(std::string_view raw) {
+    std::string out;
+    BinaryWriter(out).write_varint(raw.size());
+    lz4_compress_with_dictionary(raw, out);
+    if (out.size() >= raw.size()) {
+        return nullptr;
+    }
+    return make_shared_message(std::move(out));
+}
+
+// FRAME_FLAG_COMPRESSED 가 붙은 프레임의 payload 를 푼다
+inline bool decompress_message(std::string_view payload, std::string& out) {
+    BinaryReader reader(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+    uint64_t raw_size = 0;
+    if (!reader.read_varint(raw_size) || raw_size > MAX_DECOMPRESSED_SIZE) {
+        return false;
+    }
+    return lz4_decompress_with_dictionary(reader.rest(), static_cast<size_t>(raw_size), out);
+}
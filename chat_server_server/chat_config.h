@@ -0,0 +1,188 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// 서버 설정
+// 설정 파일이 없으면 아래 기본값으로 뜬다, 파일에 적은 항목만 바뀐다
+
+// 명령 처리 속도 제한, 팬아웃 / DB 기록 / 조회 전에 확인해서 폭주하는 쪽을 입구에서 버린다
+// rate 가 0 이면 제한 없음
+struct RateLimits {
+    double user_rate = 20;          // 세션 하나가 초당 보낼 수 있는 명령 / 채팅
+    double user_burst = 40;
+    double room_rate = 500;         // 방 하나에 초당 브로드캐스트되는 채팅, 보내는 세션 전체 합
+    double room_burst = 1000;
+    double history_cost = 5;        // fetch_history 는 DB 를 읽으므로 토큰을 더 쓴다
+    double search_cost = 10;        // search_text 는 전문 색인을 읽으므로 더 많이
+    size_t abuse_disconnect = 200;  // 연속으로 이만큼 거절되면 연결을 끊는다, 0 이면 끊지 않음
+};
+
+// 입장 / 퇴장 알림, 한 명마다 방 전체에 보내면 방이 다시 찰 때 O(N^2) 쓰기가 된다
+// window 동안 모아서 presence 알림 하나로 보내고, 큰 방은 드물게 보내거나 아예 보내지 않는다
+struct PresenceOptions {
+    std::chrono::milliseconds window{ 250 };
+    size_t max_ids = 32;                        // 알림 하나에 싣는 id 수 (입장 / 퇴장 각각)
+    size_t sample_members = 500;                // 멤버가 이보다 많으면 sample_window 마다 한 번만
+    std::chrono::milliseconds sample_window{ 5000 };
+    size_t off_members = 5000;                  // 멤버가 이보다 많으면 보내지 않는다, 0 이면 항상 보낸다
+};
+
+// talks 월별 보관 (chat_archive.h)
+struct ArchiveOptions {
+    bool enabled = true;
+    unsigned hot_months = 2;                    // 이번 달을 포함해 최근 몇 달을 talks 에 남길지
+    std::chrono::minutes interval{ 60 };        // 옮길 달이 있는지 확인하는 간격
+    size_t delete_batch = 5000;                 // talks 에서 한 트랜잭션에 지우는 id 구간, 기록 스레드가 기다리는 시간을 짧게
+};
+
+// 접속해 있지 않은 유저에게 온 귓속말 / 초대, 다음 입장 때 한 번에 전달한다
+struct InboxOptions {
+    bool enabled = true;
+    size_t max_per_user = 100;                  // 넘으면 오래된 것부터 지운다
+    std::chrono::hours ttl{ 7 * 24 };           // 이보다 오래된 알림은 전달하지 않고 지운다
+};
+
+// 접속마다 거는 소켓 옵션, 버퍼 크기가 0 이면 OS 기본값
+struct SocketOptions {
+    bool no_delay = true;           // 채팅은 작은 메시지라 Nagle 로 묶이면 지연만 늘어난다
+    bool keep_alive = true;         // heartbeat 를 못 받는 오래된 클라이언트도 커널이 정리하게
+    int send_buffer = 0;
+    int receive_buffer = 0;
+};
+
+struct ServerConfig {
+    uint16_t port = 12345;          // 클러스터 설정이 있으면 자기 노드의 client_port
+    unsigned threads = 0;           // io 스레드 수, 0 이면 코어 수
+    size_t max_frame_size = 8 * 1024; // 한 줄(텍스트) 또는 한 프레임(바이너리)의 최대 크기, 수신 버퍼 용량이 된다
+    std::string cluster;            // 클러스터 설정 파일 (형식은 chat_cluster.h), 비어 있으면 단독
+    uint16_t admin_port = 12346;    // Prometheus 가 긁어 가는 관리용 포트, 0 이면 열지 않음
+    unsigned search_threads = 2;    // search_text 를 처리하는 스레드 (스레드마다 읽기 전용 DB 연결 하나)
+    unsigned history_threads = 2;   // fetch_history 와 방의 최근 메시지 캐시를 DB 에서 읽는 스레드
+    unsigned auth_threads = 0;      // 비밀번호 해시와 users 조회를 하는 스레드 (chat_auth.h), 0 이면 코어 수의 절반
+    std::chrono::milliseconds receipt_flush{ 2000 }; // 바뀐 읽음 표시를 모아서 기록하는 간격 (chat_receipts.h)
+    bool require_auth = false;      // 켜면 login_user / create_user 로 확인된 user_id 로만 입장할 수 있다 (기존 클라이언트는 끄고 쓴다)
+    std::chrono::minutes idle_timeout{ 0 }; // 채팅 / 명령 없이 heartbeat 만 오가는 연결을 이만큼 지나면 닫는다, 0 이면 닫지 않는다
+
+    // 접속 받기
+    // SO_REUSEPORT 가 있으면 같은 포트에 acceptor 를 여러 개 열어서 커널이 나눠 주게 한다 (없으면 하나)
+    unsigned acceptors = 0;         // 0 이면 io 스레드 수만큼
+    unsigned accepts_per_acceptor = 4;  // acceptor 마다 동시에 걸어 두는 async_accept 수
+    int backlog = 1024;
+    SocketOptions socket;
+
+    // 접속 폭주 (재연결 폭풍) 에서도 fd 와 메모리가 한도 안에 있게 한다
+    size_t max_connections = 10000;
+    double accept_rate = 500;       // 넘으면 accept 를 쉬고 커널 backlog 에서 기다리게 한다
+    double accept_burst = 1000;
+
+    // 압축을 협상한 바이너리 클라이언트에게만, 이보다 큰 payload 를 압축해서 보낸다 (chat_compress.h)
+    bool compression = true;
+    size_t compression_min_size = 128;
+
+    RateLimits limits;
+    PresenceOptions presence;
+    ArchiveOptions archive;
+    InboxOptions inbox;
+};
+
+// 파일 형식, '#' 뒤는 주석, 한 줄에 "이름 값"
+//   port 12345
+//   threads 8
+//   acceptors 0
+//   tcp_nodelay 1
+//   user_rate 20
+inline ServerConfig load_server_config(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Can't open server config: " + path);
+    }
+
+    ServerConfig config;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string keyword;
+        if (!(fields >> keyword)) {
+            continue;
+        }
+
+        auto read = [&](auto& value) {
+            if (!(fields >> value)) {
+                throw std::runtime_error("Invalid value for " + keyword + " in server config");
+            }
+        };
+        auto read_millis = [&](std::chrono::milliseconds& value) {
+            long long millis = 0;
+            read(millis);
+            value = std::chrono::milliseconds(millis);
+        };
+        auto read_minutes = [&](std::chrono::minutes& value) {
+            long long minutes = 0;
+            read(minutes);
+            value = std::chrono::minutes(minutes);
+        };
+        auto read_hours = [&](std::chrono::hours& value) {
+            long long hours = 0;
+            read(hours);
+            value = std::chrono::hours(hours);
+        };
+
+        if (keyword == "port") read(config.port);
+        else if (keyword == "threads") read(config.threads);
+        else if (keyword == "max_frame_size") read(config.max_frame_size);
+        else if (keyword == "cluster") read(config.cluster);
+        else if (keyword == "admin_port") read(config.admin_port);
+        else if (keyword == "search_threads") read(config.search_threads);
+        else if (keyword == "history_threads") read(config.history_threads);
+        else if (keyword == "auth_threads") read(config.auth_threads);
+        else if (keyword == "receipt_flush_ms") read_millis(config.receipt_flush);
+        else if (keyword == "require_auth") read(config.require_auth);
+        else if (keyword == "idle_timeout_min") read_minutes(config.idle_timeout);
+        else if (keyword == "acceptors") read(config.acceptors);
+        else if (keyword == "accepts_per_acceptor") read(config.accepts_per_acceptor);
+        else if (keyword == "backlog") read(config.backlog);
+        else if (keyword == "tcp_nodelay") read(config.socket.no_delay);
+        else if (keyword == "keepalive") read(config.socket.keep_alive);
+        else if (keyword == "send_buffer") read(config.socket.send_buffer);
+        else if (keyword == "receive_buffer") read(config.socket.receive_buffer);
+        else if (keyword == "max_connections") read(config.max_connections);
+        else if (keyword == "accept_rate") read(config.accept_rate);
+        else if (keyword == "accept_burst") read(config.accept_burst);
+        else if (keyword == "compression") read(config.compression);
+        else if (keyword == "compression_min_size") read(config.compression_min_size);
+        else if (keyword == "user_rate") read(config.limits.user_rate);
+        else if (keyword == "user_burst") read(config.limits.user_burst);
+        else if (keyword == "room_rate") read(config.limits.room_rate);
+        else if (keyword == "room_burst") read(config.limits.room_burst);
+        else if (keyword == "history_cost") read(config.limits.history_cost);
+        else if (keyword == "search_cost") read(config.limits.search_cost);
+        else if (keyword == "abuse_disconnect") read(config.limits.abuse_disconnect);
+        else if (keyword == "presence_window_ms") read_millis(config.presence.window);
+        else if (keyword == "presence_max_ids") read(config.presence.max_ids);
+        else if (keyword == "presence_sample_members") read(config.presence.sample_members);
+        else if (keyword == "presence_sample_window_ms") read_millis(config.presence.sample_window);
+        else if (keyword == "presence_off_members") read(config.presence.off_members);
+        else if (keyword == "archive") read(config.archive.enabled);
+        else if (keyword == "archive_hot_months") read(config.archive.hot_months);
+        else if (keyword == "archive_interval_min") read_minutes(config.archive.interval);
+        else if (keyword == "archive_delete_batch") read(config.archive.delete_batch);
+        else if (keyword == "inbox") read(config.inbox.enabled);
+        else if (keyword == "inbox_max_per_user") read(config.inbox.max_per_user);
+        else if (keyword == "inbox_ttl_hours") read_hours(config.inbox.ttl);
+        else {
+            throw std::runtime_error("Unknown server config keyword: " + keyword);
+        }
+    }
+
+    if (config.max_frame_size == 0 || config.accepts_per_acceptor == 0 || config.search_threads == 0 || config.history_threads == 0) {
+        throw std::runtime_error("max_frame_size, accepts_per_acceptor, search_threads and history_threads must be positive");
+    }
+    return config;
+}
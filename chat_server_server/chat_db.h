@@ -0,0 +1,910 @@
+#pragma once
+
+#include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "chat_buffer.h"
+#include "chat_log.h"
+#include "chat_metrics.h"
+#include "chat_queue.h"
+
+// 데이터베이스 파일 경로
+inline const std::string DB_FILE = "data/chat_server.db";
+
+// 다른 스레드의 연결이 쓰기 잠금을 잡고 있을 때 기다리는 최대 시간
+const int DB_BUSY_TIMEOUT_MS = 5000;
+
+// 캐시된 준비 문장을 빌려 쓰는 핸들
+// 소멸될 때 reset / clear_bindings 해서 다음 호출이 바로 다시 bind 할 수 있게 한다
+class DBStatement {
+public:
+    explicit DBStatement(sqlite3_stmt* stmt) : stmt_(stmt) {}
+
+    DBStatement(DBStatement&& other) noexcept : stmt_(other.stmt_) {
+        other.stmt_ = nullptr;
+    }
+
+    DBStatement(const DBStatement&) = delete;
+    DBStatement& operator=(const DBStatement&) = delete;
+
+    ~DBStatement() {
+        if (stmt_) {
+            sqlite3_reset(stmt_);
+            sqlite3_clear_bindings(stmt_);
+        }
+    }
+
+    explicit operator bool() const { return stmt_ != nullptr; }
+    sqlite3_stmt* get() const { return stmt_; }
+
+    void bind(int index, int value) { sqlite3_bind_int(stmt_, index, value); }
+    void bind(int index, sqlite3_int64 value) { sqlite3_bind_int64(stmt_, index, value); }
+
+    // SQLITE_STATIC 이므로 value 는 step 이 끝날 때까지 살아 있어야 한다
+    void bind(int index, std::string_view value) {
+        sqlite3_bind_text(stmt_, index, value.data(), static_cast<int>(value.size()), SQLITE_STATIC);
+    }
+
+    int step() { return sqlite3_step(stmt_); }
+
+    // 같은 핸들로 여러 번 실행할 때 다음 bind 전에 호출
+    void reset() {
+        sqlite3_reset(stmt_);
+        sqlite3_clear_bindings(stmt_);
+    }
+
+private:
+    sqlite3_stmt* stmt_;
+};
+
+// 스레드마다 하나씩 유지되는 SQLite 연결
+// 요청마다 open / prepare / close 하지 않고 연결과 준비 문장을 계속 재사용한다
+class DBConnection {
+public:
+    explicit DBConnection(const std::string& path, int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) {
+        if (sqlite3_open_v2(path.c_str(), &db_, flags, nullptr) != SQLITE_OK) {
+            CHAT_LOG_ERROR << "Can't open database: " << sqlite3_errmsg(db_);
+            sqlite3_close(db_);
+            db_ = nullptr;
+            return;
+        }
+        sqlite3_busy_timeout(db_, DB_BUSY_TIMEOUT_MS);
+    }
+
+    DBConnection(const DBConnection&) = delete;
+    DBConnection& operator=(const DBConnection&) = delete;
+
+    ~DBConnection() {
+        for (auto& entry : statements_) {
+            sqlite3_finalize(entry.second);
+        }
+        sqlite3_close(db_);
+    }
+
+    bool is_open() const { return db_ != nullptr; }
+    sqlite3* handle() const { return db_; }
+    const char* last_error() const { return db_ ? sqlite3_errmsg(db_) : "database is not open"; }
+
+    // sql 은 프로그램이 끝날 때까지 유효한 정적 문자열이어야 한다 (캐시 키로 그대로 사용)
+    // 같은 문장을 동시에 두 번 빌리면 안 된다
+    DBStatement prepare(std::string_view sql) {
+        if (!db_) {
+            return DBStatement(nullptr);
+        }
+
+        auto it = statements_.find(sql);
+        if (it != statements_.end()) {
+            return DBStatement(it->second);
+        }
+
+        sqlite3_stmt* stmt = nullptr;
+        int rc = sqlite3_prepare_v3(db_, sql.data(), static_cast<int>(sql.size()),
+            SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            CHAT_LOG_ERROR << "Failed to prepare statement: " << sqlite3_errmsg(db_);
+            return DBStatement(nullptr);
+        }
+        statements_.emplace(sql, stmt);
+        return DBStatement(stmt);
+    }
+
+    // 결과가 필요 없는 일회성 SQL (스키마, PRAGMA 등)
+    bool exec(const char* sql) {
+        if (!db_) {
+            return false;
+        }
+        return sqlite3_exec(db_, sql, nullptr, nullptr, nullptr) == SQLITE_OK;
+    }
+
+    // 호출한 스레드 전용 연결, 처음 사용할 때 열리고 스레드가 끝날 때 닫힌다
+    static DBConnection& for_this_thread() {
+        thread_local DBConnection connection(DB_FILE);
+        return connection;
+    }
+
+    // 검색처럼 오래 걸릴 수 있는 조회 전용, 쓰기 잠금을 잡지 않으므로 WAL 에서 기록 스레드와 다투지 않는다
+    // 쓰는 연결과는 따로 열리므로 같은 스레드에서 for_this_thread 와 섞어 써도 된다
+    static DBConnection& read_only_for_this_thread() {
+        thread_local DBConnection connection(DB_FILE, SQLITE_OPEN_READONLY);
+        return connection;
+    }
+
+private:
+    sqlite3* db_ = nullptr;
+    std::unordered_map<std::string_view, sqlite3_stmt*> statements_;
+};
+
+// 스키마 변경 한 단계, PRAGMA user_version 에 마지막으로 적용한 version 을 남긴다
+struct SchemaMigration {
+    int version;
+    const char* description;
+    const char* sql;
+};
+
+// user_version 보다 높은 단계만 순서대로 각각 한 트랜잭션으로 적용
+// 하나라도 실패하면 그 단계를 되돌리고 false
+inline bool run_migrations(DBConnection& db, const SchemaMigration* migrations, size_t count) {
+    int current = 0;
+    {
+        DBStatement stmt = db.prepare("PRAGMA user_version;");
+        if (!stmt || stmt.step() != SQLITE_ROW) {
+            CHAT_LOG_ERROR << "Failed to read schema version: " << db.last_error();
+            return false;
+        }
+        current = sqlite3_column_int(stmt.get(), 0);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const SchemaMigration& migration = migrations[i];
+        if (migration.version <= current) {
+            continue;
+        }
+
+        std::string set_version = "PRAGMA user_version = " + std::to_string(migration.version) + ";";
+        if (!db.exec("BEGIN;") || !db.exec(migration.sql) || !db.exec(set_version.c_str()) || !db.exec("COMMIT;")) {
+            CHAT_LOG_ERROR << "Schema migration " << migration.version << " (" << migration.description
+                << ") failed: " << db.last_error();
+            db.exec("ROLLBACK;");
+            return false;
+        }
+        CHAT_LOG_INFO << "Applied schema migration " << migration.version << ": " << migration.description;
+        current = migration.version;
+    }
+    return true;
+}
+
+// talks 테이블의 한 행 (text 는 브로드캐스트한 버퍼를 그대로 공유)
+struct StoredTalk {
+    sqlite3_int64 id = 0;
+    int room_id = 0;
+    int user_id = 0;
+    std::time_t published = 0;
+    SharedMessage text;
+};
+
+inline StoredTalk read_talk_row(DBStatement& stmt) {
+    StoredTalk talk;
+    talk.id = sqlite3_column_int64(stmt.get(), 0);
+    talk.user_id = sqlite3_column_int(stmt.get(), 1);
+    talk.published = static_cast<std::time_t>(sqlite3_column_int64(stmt.get(), 2));
+    const unsigned char* text = sqlite3_column_text(stmt.get(), 3);
+    talk.text = make_shared_message(std::string(reinterpret_cast<const char*>(text),
+        static_cast<size_t>(sqlite3_column_bytes(stmt.get(), 3))));
+    return talk;
+}
+
+// room_id 방에서 before_id 보다 오래된 메시지를 최신순으로 최대 limit 개
+// OFFSET 없이 마지막으로 받은 id 에서 이어 읽는 keyset 조회
+// idx_talks_room_history (room_id, id) 범위를 거꾸로 읽고, 나머지 열은 행마다 rowid 로 찾아간다
+// db 는 talks 가 있는 연결 (본 DB 또는 월별 보관 파일, chat_archive.h)
+inline std::vector<StoredTalk> load_talks(DBConnection& db, int room_id, sqlite3_int64 before_id, int limit) {
+    std::vector<StoredTalk> talks;
+    DBStatement stmt = db.prepare("SELECT id, user_id, CAST(strftime('%s', published_date) AS INTEGER), text "
+        "FROM talks WHERE room_id = ? AND id < ? ORDER BY id DESC LIMIT ?;");
+    if (!stmt) {
+        return talks;
+    }
+
+    stmt.bind(1, room_id);
+    stmt.bind(2, before_id);
+    stmt.bind(3, limit);
+
+    int rc;
+    while ((rc = stmt.step()) == SQLITE_ROW) {
+        StoredTalk talk = read_talk_row(stmt);
+        talk.room_id = room_id;
+        talks.push_back(std::move(talk));
+    }
+    if (rc != SQLITE_DONE) {
+        CHAT_LOG_ERROR << "Failed to load talks: " << db.last_error();
+    }
+    return talks;
+}
+
+inline std::vector<StoredTalk> load_talks(int room_id, sqlite3_int64 before_id, int limit) {
+    return load_talks(DBConnection::for_this_thread(), room_id, before_id, limit);
+}
+
+// 방의 가장 큰 메시지 id, 없거나 실패하면 0
+inline sqlite3_int64 latest_talk_id(DBConnection& db, int room_id) {
+    DBStatement stmt = db.prepare("SELECT MAX(id) FROM talks WHERE room_id = ?;");
+    if (!stmt) {
+        return 0;
+    }
+    stmt.bind(1, room_id);
+    return stmt.step() == SQLITE_ROW ? sqlite3_column_int64(stmt.get(), 0) : 0;
+}
+
+// after_id < id < before_id 인 방의 메시지 수, limit 에서 멈춘다 (인덱스에서 limit 행까지만 읽는다)
+// 센 것 중 가장 작은 id 를 oldest 에 (없으면 before_id 그대로)
+inline int count_talks(DBConnection& db, int room_id, sqlite3_int64 after_id, sqlite3_int64 before_id, int limit, sqlite3_int64& oldest) {
+    oldest = before_id;
+    DBStatement stmt = db.prepare("SELECT COUNT(*), MIN(id) FROM (SELECT id FROM talks "
+        "WHERE room_id = ? AND id > ? AND id < ? ORDER BY id DESC LIMIT ?);");
+    if (!stmt) {
+        return 0;
+    }
+    stmt.bind(1, room_id);
+    stmt.bind(2, after_id);
+    stmt.bind(3, before_id);
+    stmt.bind(4, limit);
+    if (stmt.step() != SQLITE_ROW) {
+        CHAT_LOG_ERROR << "Failed to count talks: " << db.last_error();
+        return 0;
+    }
+    int count = sqlite3_column_int(stmt.get(), 0);
+    if (count > 0) {
+        oldest = sqlite3_column_int64(stmt.get(), 1);
+    }
+    return count;
+}
+
+// 사용자가 입력한 검색어를 FTS5 MATCH 식으로 바꾼다
+// 공백으로 나눈 낱말마다 따옴표로 감싸서 FTS5 문법 (AND, NEAR, 열 필터 등) 으로 해석되지 않게 하고,
+// 접두어 검색 (*) 으로 만들어서 조사가 붙은 한국어 낱말도 찾게 한다, 낱말은 모두 들어 있어야 한다
+// 낱말이 없으면 빈 문자열
+inline std::string fts5_match_query(std::string_view input) {
+    std::string query;
+    size_t pos = 0;
+    while (pos < input.size()) {
+        size_t start = input.find_first_not_of(" \t", pos);
+        if (start == std::string_view::npos) {
+            break;
+        }
+        size_t end = input.find_first_of(" \t", start);
+        std::string_view term = input.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        if (!query.empty()) {
+            query += ' ';
+        }
+        query += '"';
+        for (char c : term) {
+            if (c == '"') {
+                query += '"';
+            }
+            query += c;
+        }
+        query += "\"*";
+        pos = end == std::string_view::npos ? input.size() : end;
+    }
+    return query;
+}
+
+// room_id 방의 메시지 중 query 의 낱말이 모두 들어 있는 것을 관련도 (bm25) 순으로 offset 부터 최대 limit 개
+// talks_fts 는 talks 를 내용으로 쓰는 FTS5 색인, 기록 스레드가 같은 트랜잭션에서 함께 넣는다
+// 실패하면 false (검색어 문법 오류 포함)
+inline bool search_talks(DBConnection& db, int room_id, std::string_view query, int offset, int limit, std::vector<StoredTalk>& talks) {
+    DBStatement stmt = db.prepare("SELECT t.id, t.user_id, CAST(strftime('%s', t.published_date) AS INTEGER), t.text "
+        "FROM talks_fts JOIN talks t ON t.id = talks_fts.rowid "
+        "WHERE talks_fts MATCH ? AND t.room_id = ? ORDER BY rank LIMIT ? OFFSET ?;");
+    if (!stmt) {
+        return false;
+    }
+    std::string match = fts5_match_query(query);
+    stmt.bind(1, std::string_view(match));
+    stmt.bind(2, room_id);
+    stmt.bind(3, limit);
+    stmt.bind(4, offset);
+
+    int rc;
+    while ((rc = stmt.step()) == SQLITE_ROW) {
+        StoredTalk talk = read_talk_row(stmt);
+        talk.room_id = room_id;
+        talks.push_back(std::move(talk));
+    }
+    if (rc != SQLITE_DONE) {
+        CHAT_LOG_ERROR << "Failed to search talks: " << db.last_error();
+        return false;
+    }
+    return true;
+}
+
+struct UserRecord {
+    int id = 0;
+    std::string login_id;
+    std::string name;
+    std::string password_hash;  // 형식은 chat_auth.h (이전 DB 에서 옮겨 온 행은 평문일 수 있다)
+};
+
+inline UserRecord read_user_row(DBStatement& stmt) {
+    auto column = [&stmt](int index) {
+        const unsigned char* text = sqlite3_column_text(stmt.get(), index);
+        return std::string(text ? reinterpret_cast<const char*>(text) : "",
+            static_cast<size_t>(sqlite3_column_bytes(stmt.get(), index)));
+    };
+    UserRecord user;
+    user.id = sqlite3_column_int(stmt.get(), 0);
+    user.login_id = column(1);
+    user.name = column(2);
+    user.password_hash = column(3);
+    return user;
+}
+
+enum class DBResult {
+    ok,
+    not_found,
+    conflict,  // UNIQUE 제약 위반
+    failed,
+};
+
+inline DBResult load_user(std::string_view login_id, UserRecord& user) {
+    DBConnection& db = DBConnection::for_this_thread();
+    DBStatement stmt = db.prepare("SELECT id, login_id, name, password_hash FROM users WHERE login_id = ?;");
+    if (!stmt) {
+        return DBResult::failed;
+    }
+    stmt.bind(1, login_id);
+
+    int rc = stmt.step();
+    if (rc == SQLITE_ROW) {
+        user = read_user_row(stmt);
+        return DBResult::ok;
+    }
+    if (rc != SQLITE_DONE) {
+        CHAT_LOG_ERROR << "Failed to load user: " << db.last_error();
+        return DBResult::failed;
+    }
+    return DBResult::not_found;
+}
+
+inline DBResult load_user(int user_id, UserRecord& user) {
+    DBConnection& db = DBConnection::for_this_thread();
+    DBStatement stmt = db.prepare("SELECT id, login_id, name, password_hash FROM users WHERE id = ?;");
+    if (!stmt) {
+        return DBResult::failed;
+    }
+    stmt.bind(1, user_id);
+
+    int rc = stmt.step();
+    if (rc == SQLITE_ROW) {
+        user = read_user_row(stmt);
+        return DBResult::ok;
+    }
+    if (rc != SQLITE_DONE) {
+        CHAT_LOG_ERROR << "Failed to load user: " << db.last_error();
+        return DBResult::failed;
+    }
+    return DBResult::not_found;
+}
+
+// 최근에 만든 계정부터 최대 limit 개 (시작할 때 캐시를 채우는 용도)
+inline std::vector<UserRecord> load_recent_users(int limit) {
+    std::vector<UserRecord> users;
+    DBConnection& db = DBConnection::for_this_thread();
+    DBStatement stmt = db.prepare("SELECT id, login_id, name, password_hash FROM users ORDER BY id DESC LIMIT ?;");
+    if (!stmt) {
+        return users;
+    }
+    stmt.bind(1, limit);
+
+    int rc;
+    while ((rc = stmt.step()) == SQLITE_ROW) {
+        users.push_back(read_user_row(stmt));
+    }
+    if (rc != SQLITE_DONE) {
+        CHAT_LOG_ERROR << "Failed to load users: " << db.last_error();
+    }
+    return users;
+}
+
+// 성공하면 user.id 를 채운다, login_id 나 name 이 이미 있으면 conflict
+inline DBResult insert_user(UserRecord& user) {
+    DBConnection& db = DBConnection::for_this_thread();
+    DBStatement stmt = db.prepare("INSERT INTO users (login_id, name, password_hash) VALUES (?, ?, ?);");
+    if (!stmt) {
+        return DBResult::failed;
+    }
+    stmt.bind(1, user.login_id);
+    stmt.bind(2, user.name);
+    stmt.bind(3, user.password_hash);
+
+    int rc = stmt.step();
+    if (rc == SQLITE_DONE) {
+        user.id = static_cast<int>(sqlite3_last_insert_rowid(db.handle()));
+        return DBResult::ok;
+    }
+    if (rc == SQLITE_CONSTRAINT) {
+        return DBResult::conflict;
+    }
+    CHAT_LOG_ERROR << "Failed to insert user: " << db.last_error();
+    return DBResult::failed;
+}
+
+inline bool update_password_hash(int user_id, std::string_view password_hash) {
+    DBConnection& db = DBConnection::for_this_thread();
+    DBStatement stmt = db.prepare("UPDATE users SET password_hash = ? WHERE id = ?;");
+    if (!stmt) {
+        return false;
+    }
+    stmt.bind(1, password_hash);
+    stmt.bind(2, user_id);
+    if (stmt.step() != SQLITE_DONE) {
+        CHAT_LOG_ERROR << "Failed to update password hash: " << db.last_error();
+        return false;
+    }
+    return true;
+}
+
+// 메시지 기록 파이프라인 설정
+struct MessageWriterConfig {
+    size_t batch_size = 256;                          // 이만큼 모이면 바로 커밋
+    std::chrono::milliseconds flush_interval{ 20 };   // 첫 메시지가 들어온 뒤 이 시간이 지나면 커밋
+    std::string synchronous = "NORMAL";               // PRAGMA synchronous (OFF / NORMAL / FULL)
+    size_t backlog_warning = 10000;                   // 큐가 이 이상 밀리면 경고
+    size_t inbox_max_per_user = 100;                  // 유저마다 inbox 에 남기는 최근 알림 수
+    std::chrono::seconds inbox_ttl{ 7 * 24 * 3600 };  // 이보다 오래된 알림은 전달하지 않고 지운다
+};
+
+// 기록 파이프라인 상태 (stats() 로 조회)
+struct MessageWriterStats {
+    uint64_t enqueued = 0;
+    uint64_t written = 0;
+    uint64_t failed = 0;
+    uint64_t batches = 0;
+    uint64_t backlog_warnings = 0;   // 큐 길이가 backlog_warning 을 넘은 횟수
+    size_t queue_depth = 0;
+    size_t max_queue_depth = 0;
+    uint64_t last_batch_usec = 0;    // 마지막 트랜잭션에 걸린 시간
+    uint64_t inbox_written = 0;
+    uint64_t inbox_dropped = 0;      // 유저당 한도를 넘겨서 / 만료돼서 전달하지 못하고 지운 알림
+};
+
+// 접속해 있지 않은 유저에게 온 알림, 다음 입장 때 한 번에 전달하고 지운다
+struct InboxEntry {
+    sqlite3_int64 id = 0;
+    int user_id = 0;                 // 받는 사람
+    uint8_t kind = 0;                // 전달할 프레임 opcode (chat_protocol.h 의 deliver_direct / deliver_invite)
+    int from_user_id = 0;
+    int room_id = 0;                 // 초대받은 방, 귓속말은 0
+    std::time_t created = 0;
+    std::string text;                // 귓속말 본문, 초대는 비어 있다
+};
+
+// 만료되지 않은 알림을 오래된 것부터 limit 개까지
+inline std::vector<InboxEntry> load_inbox(DBConnection& db, int user_id, std::time_t oldest, int limit) {
+    std::vector<InboxEntry> entries;
+    DBStatement stmt = db.prepare("SELECT id, kind, from_user_id, room_id, created, text FROM inbox "
+        "WHERE user_id = ? AND created >= ? ORDER BY id LIMIT ?;");
+    if (!stmt) {
+        return entries;
+    }
+    stmt.bind(1, user_id);
+    stmt.bind(2, static_cast<sqlite3_int64>(oldest));
+    stmt.bind(3, limit);
+
+    int rc;
+    while ((rc = stmt.step()) == SQLITE_ROW) {
+        InboxEntry entry;
+        entry.id = sqlite3_column_int64(stmt.get(), 0);
+        entry.user_id = user_id;
+        entry.kind = static_cast<uint8_t>(sqlite3_column_int(stmt.get(), 1));
+        entry.from_user_id = sqlite3_column_int(stmt.get(), 2);
+        entry.room_id = sqlite3_column_int(stmt.get(), 3);
+        entry.created = static_cast<std::time_t>(sqlite3_column_int64(stmt.get(), 4));
+        const unsigned char* text = sqlite3_column_text(stmt.get(), 5);
+        entry.text.assign(text ? reinterpret_cast<const char*>(text) : "", static_cast<size_t>(sqlite3_column_bytes(stmt.get(), 5)));
+        entries.push_back(std::move(entry));
+    }
+    if (rc != SQLITE_DONE) {
+        CHAT_LOG_ERROR << "Failed to load inbox: " << db.last_error();
+    }
+    return entries;
+}
+
+// talks 테이블 기록 전용 스레드
+// 모든 방의 메시지를 무잠금 큐로 받아서 BEGIN ... COMMIT 한 번에 묶어 기록하므로
+// 브로드캐스트 경로는 디스크 지연을 기다리지 않는다
+// 접속해 있지 않은 유저의 inbox 에 넣고, 꺼내 가면서 지우는 것도 같은 큐 / 트랜잭션으로 처리한다
+class MessageWriter {
+public:
+    // 커밋이 끝난 메시지를 id 와 함께 넘겨받는 콜백 (기록 스레드에서 호출)
+    using CommitListener = std::function<void(std::vector<StoredTalk>&)>;
+    // take_inbox 결과 (기록 스레드에서 호출)
+    using InboxCallback = std::function<void(std::vector<InboxEntry>)>;
+
+    explicit MessageWriter(MessageWriterConfig config = {})
+        : config_(std::move(config)) {
+    }
+
+    // start 전에 설정
+    void set_commit_listener(CommitListener listener) {
+        commit_listener_ = std::move(listener);
+    }
+
+    MessageWriter(const MessageWriter&) = delete;
+    MessageWriter& operator=(const MessageWriter&) = delete;
+
+    ~MessageWriter() {
+        stop();
+    }
+
+    void start() {
+        if (thread_.joinable()) {
+            return;
+        }
+        stopping_.store(false);
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    // 큐에 남은 메시지를 모두 기록한 뒤 스레드 종료
+    void stop() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        stopping_.store(true);
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    // 어느 스레드에서든 호출 가능
+    void enqueue(int room_id, int user_id, SharedMessage text) {
+        PendingTalk entry;
+        entry.room_id = room_id;
+        entry.user_id = user_id;
+        entry.text = std::move(text);
+        entry.published = std::time(nullptr);
+        push(std::move(entry));
+        enqueued_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 어느 스레드에서든, 커밋되면 inbox_max_per_user 를 넘는 오래된 알림은 지운다
+    void enqueue_inbox(int to_user_id, uint8_t kind, int from_user_id, int room_id, SharedMessage text) {
+        PendingTalk entry;
+        entry.room_id = room_id;
+        entry.user_id = from_user_id;
+        entry.text = std::move(text);
+        entry.published = std::time(nullptr);
+        entry.inbox_user_id = to_user_id;
+        entry.inbox_kind = kind;
+        push(std::move(entry));
+    }
+
+    // 어느 스레드에서든, 만료되지 않은 알림을 오래된 것부터 limit 개까지 읽고 같은 트랜잭션에서 지운다
+    // 큐에서 앞선 enqueue_inbox 는 포함되고, 같은 유저가 곧바로 다시 꺼내도 이미 넘긴 알림은 다시 나오지 않는다
+    // 커밋하지 못했으면 빈 목록 (알림은 남아 있다가 다음에 나간다)
+    void take_inbox(int user_id, std::time_t oldest, int limit, InboxCallback done) {
+        PendingTalk entry;
+        entry.inbox_user_id = user_id;
+        entry.take = std::make_shared<InboxTake>();
+        entry.take->oldest = oldest;
+        entry.take->limit = limit;
+        entry.take->done = std::move(done);
+        push(std::move(entry));
+    }
+
+    MessageWriterStats stats() const {
+        MessageWriterStats stats;
+        stats.enqueued = enqueued_.load(std::memory_order_relaxed);
+        stats.written = written_.load(std::memory_order_relaxed);
+        stats.failed = failed_.load(std::memory_order_relaxed);
+        stats.batches = batches_.load(std::memory_order_relaxed);
+        stats.backlog_warnings = backlog_warnings_.load(std::memory_order_relaxed);
+        stats.queue_depth = depth_.load(std::memory_order_relaxed);
+        stats.max_queue_depth = max_depth_.load(std::memory_order_relaxed);
+        stats.last_batch_usec = last_batch_usec_.load(std::memory_order_relaxed);
+        stats.inbox_written = inbox_written_.load(std::memory_order_relaxed);
+        stats.inbox_dropped = inbox_dropped_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // 트랜잭션 하나 (BEGIN ~ COMMIT) 에 걸린 시간
+    const ShardedHistogram& batch_latency() const { return batch_latency_; }
+
+private:
+    struct InboxTake {
+        std::time_t oldest = 0;
+        int limit = 0;
+        InboxCallback done;
+        std::vector<InboxEntry> entries;
+    };
+
+    struct PendingTalk {
+        int room_id = 0;
+        int user_id = 0;
+        SharedMessage text;
+        std::time_t published = 0;
+        // inbox_user_id 가 0 이 아니면 talks 대신 그 유저의 inbox 에 (user_id 가 보낸 사람)
+        // take 가 있으면 넣지 않고 그 유저의 inbox 를 꺼내 간다
+        int inbox_user_id = 0;
+        uint8_t inbox_kind = 0;
+        std::shared_ptr<InboxTake> take;
+    };
+
+    // 꺼내는 쪽의 fetch_sub 가 먼저 돌아 depth_ 가 0 아래로 넘어가지 않게 넣기 전에 센다
+    void push(PendingTalk talk) {
+        size_t depth = depth_.fetch_add(1, std::memory_order_acq_rel) + 1;
+        queue_.push(std::move(talk));
+
+        size_t max_depth = max_depth_.load(std::memory_order_relaxed);
+        while (depth > max_depth && !max_depth_.compare_exchange_weak(max_depth, depth, std::memory_order_relaxed)) {
+        }
+
+        if (depth == config_.batch_size) {
+            wake_.notify_one();
+        }
+        if (depth == config_.backlog_warning) {
+            backlog_warnings_.fetch_add(1, std::memory_order_relaxed);
+            CHAT_LOG_WARN << "Message writer is falling behind: " << depth << " messages queued";
+        }
+    }
+
+    void run() {
+        DBConnection& db = DBConnection::for_this_thread();
+        if (!db.exec("PRAGMA journal_mode=WAL;")) {
+            CHAT_LOG_ERROR << "Failed to enable WAL journal mode: " << db.last_error();
+        }
+        std::string synchronous = "PRAGMA synchronous=" + config_.synchronous + ";";
+        if (!db.exec(synchronous.c_str())) {
+            CHAT_LOG_ERROR << "Failed to set synchronous level: " << db.last_error();
+        }
+
+        std::vector<PendingTalk> batch;
+        batch.reserve(config_.batch_size);
+        auto batch_deadline = std::chrono::steady_clock::now();
+
+        for (;;) {
+            PendingTalk talk;
+            while (batch.size() < config_.batch_size && queue_.pop(talk)) {
+                depth_.fetch_sub(1, std::memory_order_acq_rel);
+                if (batch.empty()) {
+                    batch_deadline = std::chrono::steady_clock::now() + config_.flush_interval;
+                }
+                batch.push_back(std::move(talk));
+            }
+
+            bool stopping = stopping_.load();
+            if (!batch.empty() && (batch.size() >= config_.batch_size || stopping
+                || std::chrono::steady_clock::now() >= batch_deadline)) {
+                write_batch(db, batch);
+                batch.clear();
+                continue;
+            }
+            if (stopping) {
+                if (batch.empty() && depth_.load() == 0) {
+                    break;
+                }
+                continue;
+            }
+
+            // 생산자는 배치가 찰 때만 깨우므로 나머지는 마감 시간까지 기다렸다가 처리
+            auto deadline = batch.empty()
+                ? std::chrono::steady_clock::now() + config_.flush_interval
+                : batch_deadline;
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_.wait_until(lock, deadline, [this]() {
+                return stopping_.load() || depth_.load() >= config_.batch_size;
+            });
+        }
+    }
+
+    struct BatchResult {
+        std::vector<StoredTalk> committed;
+        uint64_t inbox_written = 0;
+        uint64_t inbox_dropped = 0;
+    };
+
+    // 메시지는 이미 방송됐으므로 트랜잭션이 실패하면 한 번 더 써 보고, 그래도 안 되면 failed 로 센다
+    void write_batch(DBConnection& db, std::vector<PendingTalk>& batch) {
+        auto started = std::chrono::steady_clock::now();
+        size_t talk_count = static_cast<size_t>(std::count_if(batch.begin(), batch.end(), [](const PendingTalk& talk) {
+            return talk.inbox_user_id == 0;
+        }));
+
+        BatchResult result;
+        bool written_batch = write_transaction(db, batch, result);
+        if (!written_batch) {
+            CHAT_LOG_WARN << "Retrying a batch of " << batch.size() << " queued writes";
+            result = BatchResult();
+            written_batch = write_transaction(db, batch, result);
+        }
+        if (!written_batch) {
+            result = BatchResult();
+            for (auto& talk : batch) {
+                if (talk.take) {
+                    talk.take->entries.clear();
+                }
+            }
+        }
+
+        uint64_t written = result.committed.size();
+        written_.fetch_add(written, std::memory_order_relaxed);
+        failed_.fetch_add(talk_count - written, std::memory_order_relaxed);
+        inbox_written_.fetch_add(result.inbox_written, std::memory_order_relaxed);
+        inbox_dropped_.fetch_add(result.inbox_dropped, std::memory_order_relaxed);
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        uint64_t batch_usec = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started).count());
+        last_batch_usec_.store(batch_usec, std::memory_order_relaxed);
+        batch_latency_.record_usec(batch_usec);
+
+        if (commit_listener_ && !result.committed.empty()) {
+            commit_listener_(result.committed);
+        }
+        for (auto& talk : batch) {
+            if (talk.take) {
+                talk.take->done(std::move(talk.take->entries));
+            }
+        }
+    }
+
+    // BEGIN ~ COMMIT 한 번, batch 는 건드리지 않으므로 실패하면 그대로 다시 호출할 수 있다
+    bool write_transaction(DBConnection& db, const std::vector<PendingTalk>& batch, BatchResult& result) {
+        if (!db.exec("BEGIN;")) {
+            CHAT_LOG_ERROR << "Failed to begin transaction: " << db.last_error();
+            return false;
+        }
+
+        {
+            DBStatement stmt = db.prepare("INSERT INTO talks (room_id, user_id, text, published_date) VALUES (?, ?, ?, datetime(?, 'unixepoch'));");
+            // 검색 색인도 같은 트랜잭션에서 넣어서 커밋된 메시지는 바로 검색된다
+            DBStatement index = db.prepare("INSERT INTO talks_fts (rowid, text, room_id) VALUES (?, ?, ?);");
+            std::vector<int> inbox_users;
+            for (const auto& talk : batch) {
+                if (talk.take) {
+                    take_inbox(db, talk.inbox_user_id, *talk.take);
+                    continue;
+                }
+                if (talk.inbox_user_id != 0) {
+                    if (write_inbox(db, talk)) {
+                        ++result.inbox_written;
+                        inbox_users.push_back(talk.inbox_user_id);
+                    }
+                    continue;
+                }
+                if (!stmt) {
+                    continue;
+                }
+                stmt.bind(1, talk.room_id);
+                stmt.bind(2, talk.user_id);
+                stmt.bind(3, std::string_view(*talk.text));
+                stmt.bind(4, static_cast<sqlite3_int64>(talk.published));
+                if (stmt.step() == SQLITE_DONE) {
+                    sqlite3_int64 id = sqlite3_last_insert_rowid(db.handle());
+                    if (index) {
+                        index.bind(1, id);
+                        index.bind(2, std::string_view(*talk.text));
+                        index.bind(3, talk.room_id);
+                        if (index.step() != SQLITE_DONE) {
+                            CHAT_LOG_ERROR << "Failed to index message: " << db.last_error();
+                        }
+                        index.reset();
+                    }
+                    result.committed.push_back(StoredTalk{ id,
+                        talk.room_id, talk.user_id, talk.published, talk.text });
+                }
+                else {
+                    CHAT_LOG_ERROR << "Failed to insert message: " << db.last_error();
+                }
+                stmt.reset();
+            }
+            result.inbox_dropped = trim_inboxes(db, inbox_users);
+        }
+
+        if (!db.exec("COMMIT;")) {
+            CHAT_LOG_ERROR << "Failed to commit messages: " << db.last_error();
+            db.exec("ROLLBACK;");
+            return false;
+        }
+        return true;
+    }
+
+    // 지우지 못하면 넘기지 않는다 (다음에 다시 꺼낼 때 중복되지 않게)
+    void take_inbox(DBConnection& db, int user_id, InboxTake& take) {
+        take.entries = load_inbox(db, user_id, take.oldest, take.limit);
+        if (take.entries.empty()) {
+            return;
+        }
+        DBStatement stmt = db.prepare("DELETE FROM inbox WHERE user_id = ? AND id <= ?;");
+        if (stmt) {
+            stmt.bind(1, user_id);
+            stmt.bind(2, take.entries.back().id);
+        }
+        if (!stmt || stmt.step() != SQLITE_DONE) {
+            CHAT_LOG_ERROR << "Failed to clear inbox: " << db.last_error();
+            take.entries.clear();
+        }
+    }
+
+    bool write_inbox(DBConnection& db, const PendingTalk& entry) {
+        DBStatement stmt = db.prepare("INSERT INTO inbox (user_id, kind, from_user_id, room_id, created, text) VALUES (?, ?, ?, ?, ?, ?);");
+        if (!stmt) {
+            return false;
+        }
+        stmt.bind(1, entry.inbox_user_id);
+        stmt.bind(2, static_cast<int>(entry.inbox_kind));
+        stmt.bind(3, entry.user_id);
+        stmt.bind(4, entry.room_id);
+        stmt.bind(5, static_cast<sqlite3_int64>(entry.published));
+        stmt.bind(6, entry.text ? std::string_view(*entry.text) : std::string_view(""));
+        if (stmt.step() != SQLITE_DONE) {
+            CHAT_LOG_ERROR << "Failed to update inbox: " << db.last_error();
+            return false;
+        }
+        return true;
+    }
+
+    // 이번 배치에서 받은 유저들의 inbox 를 최근 inbox_max_per_user 개로 줄이고, 1분에 한 번 만료된 알림을 지운다
+    // 지운 행 수를 돌려준다
+    uint64_t trim_inboxes(DBConnection& db, std::vector<int>& users) {
+        uint64_t dropped = 0;
+        std::sort(users.begin(), users.end());
+        users.erase(std::unique(users.begin(), users.end()), users.end());
+        for (int user_id : users) {
+            DBStatement trim = db.prepare("DELETE FROM inbox WHERE user_id = ?1 AND id <= "
+                "(SELECT id FROM inbox WHERE user_id = ?1 ORDER BY id DESC LIMIT 1 OFFSET ?2);");
+            if (!trim) {
+                break;
+            }
+            trim.bind(1, user_id);
+            trim.bind(2, static_cast<sqlite3_int64>(config_.inbox_max_per_user));
+            if (trim.step() == SQLITE_DONE) {
+                dropped += static_cast<uint64_t>(sqlite3_changes(db.handle()));
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_inbox_expiry_) {
+            next_inbox_expiry_ = now + std::chrono::minutes(1);
+            DBStatement expire = db.prepare("DELETE FROM inbox WHERE created < ?;");
+            if (expire) {
+                expire.bind(1, static_cast<sqlite3_int64>(std::time(nullptr) - config_.inbox_ttl.count()));
+                if (expire.step() == SQLITE_DONE) {
+                    dropped += static_cast<uint64_t>(sqlite3_changes(db.handle()));
+                }
+            }
+        }
+        return dropped;
+    }
+
+    MessageWriterConfig config_;
+    CommitListener commit_listener_;
+    MpscQueue<PendingTalk> queue_;
+    std::thread thread_;
+    std::atomic<bool> stopping_{ false };
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+
+    std::atomic<size_t> depth_{ 0 };
+    std::atomic<size_t> max_depth_{ 0 };
+    std::atomic<uint64_t> enqueued_{ 0 };
+    std::atomic<uint64_t> written_{ 0 };
+    std::atomic<uint64_t> failed_{ 0 };
+    std::atomic<uint64_t> batches_{ 0 };
+    std::atomic<uint64_t> backlog_warnings_{ 0 };
+    std::atomic<uint64_t> last_batch_usec_{ 0 };
+    std::atomic<uint64_t> inbox_written_{ 0 };
+    std::atomic<uint64_t> inbox_dropped_{ 0 };
+    ShardedHistogram batch_latency_;
+    std::chrono::steady_clock::time_point next_inbox_expiry_;    // 기록 스레드 전용
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <sqlite3.h>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "chat_archive.h"
+#include "chat_metrics.h"
+
+// 기록 조회 (fetch_history 의 DB 구간과 방이 열릴 때 최근 메시지 캐시 채우기)
+// 보관 파일까지 이어 읽으면 오래 걸릴 수 있어서 방 / 세션 strand 가 아니라 전용 풀에서 읽는다
+// 결과는 풀 스레드에서 돌려주므로 받는 쪽에서 자기 strand 로 다시 넘긴다
+
+const size_t HISTORY_MAX_PENDING = 256;  // 풀에 쌓인 조회가 이보다 많으면 바로 빈 결과로
+
+class HistoryService {
+public:
+    using Callback = std::function<void(std::vector<StoredTalk>)>;
+
+    explicit HistoryService(size_t workers) : pool_(workers) {}
+
+    // 아직 시작하지 않은 조회는 버리고, 처리 중인 조회가 끝날 때까지 기다린다
+    ~HistoryService() {
+        pool_.stop();
+        pool_.join();
+    }
+
+    // before_id 보다 오래된 메시지를 최신순으로 limit 개
+    // done 은 조회 스레드에서 호출된다 (풀이 가득 차면 호출한 스레드에서 바로)
+    void load(int room_id, sqlite3_int64 before_id, int limit, Callback done) {
+        if (pending_.fetch_add(1, std::memory_order_relaxed) >= HISTORY_MAX_PENDING) {
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            rejected_.add();
+            done({});
+            return;
+        }
+        boost::asio::post(pool_, [this, room_id, before_id, limit, done = std::move(done)]() {
+            std::vector<StoredTalk> talks;
+            {
+                ScopedLatency timing(latency_);
+                talks = load_room_history(room_id, before_id, limit);
+            }
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            done(std::move(talks));
+        });
+    }
+
+    uint64_t rejected() const { return rejected_.value(); }
+    const ShardedHistogram& latency() const { return latency_; }
+
+private:
+    boost::asio::thread_pool pool_;
+    std::atomic<size_t> pending_{ 0 };
+
+    ShardedCounter rejected_;
+    ShardedHistogram latency_;         // 조회 하나를 처리하는 시간
+};
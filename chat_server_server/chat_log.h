@@ -0,0 +1,370 @@
+#pragma once
+
+#include "chat_queue.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// 비동기 로거
+// 호출한 스레드는 자기 링 버퍼 한 칸에 줄을 복사해 넣기만 하고, 시간 문자열을 만들고 stdout / stderr 에 쓰는 일은 싱크 스레드가 한다
+// 링이 가득 차면 기다리지 않고 버린 뒤 개수만 센다 (소켓 핸들러가 로그 때문에 멈추지 않도록)
+// 레벨 검사는 인자를 만들기 전에 하고, CHAT_LOG_MIN_LEVEL 보다 낮은 로그는 컴파일 단계에서 빠진다
+//
+//   CHAT_LOG_INFO << "User " << user_id << " joined room " << room_id;
+//   CHAT_LOG_DEBUG << "password: " << redacted(password);
+
+enum class LogLevel : uint8_t {
+    debug = 0,
+    info = 1,
+    warn = 2,
+    error = 3,
+};
+
+// 릴리스 빌드 (NDEBUG) 는 debug 로그를 코드에서 아예 뺀다, 빌드 옵션으로 덮어쓸 수 있다
+#ifndef CHAT_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define CHAT_LOG_MIN_LEVEL 1
+#else
+#define CHAT_LOG_MIN_LEVEL 0
+#endif
+#endif
+
+const size_t LOG_LINE_MAX = 240;                               // 넘치는 뒷부분은 잘리고 ... 으로 표시
+const size_t LOG_RING_SLOTS = 1024;                            // 스레드마다, 2의 거듭제곱
+const std::chrono::milliseconds LOG_SINK_IDLE_WAIT{ 2 };       // 모든 링이 비었을 때 싱크가 쉬는 시간
+
+struct LogRecord {
+    int64_t time_usec = 0;  // system_clock 기준
+    LogLevel level = LogLevel::info;
+    uint16_t length = 0;
+    char text[LOG_LINE_MAX];
+};
+
+// 비밀번호처럼 로그에 남기면 안 되는 값, 자리만 *** 로 남긴다
+struct Redacted {
+    std::string_view value;
+};
+
+inline Redacted redacted(std::string_view value) {
+    return Redacted{ value };
+}
+
+inline const char* log_level_name(LogLevel level) {
+    switch (level) {
+    case LogLevel::debug: return "DEBUG";
+    case LogLevel::info: return "INFO";
+    case LogLevel::warn: return "WARN";
+    case LogLevel::error: return "ERROR";
+    }
+    return "?";
+}
+
+// 실행 중 레벨은 환경 변수 CHAT_LOG_LEVEL (debug, info, warn, error) 로 정한다, 없으면 info
+inline LogLevel log_level_from_environment() {
+    const char* value = std::getenv("CHAT_LOG_LEVEL");
+    std::string_view name = value ? value : "";
+    if (name == "debug") return LogLevel::debug;
+    if (name == "warn") return LogLevel::warn;
+    if (name == "error") return LogLevel::error;
+    return LogLevel::info;
+}
+
+class Logger {
+public:
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    static bool enabled(LogLevel level) {
+        return static_cast<uint8_t>(level) >= level_.load(std::memory_order_relaxed);
+    }
+
+    static void set_level(LogLevel level) {
+        level_.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+    }
+
+    // 호출한 스레드의 링에 넣는다, 싱크가 멈춘 뒤에는 바로 쓴다
+    void submit(LogLevel level, const char* text, size_t length) {
+        int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        if (stopped_.load(std::memory_order_acquire)) {
+            std::string line;
+            append_prefix(line, now, level);
+            line.append(text, length).append("\n");
+            std::fwrite(line.data(), 1, line.size(), level >= LogLevel::warn ? stderr : stdout);
+            return;
+        }
+
+        ThreadRing& ring = thread_ring();
+        bool pushed = ring.ring.push([&](LogRecord& record) {
+            record.time_usec = now;
+            record.level = level;
+            record.length = static_cast<uint16_t>(length);
+            std::memcpy(record.text, text, length);
+        });
+        if (!pushed) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // 링이 가득 차서 버린 줄 수
+    uint64_t dropped() const {
+        return dropped_total_.load(std::memory_order_relaxed);
+    }
+
+    // 남은 로그를 모두 쓰고 싱크 스레드를 멈춘다
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                return;
+            }
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        sink_.join();
+        stopped_.store(true, std::memory_order_release);
+    }
+
+private:
+    struct ThreadRing {
+        SpscRing<LogRecord, LOG_RING_SLOTS> ring;
+        std::atomic<uint64_t> dropped{ 0 };
+        uint64_t reported_dropped = 0;  // 싱크 스레드만 접근
+    };
+
+    Logger() : sink_([this]() { run(); }) {
+    }
+
+    ~Logger() {
+        stop();
+    }
+
+    // 스레드가 끝나도 registry 가 링을 들고 있다가 다 비운 뒤에 놓는다
+    ThreadRing& thread_ring() {
+        thread_local std::shared_ptr<ThreadRing> ring = register_ring();
+        return *ring;
+    }
+
+    std::shared_ptr<ThreadRing> register_ring() {
+        auto ring = std::make_shared<ThreadRing>();
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(ring);
+        ++rings_generation_;
+        return ring;
+    }
+
+    void run() {
+        std::vector<std::shared_ptr<ThreadRing>> rings;
+        uint64_t generation = 0;
+        std::vector<LogRecord> pending;
+        std::string out;
+        std::string err;
+
+        for (;;) {
+            bool stopping;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping = stopping_;
+                if (generation != rings_generation_) {
+                    rings = rings_;
+                    generation = rings_generation_;
+                }
+            }
+
+            // 스레드마다 따로 쌓인 줄을 시간 순으로 합쳐서 쓴다
+            for (const auto& ring : rings) {
+                ring->ring.drain([&](const LogRecord& record) {
+                    pending.push_back(record);
+                });
+            }
+            std::stable_sort(pending.begin(), pending.end(), [](const LogRecord& a, const LogRecord& b) {
+                return a.time_usec < b.time_usec;
+            });
+            for (const auto& record : pending) {
+                std::string& target = record.level >= LogLevel::warn ? err : out;
+                append_prefix(target, record.time_usec, record.level);
+                target.append(record.text, record.length).append("\n");
+            }
+            report_dropped(rings, err);
+
+            size_t written = pending.size();
+            pending.clear();
+            flush(out, stdout);
+            flush(err, stderr);
+
+            prune_finished_threads(rings);
+            if (stopping) {
+                return;
+            }
+            if (written == 0) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait_for(lock, LOG_SINK_IDLE_WAIT, [this]() { return stopping_; });
+            }
+        }
+    }
+
+    void report_dropped(const std::vector<std::shared_ptr<ThreadRing>>& rings, std::string& err) {
+        uint64_t newly_dropped = 0;
+        for (const auto& ring : rings) {
+            uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+            newly_dropped += dropped - ring->reported_dropped;
+            ring->reported_dropped = dropped;
+        }
+        if (newly_dropped == 0) {
+            return;
+        }
+        dropped_total_.fetch_add(newly_dropped, std::memory_order_relaxed);
+        int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        append_prefix(err, now, LogLevel::warn);
+        err.append("Logger dropped ").append(std::to_string(newly_dropped)).append(" lines (ring full)\n");
+    }
+
+    // 끝난 스레드 (registry 만 들고 있는) 의 링을 다 비웠으면 놓는다
+    void prune_finished_threads(std::vector<std::shared_ptr<ThreadRing>>& rings) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t before = rings_.size();
+        rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](const std::shared_ptr<ThreadRing>& ring) {
+            // use_count 2 = rings_ 와 싱크의 사본
+            return ring.use_count() <= 2 && ring->ring.empty();
+        }), rings_.end());
+        if (rings_.size() != before) {
+            ++rings_generation_;
+            rings = rings_;
+        }
+    }
+
+    static void flush(std::string& buffer, std::FILE* stream) {
+        if (buffer.empty()) {
+            return;
+        }
+        std::fwrite(buffer.data(), 1, buffer.size(), stream);
+        std::fflush(stream);
+        buffer.clear();
+    }
+
+    // 2026-10-14 12:34:56.789012 INFO
+    static void append_prefix(std::string& out, int64_t time_usec, LogLevel level) {
+        std::time_t seconds = static_cast<std::time_t>(time_usec / 1000000);
+        std::tm local{};
+#ifdef _WIN32
+        localtime_s(&local, &seconds);
+#else
+        localtime_r(&seconds, &local);
+#endif
+        char prefix[48];
+        size_t length = std::strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &local);
+        std::snprintf(prefix + length, sizeof(prefix) - length, ".%06d %s ",
+            static_cast<int>(time_usec % 1000000), log_level_name(level));
+        out.append(prefix);
+    }
+
+    static inline std::atomic<uint8_t> level_{ static_cast<uint8_t>(log_level_from_environment()) };
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<std::shared_ptr<ThreadRing>> rings_;
+    uint64_t rings_generation_ = 0;
+    bool stopping_ = false;
+    std::atomic<bool> stopped_{ false };
+    std::atomic<uint64_t> dropped_total_{ 0 };
+    std::thread sink_;  // 마지막에 초기화 (run 이 위 멤버들을 쓴다)
+};
+
+// 한 줄을 스택 버퍼에 만들고, 문장이 끝날 때 (소멸자) 로거에 넘긴다
+class LogLine {
+public:
+    explicit LogLine(LogLevel level) : level_(level) {
+    }
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    ~LogLine() {
+        Logger::instance().submit(level_, text_, length_);
+    }
+
+    LogLine& operator<<(std::string_view value) {
+        append(value.data(), value.size());
+        return *this;
+    }
+
+    LogLine& operator<<(const char* value) {
+        return *this << std::string_view(value);
+    }
+
+    LogLine& operator<<(const std::string& value) {
+        return *this << std::string_view(value);
+    }
+
+    LogLine& operator<<(char value) {
+        append(&value, 1);
+        return *this;
+    }
+
+    LogLine& operator<<(bool value) {
+        return *this << (value ? "true" : "false");
+    }
+
+    LogLine& operator<<(double value) {
+        char digits[32];
+        int length = std::snprintf(digits, sizeof(digits), "%g", value);
+        append(digits, length > 0 ? static_cast<size_t>(length) : 0);
+        return *this;
+    }
+
+    LogLine& operator<<(Redacted) {
+        return *this << "***";
+    }
+
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+    LogLine& operator<<(Integer value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        append(digits, static_cast<size_t>(result.ptr - digits));
+        return *this;
+    }
+
+private:
+    void append(const char* data, size_t size) {
+        size_t room = LOG_LINE_MAX - length_;
+        if (size > room) {
+            std::memcpy(text_ + length_, data, room);
+            length_ = static_cast<uint16_t>(LOG_LINE_MAX);
+            std::memcpy(text_ + LOG_LINE_MAX - 3, "...", 3);
+            return;
+        }
+        std::memcpy(text_ + length_, data, size);
+        length_ = static_cast<uint16_t>(length_ + size);
+    }
+
+    LogLevel level_;
+    uint16_t length_ = 0;
+    char text_[LOG_LINE_MAX];
+};
+
+// if / else 형태라 꺼진 레벨은 << 뒤의 식을 평가하지 않는다
+#define CHAT_LOG(level) if (!Logger::enabled(level)) {} else LogLine(level)
+#define CHAT_LOG_DEBUG if constexpr (CHAT_LOG_MIN_LEVEL > 0) {} else CHAT_LOG(LogLevel::debug)
+#define CHAT_LOG_INFO if constexpr (CHAT_LOG_MIN_LEVEL > 1) {} else CHAT_LOG(LogLevel::info)
+#define CHAT_LOG_WARN if constexpr (CHAT_LOG_MIN_LEVEL > 2) {} else CHAT_LOG(LogLevel::warn)
+#define CHAT_LOG_ERROR CHAT_LOG(LogLevel::error)
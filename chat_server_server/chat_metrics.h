@@ -0,0 +1,292 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// 핫 경로 계측
+// 값은 스레드마다 다른 캐시 라인의 atomic 에 relaxed 로 더하고, 읽을 때 (scrape) 만 합친다
+// 여러 io 스레드가 같은 카운터를 올려도 캐시 라인을 서로 뺏지 않는다
+
+const size_t METRICS_SHARDS = 16;
+
+// 스레드마다 처음 쓸 때 하나씩 돌아가며 배정
+inline size_t metrics_shard() {
+    static std::atomic<size_t> next{ 0 };
+    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS;
+    return shard;
+}
+
+class ShardedCounter {
+public:
+    void add(uint64_t value = 1) {
+        shards_[metrics_shard()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const {
+        uint64_t total = 0;
+        for (const auto& shard : shards_) {
+            total += shard.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{ 0 };
+    };
+    std::array<Shard, METRICS_SHARDS> shards_;
+};
+
+// 올리고 내리는 스레드가 달라도 합은 맞다
+class ShardedGauge {
+public:
+    void add(int64_t value = 1) {
+        shards_[metrics_shard()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+    void sub(int64_t value = 1) { add(-value); }
+
+    int64_t value() const {
+        int64_t total = 0;
+        for (const auto& shard : shards_) {
+            total += shard.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<int64_t> value{ 0 };
+    };
+    std::array<Shard, METRICS_SHARDS> shards_;
+};
+
+// 마이크로초 단위로 기록하는 고정 버킷 히스토그램 (Prometheus histogram 과 같은 경계)
+constexpr uint64_t METRICS_LATENCY_BOUNDS_USEC[] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000
+};
+constexpr size_t METRICS_LATENCY_BUCKETS = sizeof(METRICS_LATENCY_BOUNDS_USEC) / sizeof(METRICS_LATENCY_BOUNDS_USEC[0]);
+
+struct HistogramSnapshot {
+    std::array<uint64_t, METRICS_LATENCY_BUCKETS + 1> buckets{};  // 마지막은 +Inf, 누적 아님
+    uint64_t sum_usec = 0;
+    uint64_t count = 0;
+};
+
+class ShardedHistogram {
+public:
+    void record_usec(uint64_t value) {
+        const uint64_t* bound = std::lower_bound(std::begin(METRICS_LATENCY_BOUNDS_USEC), std::end(METRICS_LATENCY_BOUNDS_USEC), value);
+        Shard& shard = shards_[metrics_shard()];
+        shard.buckets[static_cast<size_t>(bound - std::begin(METRICS_LATENCY_BOUNDS_USEC))].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot result;
+        for (const auto& shard : shards_) {
+            for (size_t i = 0; i < result.buckets.size(); ++i) {
+                uint64_t count = shard.buckets[i].load(std::memory_order_relaxed);
+                result.buckets[i] += count;
+                result.count += count;
+            }
+            result.sum_usec += shard.sum.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, METRICS_LATENCY_BUCKETS + 1> buckets{};
+        std::atomic<uint64_t> sum{ 0 };
+    };
+    std::array<Shard, METRICS_SHARDS> shards_;
+};
+
+// 구간 시간을 재서 히스토그램에 넣는다
+class ScopedLatency {
+public:
+    explicit ScopedLatency(ShardedHistogram& histogram)
+        : histogram_(histogram), started_(std::chrono::steady_clock::now()) {
+    }
+
+    ~ScopedLatency() {
+        histogram_.record_usec(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started_).count()));
+    }
+
+private:
+    ShardedHistogram& histogram_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+// ---- Prometheus 텍스트 형식 ----
+
+inline void write_metric_header(std::string& out, std::string_view name, std::string_view type, std::string_view help) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+// labels 는 비어 있거나 room_id="1" 처럼 중괄호 안의 내용
+template <typename Value>
+inline void write_metric_sample(std::string& out, std::string_view name, std::string_view labels, Value value) {
+    out.append(name);
+    if (!labels.empty()) {
+        out.append("{").append(labels).append("}");
+    }
+    out.append(" ").append(std::to_string(value)).append("\n");
+}
+
+inline void write_histogram(std::string& out, std::string_view name, std::string_view help, const HistogramSnapshot& snapshot) {
+    write_metric_header(out, name, "histogram", help);
+    std::string bucket_name = std::string(name) + "_bucket";
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < METRICS_LATENCY_BUCKETS; ++i) {
+        cumulative += snapshot.buckets[i];
+        double seconds = static_cast<double>(METRICS_LATENCY_BOUNDS_USEC[i]) / 1e6;
+        char label[32];
+        std::snprintf(label, sizeof(label), "le=\"%g\"", seconds);
+        write_metric_sample(out, bucket_name, label, cumulative);
+    }
+    write_metric_sample(out, bucket_name, "le=\"+Inf\"", snapshot.count);
+    write_metric_sample(out, std::string(name) + "_sum", "", static_cast<double>(snapshot.sum_usec) / 1e6);
+    write_metric_sample(out, std::string(name) + "_count", "", snapshot.count);
+}
+
+// 관리용 포트, 요청 경로와 상관없이 GET 하면 render() 결과를 돌려주고 연결을 닫는다
+// 채팅 io 스레드와 같은 io_context 에서 돌지만 scrape 할 때만 일한다
+// 요청을 다 보내지 않고 붙잡고 있는 연결은 ADMIN_TIMEOUT 에 닫고, 동시에 ADMIN_MAX_CONNECTIONS 개까지만 받는다
+// 채팅 포트처럼 SO_REUSEPORT 로 열어서 재시작할 때 새 프로세스가 같은 포트를 잡을 수 있게 하고, 이전 프로세스는 drain 할 때 close 한다
+const size_t ADMIN_MAX_REQUEST = 8 * 1024;
+const std::chrono::seconds ADMIN_TIMEOUT{ 5 };
+const size_t ADMIN_MAX_CONNECTIONS = 16;
+
+class AdminServer {
+public:
+    using Renderer = std::function<std::string()>;
+
+    AdminServer(boost::asio::io_context& io_context, const boost::asio::ip::tcp::endpoint& endpoint, Renderer render)
+        : io_context_(io_context), acceptor_(boost::asio::make_strand(io_context)), render_(std::make_shared<const Renderer>(std::move(render))),
+        connections_(std::make_shared<std::atomic<size_t>>(0)) {
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+        acceptor_.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+        do_accept();
+    }
+
+    // 어느 스레드에서든, 이미 받은 연결은 응답을 마저 보낸다
+    void close() {
+        boost::asio::dispatch(acceptor_.get_executor(), [this]() {
+            boost::system::error_code ignored;
+            acceptor_.close(ignored);
+        });
+    }
+
+private:
+    // 연결 수와 렌더러는 AdminServer 보다 오래 남을 수 있는 연결이 쓰므로 같이 들고 있는다
+    using ConnectionCount = std::shared_ptr<std::atomic<size_t>>;
+    using SharedRenderer = std::shared_ptr<const Renderer>;
+
+    class Connection : public std::enable_shared_from_this<Connection> {
+    public:
+        Connection(boost::asio::ip::tcp::socket socket, SharedRenderer render, ConnectionCount count)
+            : socket_(std::move(socket)), timer_(socket_.get_executor()), render_(std::move(render)), count_(std::move(count)) {
+        }
+
+        ~Connection() {
+            count_->fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        // 응답을 다 보내기 전에 ADMIN_TIMEOUT 이 지나면 닫는다
+        void start() {
+            auto self = shared_from_this();
+            timer_.expires_after(ADMIN_TIMEOUT);
+            timer_.async_wait([this, self](boost::system::error_code ec) {
+                if (!ec) {
+                    boost::system::error_code ignored;
+                    socket_.close(ignored);
+                }
+            });
+            do_read();
+        }
+
+    private:
+        void do_read() {
+            auto self = shared_from_this();
+            socket_.async_read_some(boost::asio::buffer(chunk_), [this, self](boost::system::error_code ec, size_t length) {
+                if (ec) {
+                    return;
+                }
+                request_.append(chunk_.data(), length);
+                if (request_.find("\r\n\r\n") == std::string::npos) {
+                    if (request_.size() < ADMIN_MAX_REQUEST) {
+                        do_read();
+                    }
+                    return;
+                }
+                respond();
+            });
+        }
+
+        void respond() {
+            std::string body = (*render_)();
+            response_ = "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                "Connection: close\r\n\r\n";
+            response_ += body;
+
+            auto self = shared_from_this();
+            boost::asio::async_write(socket_, boost::asio::buffer(response_), [this, self](boost::system::error_code, size_t) {
+                timer_.cancel();
+                boost::system::error_code ignored;
+                socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+            });
+        }
+
+        boost::asio::ip::tcp::socket socket_;
+        boost::asio::steady_timer timer_;
+        SharedRenderer render_;
+        ConnectionCount count_;
+        std::array<char, 1024> chunk_{};
+        std::string request_;
+        std::string response_;
+    };
+
+    void do_accept() {
+        acceptor_.async_accept(boost::asio::make_strand(io_context_), [this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
+            if (!ec) {
+                // 가득 차면 받자마자 닫는다 (socket 이 여기서 사라진다)
+                if (connections_->fetch_add(1, std::memory_order_relaxed) < ADMIN_MAX_CONNECTIONS) {
+                    std::make_shared<Connection>(std::move(socket), render_, connections_)->start();
+                }
+                else {
+                    connections_->fetch_sub(1, std::memory_order_relaxed);
+                }
+            }
+            if (acceptor_.is_open()) {
+                do_accept();
+            }
+        });
+    }
+
+    boost::asio::io_context& io_context_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    SharedRenderer render_;
+    ConnectionCount connections_;
+};
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// 접속이 몰릴 때 전역 할당자 경쟁을 줄이기 위한 재사용 메모리
+
+// 스레드별로 한 번 쓴 블록을 모아 두었다가 다시 내주는 캐시
+// 받은 스레드와 돌려주는 스레드가 달라도 되고, 잠금이 전혀 없다
+const size_t POOL_MAX_CACHED_BLOCKS = 1024;  // 스레드당 크기별로 쌓아 두는 최대 블록 수
+
+template <size_t Size>
+class ThreadBlockCache {
+public:
+    static void* allocate() {
+        FreeList& list = local();
+        if (list.head) {
+            FreeBlock* block = list.head;
+            list.head = block->next;
+            --list.count;
+            return block;
+        }
+        return ::operator new(BLOCK_SIZE);
+    }
+
+    static void deallocate(void* pointer) {
+        FreeList& list = local();
+        if (list.count >= POOL_MAX_CACHED_BLOCKS) {
+            ::operator delete(pointer);
+            return;
+        }
+        FreeBlock* block = static_cast<FreeBlock*>(pointer);
+        block->next = list.head;
+        list.head = block;
+        ++list.count;
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static const size_t BLOCK_SIZE = Size > sizeof(FreeBlock) ? Size : sizeof(FreeBlock);
+
+    struct FreeList {
+        FreeBlock* head = nullptr;
+        size_t count = 0;
+
+        ~FreeList() {
+            while (head) {
+                FreeBlock* next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    };
+
+    static FreeList& local() {
+        thread_local FreeList list;
+        return list;
+    }
+};
+
+// allocate_shared 등에 넘기는 할당자, 한 개짜리 할당은 크기별 스레드 캐시에서 가져온다
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not pooled");
+        if (n == 1) {
+            return static_cast<T*>(ThreadBlockCache<sizeof(T)>::allocate());
+        }
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* pointer, size_t n) noexcept {
+        if (n == 1) {
+            ThreadBlockCache<sizeof(T)>::deallocate(pointer);
+            return;
+        }
+        std::allocator<T>().deallocate(pointer, n);
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+};
+
+// 세션 수신 버퍼용 캐시, 모든 세션이 같은 용량을 쓰므로 스레드별로 한 가지 크기만 모아 둔다
+class BufferCache {
+public:
+    static char* acquire(size_t capacity) {
+        FreeList& list = local();
+        if (list.capacity == capacity && list.head) {
+            FreeBlock* block = list.head;
+            list.head = block->next;
+            --list.count;
+            return reinterpret_cast<char*>(block);
+        }
+        return static_cast<char*>(::operator new(capacity < sizeof(FreeBlock) ? sizeof(FreeBlock) : capacity));
+    }
+
+    static void release(char* buffer, size_t capacity) {
+        FreeList& list = local();
+        if (list.capacity != capacity) {
+            list.clear();
+            list.capacity = capacity;
+        }
+        if (list.count >= POOL_MAX_CACHED_BLOCKS || capacity < sizeof(FreeBlock)) {
+            ::operator delete(buffer);
+            return;
+        }
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(buffer);
+        block->next = list.head;
+        list.head = block;
+        ++list.count;
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct FreeList {
+        size_t capacity = 0;
+        FreeBlock* head = nullptr;
+        size_t count = 0;
+
+        void clear() {
+            while (head) {
+                FreeBlock* next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+            count = 0;
+        }
+
+        ~FreeList() { clear(); }
+    };
+
+    static FreeList& local() {
+        thread_local FreeList list;
+        return list;
+    }
+};
+
+// 비동기 작업 핸들러용 메모리
+// 한 번에 하나만 진행되는 작업(세션의 read, write 등)마다 하나씩 두고 계속 재사용한다
+// 이미 사용 중이거나 크기가 넘치면 일반 할당으로 넘어간다
+const size_t HANDLER_MEMORY_SIZE = 512;
+
+class HandlerMemory {
+public:
+    HandlerMemory() = default;
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(size_t size) {
+        if (!in_use_ && size <= sizeof(storage_)) {
+            in_use_ = true;
+            return &storage_;
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void* pointer) {
+        if (pointer == &storage_) {
+            in_use_ = false;
+            return;
+        }
+        ::operator delete(pointer);
+    }
+
+private:
+    typename std::aligned_storage<HANDLER_MEMORY_SIZE, alignof(std::max_align_t)>::type storage_;
+    bool in_use_ = false;
+};
+
+template <typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) noexcept : memory_(&memory) {}
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory_(other.memory_) {}
+
+    T* allocate(size_t n) const {
+        return static_cast<T*>(memory_->allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* pointer, size_t /*n*/) const {
+        memory_->deallocate(pointer);
+    }
+
+    template <typename U>
+    bool operator==(const HandlerAllocator<U>& other) const noexcept { return memory_ == other.memory_; }
+
+    template <typename U>
+    bool operator!=(const HandlerAllocator<U>& other) const noexcept { return memory_ != other.memory_; }
+
+private:
+    template <typename> friend class HandlerAllocator;
+    HandlerMemory* memory_;
+};
+
+// asio 가 associated_allocator 로 찾아 쓰는 allocator_type 을 달아 주는 핸들러 래퍼
+// (boost::asio::bind_allocator 과 같은 역할)
+template <typename Handler>
+class CustomAllocHandler {
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    CustomAllocHandler(HandlerMemory& memory, Handler handler)
+        : memory_(memory), handler_(std::move(handler)) {
+    }
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type(memory_);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory& memory_;
+    Handler handler_;
+};
+
+template <typename Handler>
+inline CustomAllocHandler<typename std::decay<Handler>::type> make_custom_alloc_handler(HandlerMemory& memory, Handler&& handler) {
+    return CustomAllocHandler<typename std::decay<Handler>::type>(memory, std::forward<Handler>(handler));
+}
@@ -0,0 +1,658 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// 메시지 프로토콜
+//
+// 텍스트 (기존 클라이언트)
+//   접속 후 첫 줄: room_id,user_id
+//   이후: 함수명?변수명1:데이터1/변수명2:데이터2  또는 일반 채팅 문자열, 줄바꿈으로 구분
+//
+// 바이너리
+//   접속 직후 첫 바이트로 BINARY_PROTOCOL_MAGIC 을 보내면 바이너리 모드로 전환
+//   프레임: [opcode 1B][flags 1B][payload 길이 2B, big endian][payload]
+//   payload 필드는 opcode 별로 정해진 순서대로 나열된다
+//     정수: unsigned LEB128 varint
+//     문자열: varint 길이 + 바이트
+//   첫 프레임은 hello (room_id, user_id[, codecs])
+//
+// 압축: hello / resume 끝에 붙인 codecs 비트 중 서버도 지원하는 것이 있으면, 서버 → 클라이언트 프레임 중 큰 것은
+//   flags 에 FRAME_FLAG_COMPRESSED 를 세우고 payload 를 압축해서 보낸다 (형식은 chat_compress.h)
+//   클라이언트 → 서버 프레임은 압축하지 않는다, 텍스트 클라이언트와 codecs 를 보내지 않은 클라이언트는 항상 그대로 받는다
+//
+// 기록 조회 (fetch_history) 응답은 한 번에 묶어서 보낸다
+//   텍스트: history?room_id:1/count:2 줄 뒤에 talk?id:../user_id:../published:../text:.. 줄이 count 개
+//   바이너리: history_result 프레임 하나
+//   before_id 가 0 이면 가장 최근부터, 결과는 최신순
+//
+// 검색 (search_text) 은 room_id 방에서 query 의 낱말 (각각 접두어) 이 모두 들어 있는 메시지를 관련도 순으로 돌려준다
+//   텍스트: search_text?room_id:1/query:hello world/offset:0/limit:20
+//           응답은 search?room_id:1/offset:0/count:2 줄 뒤에 기록 조회와 같은 talk? 줄이 count 개
+//   바이너리: search_result 프레임 하나, 다음 쪽은 offset 에 받은 수를 더해서 다시 요청한다
+//   검색하지 못했으면 (검색어가 비었거나 서버가 바쁨) count 가 0 인 응답이 간다
+//
+// 읽음 표시: mark_read?room_id:1/last_read_id:0  (0 이면 지금까지 받은 메시지 전부, 응답 없음)
+//   안 읽은 수는 unread_summary? 한 번으로 읽음 표시가 있는 모든 방을 받는다 (방마다 기록을 조회하지 않는다)
+//   둘 다 login_user 로 로그인한 세션만, 아니면 mark_read 는 무시하고 unread_summary 는 빈 목록
+//   텍스트: unread?count:2 줄 뒤에 room?room_id:1/last_read_id:123/unread:5 줄이 count 개
+//   바이너리: unread_result 프레임 하나, unread 는 1000 에서 멈춘다 (chat_receipts.h)
+//
+// 서버가 한 사람에게만 보내는 알림은 텍스트 클라이언트에 명령과 같은 형식의 한 줄로 간다
+//   direct?user_id:1/text:..  (send_direct 로 받은 귓속말)
+//   invite?room_id:3/user_id:1  (invite_user 로 받은 초대)
+//   auth?status:0/user_id:7  (create_user / login_user 결과, status 는 chat_auth.h 의 AuthStatus)
+//   성공하면 그 user_id 가 세션에 묶인다, 이후 채팅 / 귓속말 / 초대의 보낸 사람은 명령의 user_id 가 아니라 세션의 user_id
+//   login_user / create_user 는 핸드셰이크 전에도 보낼 수 있고, 결과가 올 때까지 서버는 다음 줄 / 프레임을 읽지 않는다
+//   서버가 require_auth 로 뜨면 핸드셰이크 (hello / room_id,user_id) 의 user_id 가 로그인한 것과 같아야 하고, 아니면 연결을 닫는다
+//   귓속말 / 초대를 받을 사람이 접속해 있지 않으면 서버에 남겼다가, 그 user_id 로 로그인해서 입장했을 때 한 번에 보낸다
+//   (입장한 뒤에 로그인하면 그때, 로그인으로 돌아온 재접속 토큰이면 resume 때)
+//     텍스트: inbox?count:2 줄 뒤에 direct?user_id:1/published:../text:.. 또는 invite?room_id:3/user_id:1/published:.. 줄이 count 개
+//     바이너리: deliver_inbox 프레임 (한 프레임에 다 들어가지 않으면 여러 개), 오래된 것부터
+//
+// 입장 / 퇴장은 방마다 잠깐 모아서 한 줄 (바이너리는 deliver_presence 프레임 하나) 로 보낸다
+//   presence?room_id:1/joined:12/left:3/joined_ids:4,5,6/left_ids:2
+//   수는 정확하고, id 목록은 앞에서부터 일부만 실릴 수 있다, 아주 큰 방은 보내지 않는다
+//   들어온 본인은 기존 클라이언트처럼 입장 직후 "A new user has joined the chat." 를 따로 받는다
+//
+// 재접속: 서버가 내려가기 전에 (drain) 세션마다 resume?token:.. 한 줄 (바이너리는 resume_token 프레임) 을 보내고 연결을 닫는다
+//   다음 접속의 첫 줄로 resume?token:.. (바이너리는 hello 대신 resume 프레임) 을 보내면
+//   같은 방 / 유저로 입장하고 최근 메시지 재전송은 건너뛴다, 토큰이 틀렸거나 만료됐으면 연결을 닫는다 (형식은 chat_resume.h)
+//
+// heartbeat: 한동안 아무것도 받지 못하면 서버가 ping 을 보내고, 클라이언트는 pong 으로 답해야 한다
+//   텍스트는 ping? / pong? 한 줄, 바이너리는 payload 없는 ping / pong 프레임
+//   클라이언트가 ping 을 보내도 서버가 pong 으로 답한다
+//   텍스트 세션은 ping? / pong? 을 한 번이라도 보낸 뒤부터만 서버가 ping 을 보내고 답이 없으면 끊는다 (바이너리는 처음부터)
+
+// 입장이 끝나면 들어온 본인에게 오는 메시지 (텍스트 / 바이너리 모두 deliver_text)
+constexpr std::string_view JOIN_NOTICE = "A new user has joined the chat.";
+
+// 접속 직후 첫 바이트가 이 값이면 바이너리 프로토콜 (텍스트 핸드셰이크는 숫자로 시작)
+const uint8_t BINARY_PROTOCOL_MAGIC = 0xC5;
+const size_t BINARY_HEADER_SIZE = 4;
+const size_t BINARY_MAX_PAYLOAD = 0xFFFF;
+const uint8_t FRAME_FLAG_COMPRESSED = 0x01;
+
+enum class CommandType : uint8_t {
+    unknown = 0,
+    hello = 1,          // room_id, user_id[, codecs] (바이너리 핸드셰이크)
+    create_user = 2,    // id, password
+    login_user = 3,     // id, password
+    create_room = 4,    // title
+    join_room = 5,      // room_id
+    send_text = 6,      // room_id, user_id, text
+    exit_room = 7,      // room_id, user_id
+    kick_user = 8,      // room_id, user_id, target_user_id
+    grant_host = 9,     // room_id, user_id, target_user_id
+    invite_user = 10,   // room_id, user_id, target_user_id
+    fetch_history = 11, // room_id, before_id, limit
+    send_direct = 12,   // user_id, target_user_id, text
+    ping = 13,          // (없음) 어느 쪽이든 보낼 수 있고, 받은 쪽은 pong 으로 답한다
+    pong = 14,          // (없음)
+    resume = 15,        // token[, codecs] (hello 대신 보내는 재접속 핸드셰이크)
+    search_text = 16,   // room_id, offset, limit, query
+    mark_read = 17,     // room_id, last_read_id
+    unread_summary = 18, // (없음)
+
+    // 서버 → 클라이언트
+    deliver_text = 0x80,    // text (payload 전체)
+    history_result = 0x81,  // room_id, count, (id, user_id, published, text) * count
+    deliver_direct = 0x82,  // user_id (보낸 사람), text
+    deliver_invite = 0x83,  // room_id, user_id (초대한 사람)
+    auth_result = 0x84,     // status, user_id (성공했을 때만 0 이 아님)
+    deliver_presence = 0x85, // room_id, joined, left, n, user_id * n (입장), m, user_id * m (퇴장)
+    resume_token = 0x86,    // token (서버가 내려가기 전에 보낸다)
+    search_result = 0x87,   // room_id, offset, count, (id, user_id, published, text) * count
+    unread_result = 0x88,   // count, (room_id, last_read_id, unread) * count
+    deliver_inbox = 0x89    // count, (kind, user_id, room_id, published, text) * count, kind 는 deliver_direct / deliver_invite
+};
+
+// 텍스트 / 바이너리 어느 쪽에서 왔든 디스패처가 받는 형태
+// 문자열 필드는 수신 버퍼를 가리키므로 명령을 처리하는 동안에만 유효하다
+struct ChatCommand {
+    CommandType type = CommandType::unknown;
+    int room_id = 0;
+    int user_id = 0;
+    int target_user_id = 0;
+    int64_t before_id = 0;
+    int64_t last_read_id = 0;
+    int offset = 0;
+    int limit = 0;
+    std::string_view id;
+    std::string_view password;
+    std::string_view title;
+    std::string_view text;      // send_text / send_direct 본문, search_text 검색어
+    std::string_view token;
+    uint64_t codecs = 0;    // 클라이언트가 풀 수 있는 압축 (chat_compress.h 의 CODEC_*)
+};
+
+// 수신 버퍼 위에서 바로 필드를 읽는 바이너리 payload 리더 (할당 없음)
+class BinaryReader {
+public:
+    BinaryReader(const uint8_t* data, size_t size) : pos_(data), end_(data + size) {}
+
+    bool read_varint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos_ == end_) {
+                return false;
+            }
+            uint8_t byte = *pos_++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool read_int(int& value) {
+        uint64_t raw;
+        if (!read_varint(raw) || raw > static_cast<uint64_t>(INT32_MAX)) {
+            return false;
+        }
+        value = static_cast<int>(raw);
+        return true;
+    }
+
+    bool read_int(int64_t& value) {
+        uint64_t raw;
+        if (!read_varint(raw) || raw > static_cast<uint64_t>(INT64_MAX)) {
+            return false;
+        }
+        value = static_cast<int64_t>(raw);
+        return true;
+    }
+
+    bool read_string(std::string_view& value) {
+        uint64_t length;
+        if (!read_varint(length) || length > static_cast<uint64_t>(end_ - pos_)) {
+            return false;
+        }
+        value = std::string_view(reinterpret_cast<const char*>(pos_), static_cast<size_t>(length));
+        pos_ += length;
+        return true;
+    }
+
+    bool at_end() const { return pos_ == end_; }
+
+    // 아직 읽지 않은 나머지
+    std::string_view rest() const {
+        return std::string_view(reinterpret_cast<const char*>(pos_), static_cast<size_t>(end_ - pos_));
+    }
+
+private:
+    const uint8_t* pos_;
+    const uint8_t* end_;
+};
+
+// 바이너리 payload 를 이어 붙이는 쓰기 도우미
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::string& out) : out_(out) {}
+
+    void write_varint(uint64_t value) {
+        while (value >= 0x80) {
+            out_.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out_.push_back(static_cast<char>(value));
+    }
+
+    void write_string(std::string_view value) {
+        write_varint(value.size());
+        out_.append(value.data(), value.size());
+    }
+
+private:
+    std::string& out_;
+};
+
+inline void encode_frame_header(uint8_t* out, CommandType type, size_t payload_size, uint8_t flags = 0) {
+    out[0] = static_cast<uint8_t>(type);
+    out[1] = flags;
+    out[2] = static_cast<uint8_t>((payload_size >> 8) & 0xFF);
+    out[3] = static_cast<uint8_t>(payload_size & 0xFF);
+}
+
+// 헤더가 다 들어와 있으면 opcode 와 payload 길이를 채우고 true
+inline bool decode_frame_header(const uint8_t* data, size_t size, CommandType& type, size_t& payload_size) {
+    if (size < BINARY_HEADER_SIZE) {
+        return false;
+    }
+    type = static_cast<CommandType>(data[0]);
+    payload_size = (static_cast<size_t>(data[2]) << 8) | data[3];
+    return true;
+}
+
+inline bool decode_frame_header(const uint8_t* data, size_t size, CommandType& type, size_t& payload_size, uint8_t& flags) {
+    if (!decode_frame_header(data, size, type, payload_size)) {
+        return false;
+    }
+    flags = data[1];
+    return true;
+}
+
+// payload 를 opcode 에 맞는 필드로 해석, 형식이 맞지 않으면 false
+inline bool decode_binary_command(CommandType type, const uint8_t* payload, size_t size, ChatCommand& command) {
+    BinaryReader reader(payload, size);
+    command = ChatCommand();
+    command.type = type;
+
+    bool ok = false;
+    switch (type) {
+    case CommandType::hello:
+        ok = reader.read_int(command.room_id) && reader.read_int(command.user_id)
+            && (reader.at_end() || reader.read_varint(command.codecs));
+        break;
+    case CommandType::create_user:
+    case CommandType::login_user:
+        ok = reader.read_string(command.id) && reader.read_string(command.password);
+        break;
+    case CommandType::create_room:
+        ok = reader.read_string(command.title);
+        break;
+    case CommandType::join_room:
+        ok = reader.read_int(command.room_id);
+        break;
+    case CommandType::send_text:
+        ok = reader.read_int(command.room_id) && reader.read_int(command.user_id)
+            && reader.read_string(command.text);
+        break;
+    case CommandType::exit_room:
+        ok = reader.read_int(command.room_id) && reader.read_int(command.user_id);
+        break;
+    case CommandType::kick_user:
+    case CommandType::grant_host:
+    case CommandType::invite_user:
+        ok = reader.read_int(command.room_id) && reader.read_int(command.user_id)
+            && reader.read_int(command.target_user_id);
+        break;
+    case CommandType::fetch_history:
+        ok = reader.read_int(command.room_id) && reader.read_int(command.before_id)
+            && reader.read_int(command.limit);
+        break;
+    case CommandType::send_direct:
+        ok = reader.read_int(command.user_id) && reader.read_int(command.target_user_id)
+            && reader.read_string(command.text);
+        break;
+    case CommandType::ping:
+    case CommandType::pong:
+        ok = true;
+        break;
+    case CommandType::resume:
+        ok = reader.read_string(command.token)
+            && (reader.at_end() || reader.read_varint(command.codecs));
+        break;
+    case CommandType::search_text:
+        ok = reader.read_int(command.room_id) && reader.read_int(command.offset)
+            && reader.read_int(command.limit) && reader.read_string(command.text);
+        break;
+    case CommandType::mark_read:
+        ok = reader.read_int(command.room_id) && reader.read_int(command.last_read_id);
+        break;
+    case CommandType::unread_summary:
+        ok = true;
+        break;
+    default:
+        break;
+    }
+    return ok && reader.at_end();
+}
+
+// ---- 텍스트 프로토콜 ----
+
+// 정수 필드 해석, 예외 없이 실패하면 false
+template <typename Integer>
+inline bool parse_int(std::string_view text, Integer& value) {
+    const char* first = text.data();
+    const char* last = text.data() + text.size();
+    auto result = std::from_chars(first, last, value);
+    return result.ec == std::errc() && result.ptr == last && first != last;
+}
+
+// "변수명:데이터" 쌍들, 수신 버퍼를 가리키는 고정 크기 배열 (할당 없음)
+const size_t TEXT_MAX_PARAMS = 8;
+
+class TextParams {
+public:
+    bool add(std::string_view key, std::string_view value) {
+        if (count_ == params_.size()) {
+            return false;
+        }
+        params_[count_++] = { key, value };
+        return true;
+    }
+
+    // 없는 변수는 빈 문자열
+    std::string_view get(std::string_view key) const {
+        for (size_t i = 0; i < count_; ++i) {
+            if (params_[i].key == key) {
+                return params_[i].value;
+            }
+        }
+        return {};
+    }
+
+    template <typename Integer>
+    bool get_int(std::string_view key, Integer& value) const {
+        return parse_int(get(key), value);
+    }
+
+    size_t size() const { return count_; }
+
+private:
+    struct Param {
+        std::string_view key;
+        std::string_view value;
+    };
+
+    std::array<Param, TEXT_MAX_PARAMS> params_{};
+    size_t count_ = 0;
+};
+
+// "함수명?변수명1:데이터1/변수명2:데이터2" 를 나눈다
+// '?' 가 없으면 명령이 아님, 변수가 TEXT_MAX_PARAMS 보다 많으면 실패
+inline bool split_text_command(std::string_view line, std::string_view& name, TextParams& params) {
+    size_t delimiter_pos = line.find('?');
+    if (delimiter_pos == std::string_view::npos || delimiter_pos == 0) {
+        return false;
+    }
+    name = line.substr(0, delimiter_pos);
+
+    std::string_view rest = line.substr(delimiter_pos + 1);
+    while (!rest.empty()) {
+        size_t end = rest.find('/');
+        std::string_view pair = rest.substr(0, end);
+        size_t sep = pair.find(':');
+        if (sep != std::string_view::npos && !params.add(pair.substr(0, sep), pair.substr(sep + 1))) {
+            return false;
+        }
+        if (end == std::string_view::npos) {
+            break;
+        }
+        rest.remove_prefix(end + 1);
+    }
+    return true;
+}
+
+// 명령 이름 → CommandType
+// 컴파일 타임에 충돌 없는 seed 를 찾아서 만든 완전 해시 테이블, 조회는 해시 한 번과 비교 한 번
+struct TextCommandName {
+    std::string_view name;
+    CommandType type;
+};
+
+constexpr TextCommandName TEXT_COMMANDS[] = {
+    { "create_user", CommandType::create_user },
+    { "login_user", CommandType::login_user },
+    { "create_room", CommandType::create_room },
+    { "join_room", CommandType::join_room },
+    { "send_text", CommandType::send_text },
+    { "exit_room", CommandType::exit_room },
+    { "kick_user", CommandType::kick_user },
+    { "grant_host", CommandType::grant_host },
+    { "invite_user", CommandType::invite_user },
+    { "fetch_history", CommandType::fetch_history },
+    { "send_direct", CommandType::send_direct },
+    { "ping", CommandType::ping },
+    { "pong", CommandType::pong },
+    { "resume", CommandType::resume },
+    { "search_text", CommandType::search_text },
+    { "mark_read", CommandType::mark_read },
+    { "unread_summary", CommandType::unread_summary },
+};
+
+const size_t TEXT_COMMAND_TABLE_SIZE = 128;  // 2의 거듭제곱, 명령 수의 여덟 배쯤이어야 seed 를 금방 찾는다
+const uint32_t TEXT_COMMAND_SEED_LIMIT = 4096;  // 이 안에서 못 찾으면 컴파일 오류 (명령을 늘렸으면 테이블을 키운다)
+
+constexpr uint32_t text_command_hash(std::string_view name, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;  // FNV-1a
+    for (char c : name) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash & (TEXT_COMMAND_TABLE_SIZE - 1);
+}
+
+constexpr bool text_command_seed_is_perfect(uint32_t seed) {
+    bool used[TEXT_COMMAND_TABLE_SIZE] = {};
+    for (const auto& command : TEXT_COMMANDS) {
+        uint32_t slot = text_command_hash(command.name, seed);
+        if (used[slot]) {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t find_text_command_seed() {
+    for (uint32_t seed = 0; seed < TEXT_COMMAND_SEED_LIMIT; ++seed) {
+        if (text_command_seed_is_perfect(seed)) {
+            return seed;
+        }
+    }
+    return TEXT_COMMAND_SEED_LIMIT;
+}
+
+constexpr uint32_t TEXT_COMMAND_SEED = find_text_command_seed();
+static_assert(TEXT_COMMAND_SEED < TEXT_COMMAND_SEED_LIMIT, "no collision-free seed for the text command table, grow TEXT_COMMAND_TABLE_SIZE");
+
+constexpr std::array<TextCommandName, TEXT_COMMAND_TABLE_SIZE> build_text_command_table() {
+    std::array<TextCommandName, TEXT_COMMAND_TABLE_SIZE> table{};
+    for (const auto& command : TEXT_COMMANDS) {
+        table[text_command_hash(command.name, TEXT_COMMAND_SEED)] = command;
+    }
+    return table;
+}
+
+constexpr std::array<TextCommandName, TEXT_COMMAND_TABLE_SIZE> TEXT_COMMAND_TABLE = build_text_command_table();
+
+constexpr CommandType lookup_text_command(std::string_view name) {
+    const TextCommandName& entry = TEXT_COMMAND_TABLE[text_command_hash(name, TEXT_COMMAND_SEED)];
+    return entry.name == name ? entry.type : CommandType::unknown;
+}
+
+static_assert(lookup_text_command("send_text") == CommandType::send_text, "text command table is broken");
+static_assert(lookup_text_command("send_texts") == CommandType::unknown, "text command table is broken");
+
+// 변수들을 type 에 맞는 필드로 옮긴다, 정수 필드가 없거나 숫자가 아니면 false
+inline bool build_text_command(CommandType type, const TextParams& params, ChatCommand& command) {
+    command = ChatCommand();
+    command.type = type;
+
+    switch (type) {
+    case CommandType::create_user:
+    case CommandType::login_user:
+        command.id = params.get("id");
+        command.password = params.get("password");
+        return true;
+    case CommandType::create_room:
+        command.title = params.get("title");
+        return true;
+    case CommandType::join_room:
+        return params.get_int("room_id", command.room_id);
+    case CommandType::send_text:
+        command.text = params.get("text");
+        return params.get_int("room_id", command.room_id) && params.get_int("user_id", command.user_id);
+    case CommandType::exit_room:
+        return params.get_int("room_id", command.room_id) && params.get_int("user_id", command.user_id);
+    case CommandType::kick_user:
+    case CommandType::grant_host:
+    case CommandType::invite_user:
+        return params.get_int("room_id", command.room_id) && params.get_int("user_id", command.user_id)
+            && params.get_int("target_user_id", command.target_user_id);
+    case CommandType::fetch_history:
+        return params.get_int("room_id", command.room_id) && params.get_int("before_id", command.before_id)
+            && params.get_int("limit", command.limit);
+    case CommandType::send_direct:
+        command.text = params.get("text");
+        return params.get_int("user_id", command.user_id) && params.get_int("target_user_id", command.target_user_id);
+    case CommandType::ping:
+    case CommandType::pong:
+        return true;
+    case CommandType::resume:
+        command.token = params.get("token");
+        return !command.token.empty();
+    case CommandType::search_text:
+        command.text = params.get("query");
+        return params.get_int("room_id", command.room_id) && params.get_int("offset", command.offset)
+            && params.get_int("limit", command.limit);
+    case CommandType::mark_read:
+        return params.get_int("room_id", command.room_id) && params.get_int("last_read_id", command.last_read_id);
+    case CommandType::unread_summary:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// ---- 클라이언트 쪽 인코딩 (chat_client.h, chat_bench) ----
+
+constexpr std::string_view text_command_name(CommandType type) {
+    for (const auto& command : TEXT_COMMANDS) {
+        if (command.type == type) {
+            return command.name;
+        }
+    }
+    return {};
+}
+
+// 명령의 필드를 decode_binary_command / build_text_command 가 읽는 순서대로 field(이름, 값) 으로 넘긴다
+// 값은 uint64_t 또는 std::string_view, 클라이언트가 보낼 수 없는 type 이면 false
+template <typename Field>
+inline bool visit_command_fields(const ChatCommand& command, Field&& field) {
+    auto number = [&](std::string_view name, int64_t value) {
+        field(name, static_cast<uint64_t>(value));
+    };
+    switch (command.type) {
+    case CommandType::hello:
+        number("room_id", command.room_id);
+        number("user_id", command.user_id);
+        if (command.codecs != 0) {
+            field("codecs", command.codecs);
+        }
+        return true;
+    case CommandType::create_user:
+    case CommandType::login_user:
+        field("id", command.id);
+        field("password", command.password);
+        return true;
+    case CommandType::create_room:
+        field("title", command.title);
+        return true;
+    case CommandType::join_room:
+        number("room_id", command.room_id);
+        return true;
+    case CommandType::send_text:
+        number("room_id", command.room_id);
+        number("user_id", command.user_id);
+        field("text", command.text);
+        return true;
+    case CommandType::exit_room:
+        number("room_id", command.room_id);
+        number("user_id", command.user_id);
+        return true;
+    case CommandType::kick_user:
+    case CommandType::grant_host:
+    case CommandType::invite_user:
+        number("room_id", command.room_id);
+        number("user_id", command.user_id);
+        number("target_user_id", command.target_user_id);
+        return true;
+    case CommandType::fetch_history:
+        number("room_id", command.room_id);
+        number("before_id", command.before_id);
+        number("limit", command.limit);
+        return true;
+    case CommandType::send_direct:
+        number("user_id", command.user_id);
+        number("target_user_id", command.target_user_id);
+        field("text", command.text);
+        return true;
+    case CommandType::ping:
+    case CommandType::pong:
+    case CommandType::unread_summary:
+        return true;
+    case CommandType::resume:
+        field("token", command.token);
+        if (command.codecs != 0) {
+            field("codecs", command.codecs);
+        }
+        return true;
+    case CommandType::search_text:
+        number("room_id", command.room_id);
+        number("offset", command.offset);
+        number("limit", command.limit);
+        field("query", command.text);
+        return true;
+    case CommandType::mark_read:
+        number("room_id", command.room_id);
+        number("last_read_id", command.last_read_id);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 명령 하나를 out 뒤에 붙인다, 텍스트는 줄바꿈까지 한 줄, 바이너리는 프레임 하나
+// 텍스트 핸드셰이크 (hello) 는 "room_id,user_id" 줄이고, 바이너리 핸드셰이크 앞의 BINARY_PROTOCOL_MAGIC 은 붙이지 않는다
+// 텍스트의 문자열 값은 그대로 들어가므로 '/' 가 있으면 서버에서 그 앞까지만 읽힌다 (그래서 본문 필드가 항상 마지막)
+// 보낼 수 없는 type, 프레임 한도를 넘는 payload, 텍스트 값에 줄바꿈이 있으면 false 이고 out 은 그대로
+inline bool encode_command(bool binary, const ChatCommand& command, std::string& out) {
+    size_t start = out.size();
+    bool ok = false;
+    if (binary) {
+        out.append(BINARY_HEADER_SIZE, '\0');
+        BinaryWriter writer(out);
+        ok = visit_command_fields(command, [&](std::string_view, auto value) {
+            if constexpr (std::is_same_v<decltype(value), std::string_view>) {
+                writer.write_string(value);
+            }
+            else {
+                writer.write_varint(value);
+            }
+        });
+        size_t payload_size = out.size() - start - BINARY_HEADER_SIZE;
+        if (ok && payload_size <= BINARY_MAX_PAYLOAD) {
+            encode_frame_header(reinterpret_cast<uint8_t*>(&out[start]), command.type, payload_size);
+            return true;
+        }
+    }
+    else if (command.type == CommandType::hello) {
+        out += std::to_string(command.room_id) + ',' + std::to_string(command.user_id) + '\n';
+        return true;
+    }
+    else {
+        std::string_view name = text_command_name(command.type);
+        out.append(name.data(), name.size());
+        out += '?';
+        bool first = true;
+        ok = !name.empty() && visit_command_fields(command, [&](std::string_view key, auto value) {
+            if (!first) {
+                out += '/';
+            }
+            first = false;
+            out.append(key.data(), key.size());
+            out += ':';
+            if constexpr (std::is_same_v<decltype(value), std::string_view>) {
+                out.append(value.data(), value.size());
+            }
+            else {
+                out += std::to_string(value);
+            }
+        });
+        if (ok && out.find('\n', start) == std::string::npos) {
+            out += '\n';
+            return true;
+        }
+    }
+    out.resize(start);
+    return false;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// 여러 생산자 / 단일 소비자 무잠금 큐 (Vyukov intrusive MPSC)
+// push 는 어느 스레드에서든 호출할 수 있고, pop 은 소비자 스레드 하나에서만 호출해야 한다
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head_(&stub_), tail_(&stub_) {}
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue() {
+        T discarded;
+        while (pop(discarded)) {
+        }
+        if (tail_ != &stub_) {
+            delete tail_;
+        }
+    }
+
+    void push(T value) {
+        Node* node = new Node;
+        node->value = std::move(value);
+        Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // 생산자가 막 연결 중인 노드는 아직 보이지 않을 수 있다 (다음 pop 에서 나온다)
+    bool pop(T& out) {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        out = std::move(next->value);
+        tail_ = next;
+        if (tail != &stub_) {
+            delete tail;
+        }
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next{ nullptr };
+        T value{};
+    };
+
+    Node stub_;
+    std::atomic<Node*> head_;  // 생산자들이 붙이는 쪽
+    Node* tail_;               // 소비자만 접근
+};
+
+// 단일 생산자 / 단일 소비자 고정 크기 링 버퍼
+// 가득 차면 push 가 false 를 돌려줄 뿐 기다리지 않는다, Capacity 는 2의 거듭제곱
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscRing() = default;
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // 생산자 스레드에서만, fill(slot) 로 자리에 직접 쓴다
+    template <typename Fill>
+    bool push(Fill&& fill) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        fill(slots_[head & (Capacity - 1)]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 소비자 스레드에서만, 지금 보이는 항목을 모두 consume(slot) 에 넘기고 개수를 돌려준다
+    template <typename Consume>
+    size_t drain(Consume&& consume) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        for (size_t i = tail; i != head; ++i) {
+            consume(slots_[i & (Capacity - 1)]);
+        }
+        tail_.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+private:
+    alignas(64) std::atomic<size_t> head_{ 0 };  // 생산자가 쓰는 쪽
+    alignas(64) std::atomic<size_t> tail_{ 0 };  // 소비자가 읽는 쪽
+    T slots_[Capacity];
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// 토큰 버킷
+// 초당 rate 개씩 채워지고 최대 burst 개까지 모인다, rate 가 0 이하면 제한 없음
+// 잠금이 없으므로 한 strand 안에서만 쓴다
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TokenBucket(double rate, double burst, Clock::time_point now = Clock::now())
+        : rate_(rate), burst_(burst), tokens_(burst), updated_(now) {
+    }
+
+    bool try_acquire(Clock::time_point now, double cost = 1.0) {
+        if (rate_ <= 0) {
+            return true;
+        }
+        refill(now);
+        if (tokens_ < cost) {
+            return false;
+        }
+        tokens_ -= cost;
+        return true;
+    }
+
+    // cost 만큼 모일 때까지 남은 시간, 이미 있으면 0
+    Clock::duration time_until(Clock::time_point now, double cost = 1.0) {
+        refill(now);
+        if (tokens_ >= cost || rate_ <= 0) {
+            return Clock::duration::zero();
+        }
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((cost - tokens_) / rate_));
+    }
+
+private:
+    void refill(Clock::time_point now) {
+        if (now <= updated_) {
+            return;
+        }
+        double elapsed = std::chrono::duration<double>(now - updated_).count();
+        tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+        updated_ = now;
+    }
+
+    double rate_;
+    double burst_;
+    double tokens_;
+    Clock::time_point updated_;
+};
+
+// 여러 strand 가 같이 쓰는 제한기 (GCRA)
+// 다음 요청이 허용되는 이론상 도착 시각 (TAT) 하나만 atomic 으로 두고, 통과할 때만 CAS 로 밀어 준다
+// 거절은 읽기 한 번으로 끝나므로 폭주하는 쪽을 걸러 낼 때 캐시 라인을 서로 뺏지 않는다
+class SharedRateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    SharedRateLimiter(double rate, double burst)
+        : interval_(rate > 0 ? static_cast<int64_t>(1e9 / rate) : 0),
+        tolerance_(static_cast<int64_t>(static_cast<double>(interval_) * std::max(burst, 1.0))) {
+    }
+
+    bool try_acquire(Clock::time_point now, double cost = 1.0) {
+        if (interval_ == 0) {
+            return true;
+        }
+        int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+        int64_t increment = static_cast<int64_t>(static_cast<double>(interval_) * cost);
+        int64_t tat = tat_.load(std::memory_order_relaxed);
+        for (;;) {
+            int64_t next = std::max(tat, now_ns) + increment;
+            if (next - now_ns > tolerance_) {
+                return false;
+            }
+            if (tat_.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    // cost 만큼 통과할 수 있을 때까지 남은 시간, 지금 되면 0
+    Clock::duration time_until(Clock::time_point now, double cost = 1.0) const {
+        if (interval_ == 0) {
+            return Clock::duration::zero();
+        }
+        int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+        int64_t increment = static_cast<int64_t>(static_cast<double>(interval_) * cost);
+        int64_t wait = std::max(tat_.load(std::memory_order_relaxed), now_ns) + increment - now_ns - tolerance_;
+        return wait > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(wait)) : Clock::duration::zero();
+    }
+
+private:
+    const int64_t interval_;   // 토큰 하나가 채워지는 시간 (ns), 0 이면 제한 없음
+    const int64_t tolerance_;  // burst 만큼 앞당겨 쓸 수 있는 시간
+    std::atomic<int64_t> tat_{ 0 };
+};
@@ -0,0 +1,579 @@
+#pragma once
+
+#include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "chat_archive.h"
+#include "chat_db.h"
+#include "chat_log.h"
+#include "chat_metrics.h"
+
+// 읽음 표시와 안 읽은 메시지 수
+// 유저마다 방별로 어디까지 읽었는지 (last_read_id) 를 read_receipts 에 남긴다
+// 방마다 이번 실행에서 커밋된 메시지 수 (순번) 를 세고, 읽음 표시에는 읽었을 때의 순번을 적어 둔다
+// 안 읽은 수는 두 순번의 차이라서 커밋 콜백은 읽는 사람 수와 상관없이 메시지마다 O(1) 이고, 접속한 클라이언트는
+// 방마다 기록을 조회하지 않고 unread_summary 한 번으로 모든 방의 수를 받는다
+// DB 에서 세는 것은 이번 실행에서 처음 보는 (유저, 방) 이나 중간까지만 읽은 경우뿐이고, UNREAD_COUNT_MAX 에서 멈춘다
+// mark_read 는 메모리만 바꾸고, 바뀐 행은 flush_interval 마다 한 트랜잭션으로 모아서 기록한다
+// 기록이 끝난 뒤 RECEIPT_IDLE_EVICT 동안 쓰지 않은 유저의 읽음 표시는 메모리에서 내린다 (다음에 DB 에서 다시 읽는다)
+// DB 는 읽음 표시 스레드에서만, mutex_ 를 놓고 읽는다 (커밋 콜백과 mark_read 가 조회를 기다리지 않게)
+//
+// 메시지를 보낸 사람은 그 방에 읽음 표시가 있으면 그 메시지까지 읽은 것으로 본다
+
+const uint32_t UNREAD_COUNT_MAX = 1000;     // 이보다 많으면 이 값으로 (클라이언트는 999+ 로 보여 준다)
+const size_t UNREAD_MAX_PENDING = 256;      // 쌓인 unread_summary 가 이보다 많으면 바로 빈 응답
+const size_t READ_MARK_MAX_PENDING = 4096;  // 가장 큰 id 를 아직 모르는 방의 mark_read 가 이보다 많이 쌓이면 버린다
+const size_t RECENT_COMMITS = 128;          // 읽음 표시가 있는 방마다 기억하는 최근 메시지 (mark_read 0 을 맞추는 데 쓴다)
+const std::chrono::seconds READ_ALL_SETTLE{ 5 };        // mark_read 0 시각 이전에 보낸 메시지는 이 안에 커밋된다고 본다
+const std::chrono::minutes RECEIPT_IDLE_EVICT{ 5 };     // 이만큼 mark_read / unread_summary 가 없던 유저는 메모리에서 내린다
+
+struct UnreadRoom {
+    int room_id = 0;
+    sqlite3_int64 last_read_id = 0;
+    uint32_t unread = 0;
+};
+
+class ReadReceipts {
+public:
+    using Callback = std::function<void(std::vector<UnreadRoom>)>;
+
+    explicit ReadReceipts(std::chrono::milliseconds flush_interval) : flush_interval_(flush_interval) {}
+
+    ReadReceipts(const ReadReceipts&) = delete;
+    ReadReceipts& operator=(const ReadReceipts&) = delete;
+
+    ~ReadReceipts() {
+        stop();
+    }
+
+    void start() {
+        if (thread_.joinable()) {
+            return;
+        }
+        stopping_ = false;
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    // 쌓인 unread_summary 에 답하고 바뀐 읽음 표시를 모두 기록한 뒤 종료
+    void stop() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    // 어느 스레드에서든, last_read_id 가 0 이면 지금까지 보낸 메시지 전부
+    // 실시간으로 받은 메시지에는 id 가 없으므로 클라이언트는 보통 0 을 보내고, 기록 조회로 본 곳까지는 그 id 를 보낸다
+    // 가장 큰 id 를 아직 모르는 방이면 읽음 표시 스레드가 DB 에서 읽어 온 뒤에 반영한다 (방마다 한 번)
+    void mark_read(int user_id, int room_id, sqlite3_int64 last_read_id) {
+        Mark mark{ user_id, room_id, last_read_id, std::time(nullptr) };
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (room_states_.count(room_id) != 0) {
+                apply(mark);
+                return;
+            }
+            if (!stopping_ && marks_.size() < READ_MARK_MAX_PENDING) {
+                marks_.push_back(mark);
+                wake_.notify_one();
+                return;
+            }
+        }
+        rejected_.add();
+    }
+
+    // 기록 스레드의 커밋 콜백에서, 같은 방 안에서는 id 순서
+    // 메시지마다 방 순번만 올리고, 보낸 사람의 읽음 표시가 있으면 그것만 옮긴다
+    void on_committed(const std::vector<StoredTalk>& talks) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const StoredTalk& talk : talks) {
+            RoomState& room = room_states_[talk.room_id];
+            room.latest_id = std::max(room.latest_id, talk.id);
+            ++room.committed;
+
+            auto readers = rooms_.find(talk.room_id);
+            if (readers == rooms_.end()) {
+                continue;
+            }
+            room.recent.push_back(Commit{ talk.id, talk.published });
+            if (room.recent.size() > RECENT_COMMITS) {
+                room.recent.pop_front();
+            }
+            auto sender = readers->second.find(talk.user_id);
+            if (sender != readers->second.end() && talk.id > sender->second.last_read_id) {
+                read_through(sender->second, room, talk.id);
+                mark_dirty(talk.user_id, talk.room_id, sender->second);
+            }
+        }
+    }
+
+    // 유저에게 읽음 표시가 있는 모든 방, room_id 순
+    // done 은 읽음 표시 스레드에서 호출된다 (쌓인 요청이 너무 많으면 호출한 스레드에서 바로 빈 목록으로)
+    void unread_summary(int user_id, Callback done) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!stopping_ && requests_.size() < UNREAD_MAX_PENDING) {
+                requests_.push_back(Request{ user_id, std::move(done) });
+                wake_.notify_one();
+                return;
+            }
+        }
+        rejected_.add();
+        done({});
+    }
+
+    uint64_t written() const { return written_.value(); }
+    uint64_t write_failures() const { return write_failures_.value(); }
+    uint64_t recounts() const { return recounts_.value(); }
+    uint64_t rejected() const { return rejected_.value(); }
+    size_t tracked() const { return tracked_.load(std::memory_order_relaxed); }
+
+private:
+    struct Receipt {
+        sqlite3_int64 last_read_id = 0;
+        uint64_t read_ordinal = 0;      // 읽었을 때 (또는 다시 세기 시작했을 때) 방의 committed
+        uint32_t base_unread = 0;       // read_ordinal 까지의 메시지 중 안 읽은 수 (다시 센 값)
+        std::time_t read_all_at = 0;    // 이 시각까지 보낸 메시지는 커밋되면 읽은 것으로 (mark_read 0)
+        bool counted = false;           // false 면 안 읽은 수를 믿지 않고 unread_summary 때 DB 에서 다시 센다
+        bool recounting = false;        // 다시 세는 중, base_unread 는 끝나야 채워진다
+        bool dirty = false;             // 아직 read_receipts 에 기록하지 않았다
+    };
+
+    struct Commit {
+        sqlite3_int64 id = 0;
+        std::time_t published = 0;
+    };
+
+    struct RoomState {
+        sqlite3_int64 latest_id = 0;    // 커밋된 가장 큰 id
+        uint64_t committed = 0;         // 이번 실행에서 커밋된 메시지 수, 읽음 표시의 read_ordinal 과 비교한다
+        std::deque<Commit> recent;      // 마지막 RECENT_COMMITS 개 (순번 committed - size + 1 .. committed), 읽음 표시가 있는 방만
+    };
+
+    struct UserState {
+        std::vector<int> rooms;         // 읽음 표시가 있는 방
+        bool loaded = false;            // read_receipts 를 읽어 왔다
+        std::chrono::steady_clock::time_point used;
+    };
+
+    struct Request {
+        int user_id = 0;
+        Callback done;
+    };
+
+    struct Mark {
+        int user_id = 0;
+        int room_id = 0;
+        sqlite3_int64 last_read_id = 0;
+        std::time_t at = 0;
+    };
+
+    // mutex_ 를 놓고 세는 동안 커밋된 메시지는 순번 차이로 들어가므로, 센 수는 끝나고 base_unread 에 넣는다
+    struct Recount {
+        int room_id = 0;
+        sqlite3_int64 last_read_id = 0;
+        sqlite3_int64 latest = 0;
+        uint32_t unread = 0;
+    };
+
+    // 이하 mutex_ 를 잡고 호출
+    void apply(const Mark& mark) {
+        RoomState& room = room_states_[mark.room_id];
+        auto readers = rooms_.find(mark.room_id);
+        bool created = readers == rooms_.end() || readers->second.count(mark.user_id) == 0;
+        Receipt& receipt = entry(mark.user_id, mark.room_id);
+        users_[mark.user_id].used = std::chrono::steady_clock::now();
+        sqlite3_int64 read_before = receipt.last_read_id;
+        sqlite3_int64 read_to = mark.last_read_id;
+        if (mark.last_read_id <= 0 || mark.last_read_id >= room.latest_id) {
+            // 아직 커밋되지 않은 메시지도 이 시각까지 보냈으면 커밋된 뒤 settle 에서 읽은 것으로 (초 단위라 같은 초의 뒤 메시지도 포함)
+            if (mark.last_read_id <= 0 && mark.at > receipt.read_all_at) {
+                if (receipt.read_all_at == 0) {
+                    settling_.emplace_back(mark.user_id, mark.room_id);
+                }
+                receipt.read_all_at = mark.at;
+            }
+            read_through(receipt, room, std::max(read_to, room.latest_id));
+        }
+        else if (mark.last_read_id > receipt.last_read_id) {
+            receipt.last_read_id = mark.last_read_id;
+            receipt.counted = false;
+        }
+        // 새 읽음 표시는 0 이어도 기록한다 (메모리에서 내린 뒤 DB 에서 다시 읽을 수 있게)
+        if (created || receipt.last_read_id > read_before) {
+            mark_dirty(mark.user_id, mark.room_id, receipt);
+        }
+    }
+
+    // 방에서 지금까지 커밋된 메시지를 모두 읽었다
+    static void read_through(Receipt& receipt, const RoomState& room, sqlite3_int64 id) {
+        receipt.last_read_id = std::max(receipt.last_read_id, id);
+        receipt.read_ordinal = room.committed;
+        receipt.base_unread = 0;
+        receipt.counted = true;
+    }
+
+    static uint32_t unread_of(const Receipt& receipt, const RoomState& room) {
+        uint64_t unread = receipt.base_unread + (room.committed - receipt.read_ordinal);
+        return static_cast<uint32_t>(std::min<uint64_t>(unread, UNREAD_COUNT_MAX));
+    }
+
+    // mark_read 0 뒤에 커밋된 메시지 중 그 시각까지 보낸 것은 읽은 것으로 옮긴다
+    // 그 뒤에 보낸 메시지를 만났거나 READ_ALL_SETTLE 이 지났으면 true (더 볼 것 없음)
+    bool settle(Receipt& receipt, const RoomState& room, int user_id, int room_id, std::time_t now) {
+        if (receipt.read_all_at == 0) {
+            return true;
+        }
+        bool done = now > receipt.read_all_at + READ_ALL_SETTLE.count();
+        uint64_t first = room.committed - room.recent.size() + 1;
+        if (receipt.counted && receipt.base_unread == 0 && !receipt.recounting && receipt.read_ordinal + 1 >= first) {
+            for (uint64_t ordinal = receipt.read_ordinal + 1; ordinal <= room.committed; ++ordinal) {
+                const Commit& commit = room.recent[static_cast<size_t>(ordinal - first)];
+                if (commit.published > receipt.read_all_at) {
+                    done = true;
+                    break;
+                }
+                receipt.read_ordinal = ordinal;
+                if (commit.id > receipt.last_read_id) {
+                    receipt.last_read_id = commit.id;
+                    mark_dirty(user_id, room_id, receipt);
+                }
+            }
+        }
+        else {
+            done = true;  // 최근 메시지 범위를 넘었거나 중간까지만 읽었으면 남은 것은 안 읽은 것으로
+        }
+        if (done) {
+            receipt.read_all_at = 0;
+        }
+        return done;
+    }
+
+    void settle_all() {
+        std::time_t now = std::time(nullptr);
+        std::vector<std::pair<int, int>> keys;
+        keys.swap(settling_);
+        for (const auto& [user_id, room_id] : keys) {
+            auto readers = rooms_.find(room_id);
+            if (readers == rooms_.end()) {
+                continue;
+            }
+            auto found = readers->second.find(user_id);
+            if (found != readers->second.end() && !settle(found->second, room_states_[room_id], user_id, room_id, now)) {
+                settling_.emplace_back(user_id, room_id);
+            }
+        }
+    }
+
+    Receipt& entry(int user_id, int room_id) {
+        auto [found, inserted] = rooms_[room_id].try_emplace(user_id);
+        if (inserted) {
+            // 가장 큰 id 를 아직 모르는 방이면 순번은 0 부터 (그 전에 다시 센다)
+            auto room = room_states_.find(room_id);
+            found->second.read_ordinal = room == room_states_.end() ? 0 : room->second.committed;
+            users_[user_id].rooms.push_back(room_id);
+            tracked_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return found->second;
+    }
+
+    // 기록할 것이 남지 않았고 한동안 쓰지 않은 유저의 읽음 표시를 모두 내린다
+    // 읽음 표시가 하나도 남지 않은 방은 최근 메시지도 비운다
+    void evict_idle() {
+        auto idle_before = std::chrono::steady_clock::now() - RECEIPT_IDLE_EVICT;
+        for (auto user = users_.begin(); user != users_.end();) {
+            int user_id = user->first;
+            bool clean = user->second.used < idle_before
+                && std::all_of(user->second.rooms.begin(), user->second.rooms.end(), [&](int room_id) {
+                    const Receipt& receipt = rooms_[room_id][user_id];
+                    return !receipt.dirty && !receipt.recounting && receipt.read_all_at == 0;
+                });
+            if (!clean) {
+                ++user;
+                continue;
+            }
+            for (int room_id : user->second.rooms) {
+                auto readers = rooms_.find(room_id);
+                readers->second.erase(user_id);
+                tracked_.fetch_sub(1, std::memory_order_relaxed);
+                if (readers->second.empty()) {
+                    rooms_.erase(readers);
+                    auto room = room_states_.find(room_id);
+                    if (room != room_states_.end()) {
+                        room->second.recent.clear();
+                    }
+                }
+            }
+            user = users_.erase(user);
+        }
+    }
+
+    void mark_dirty(int user_id, int room_id, Receipt& receipt) {
+        if (!receipt.dirty) {
+            receipt.dirty = true;
+            dirty_.emplace_back(user_id, room_id);
+        }
+    }
+
+    // 읽어 오는 사이에 커밋 콜백이 먼저 채웠으면 더 큰 쪽
+    void merge_latest(const std::vector<std::pair<int, sqlite3_int64>>& latest) {
+        for (const auto& [room_id, id] : latest) {
+            sqlite3_int64& room_latest = room_states_[room_id].latest_id;
+            room_latest = std::max(room_latest, id);
+        }
+    }
+
+    // 이 방에서 지금까지 커밋된 메시지는 센 수에 넣고, 이후의 것은 순번 차이로 센다
+    // 센 뒤 finish_recount 에서 last_read_id 가 그대로일 때만 믿는다
+    bool begin_recount(int room_id, Receipt& receipt, Recount& recount) {
+        const RoomState& room = room_states_[room_id];
+        sqlite3_int64 latest = room.latest_id;
+        receipt.read_ordinal = room.committed;
+        receipt.base_unread = 0;
+        if (latest <= receipt.last_read_id) {
+            receipt.counted = true;
+            return false;
+        }
+        receipt.recounting = true;
+        recount = Recount{ room_id, receipt.last_read_id, latest, 0 };
+        return true;
+    }
+
+    void finish_recount(int user_id, const Recount& recount) {
+        Receipt& receipt = rooms_[recount.room_id][user_id];
+        // 세는 동안 mark_read 나 자기 메시지로 읽은 곳이 바뀌었으면 버리고 다음 unread_summary 때 다시 센다
+        if (receipt.recounting && !receipt.counted && receipt.last_read_id == recount.last_read_id) {
+            receipt.base_unread = std::min(UNREAD_COUNT_MAX, recount.unread);
+            receipt.counted = true;
+        }
+        receipt.recounting = false;
+    }
+
+    // 이하 mutex_ 를 놓고 호출
+    static std::vector<std::pair<int, sqlite3_int64>> read_latest(const std::vector<int>& room_ids) {
+        std::vector<std::pair<int, sqlite3_int64>> latest;
+        for (int room_id : room_ids) {
+            latest.emplace_back(room_id, latest_room_talk_id(room_id));  // 인덱스 끝만 읽는다
+        }
+        return latest;
+    }
+
+    // 가장 큰 id 를 모르던 방의 mark_read, 받은 순서대로 반영한다
+    void apply_marks(const std::vector<Mark>& marks) {
+        std::vector<int> unknown;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const Mark& mark : marks) {
+                if (room_states_.count(mark.room_id) == 0) {
+                    unknown.push_back(mark.room_id);
+                }
+            }
+        }
+        std::sort(unknown.begin(), unknown.end());
+        unknown.erase(std::unique(unknown.begin(), unknown.end()), unknown.end());
+        std::vector<std::pair<int, sqlite3_int64>> latest = read_latest(unknown);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        merge_latest(latest);
+        for (const Mark& mark : marks) {
+            apply(mark);
+        }
+    }
+
+    void run() {
+        DBConnection& db = DBConnection::for_this_thread();
+        auto next_flush = std::chrono::steady_clock::now() + flush_interval_;
+        for (;;) {
+            std::vector<Mark> marks;
+            std::vector<Request> requests;
+            bool stopping = false;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait_until(lock, next_flush, [this]() { return stopping_ || !requests_.empty() || !marks_.empty(); });
+                marks.swap(marks_);
+                requests.swap(requests_);
+                stopping = stopping_;
+            }
+            if (!marks.empty()) {
+                apply_marks(marks);
+            }
+            for (auto& request : requests) {
+                answer(db, request);
+            }
+            if (stopping || std::chrono::steady_clock::now() >= next_flush) {
+                flush(db);
+                next_flush = std::chrono::steady_clock::now() + flush_interval_;
+            }
+            if (stopping) {
+                break;
+            }
+        }
+    }
+
+    void answer(DBConnection& db, Request& request) {
+        // 이번 실행에서 처음 묻는 유저는 지난 실행까지 남긴 읽음 표시부터 읽는다
+        bool loaded = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            UserState& user = users_[request.user_id];
+            user.used = std::chrono::steady_clock::now();
+            loaded = user.loaded;
+        }
+        std::vector<std::pair<int, sqlite3_int64>> stored;
+        if (!loaded) {
+            DBStatement stmt = db.prepare("SELECT room_id, last_read_id FROM read_receipts WHERE user_id = ?;");
+            if (stmt) {
+                stmt.bind(1, request.user_id);
+                while (stmt.step() == SQLITE_ROW) {
+                    stored.emplace_back(sqlite3_column_int(stmt.get(), 0), sqlite3_column_int64(stmt.get(), 1));
+                }
+            }
+        }
+
+        std::vector<int> unknown;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!loaded && !users_[request.user_id].loaded) {
+                users_[request.user_id].loaded = true;
+                for (const auto& [room_id, last_read_id] : stored) {
+                    Receipt& receipt = entry(request.user_id, room_id);
+                    if (last_read_id > receipt.last_read_id) {
+                        receipt.last_read_id = last_read_id;
+                        receipt.counted = false;
+                    }
+                }
+            }
+            for (int room_id : users_[request.user_id].rooms) {
+                if (!rooms_[room_id][request.user_id].counted && room_states_.count(room_id) == 0) {
+                    unknown.push_back(room_id);
+                }
+            }
+        }
+        std::vector<std::pair<int, sqlite3_int64>> latest = read_latest(unknown);
+
+        std::vector<Recount> recounts;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            merge_latest(latest);
+            for (int room_id : users_[request.user_id].rooms) {
+                Receipt& receipt = rooms_[room_id][request.user_id];
+                Recount recount;
+                if (!receipt.counted && begin_recount(room_id, receipt, recount)) {
+                    recounts.push_back(recount);
+                }
+            }
+        }
+        // 가장 큰 id 는 begin_recount 때 정했으므로 그 뒤에 커밋된 메시지는 세지 않는다
+        for (Recount& recount : recounts) {
+            recount.unread = static_cast<uint32_t>(count_room_history(recount.room_id, recount.last_read_id,
+                recount.latest, static_cast<int>(UNREAD_COUNT_MAX)));
+            recounts_.add();
+        }
+
+        std::vector<UnreadRoom> rooms;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const Recount& recount : recounts) {
+                finish_recount(request.user_id, recount);
+            }
+            std::time_t now = std::time(nullptr);
+            for (int room_id : users_[request.user_id].rooms) {
+                Receipt& receipt = rooms_[room_id][request.user_id];
+                const RoomState& room = room_states_[room_id];
+                settle(receipt, room, request.user_id, room_id, now);
+                rooms.push_back(UnreadRoom{ room_id, receipt.last_read_id, unread_of(receipt, room) });
+            }
+        }
+        std::sort(rooms.begin(), rooms.end(), [](const UnreadRoom& a, const UnreadRoom& b) {
+            return a.room_id < b.room_id;
+        });
+        request.done(std::move(rooms));
+    }
+
+    // 같은 (유저, 방) 이 여러 번 바뀌었어도 마지막 값 한 행만 기록한다, 실패하면 다음 번에 다시
+    void flush(DBConnection& db) {
+        std::vector<std::pair<int, int>> keys;
+        std::vector<sqlite3_int64> values;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            settle_all();
+            keys.swap(dirty_);
+            for (const auto& [user_id, room_id] : keys) {
+                Receipt& receipt = rooms_[room_id][user_id];
+                receipt.dirty = false;
+                values.push_back(receipt.last_read_id);
+            }
+        }
+        if (keys.empty()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            evict_idle();
+            return;
+        }
+
+        bool ok = db.exec("BEGIN;");
+        if (ok) {
+            // 다른 노드나 이전 실행이 더 뒤까지 남겼으면 그대로 둔다
+            DBStatement stmt = db.prepare("INSERT INTO read_receipts (user_id, room_id, last_read_id) VALUES (?, ?, ?) "
+                "ON CONFLICT(user_id, room_id) DO UPDATE SET last_read_id = MAX(last_read_id, excluded.last_read_id);");
+            ok = static_cast<bool>(stmt);
+            for (size_t i = 0; ok && i < keys.size(); ++i) {
+                stmt.bind(1, keys[i].first);
+                stmt.bind(2, keys[i].second);
+                stmt.bind(3, values[i]);
+                ok = stmt.step() == SQLITE_DONE;
+                stmt.reset();
+            }
+        }
+        if (ok && db.exec("COMMIT;")) {
+            written_.add(keys.size());
+            std::lock_guard<std::mutex> lock(mutex_);
+            evict_idle();
+            return;
+        }
+
+        CHAT_LOG_ERROR << "Failed to write read receipts: " << db.last_error();
+        db.exec("ROLLBACK;");
+        write_failures_.add();
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [user_id, room_id] : keys) {
+            mark_dirty(user_id, room_id, rooms_[room_id][user_id]);
+        }
+    }
+
+    const std::chrono::milliseconds flush_interval_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::vector<Request> requests_;
+    std::vector<Mark> marks_;
+    std::unordered_map<int, std::unordered_map<int, Receipt>> rooms_;   // room_id → user_id → 읽음 표시
+    std::unordered_map<int, UserState> users_;                          // user_id → 읽음 표시가 있는 방
+    std::unordered_map<int, RoomState> room_states_;                    // 가장 큰 id 를 아는 방
+    std::vector<std::pair<int, int>> dirty_;                            // (user_id, room_id)
+    std::vector<std::pair<int, int>> settling_;                         // read_all_at 이 남은 (user_id, room_id)
+    std::atomic<size_t> tracked_{ 0 };
+    std::thread thread_;
+
+    ShardedCounter written_;
+    ShardedCounter write_failures_;
+    ShardedCounter recounts_;
+    ShardedCounter rejected_;
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "chat_auth.h"
+#include "chat_log.h"
+#include "chat_protocol.h"
+
+// 재접속 토큰
+// 서버가 내려가기 전에 (drain) 세션마다 하나씩 보내 주고, 클라이언트는 다음 접속의 첫 메시지로 돌려준다
+// 토큰만으로 같은 방 / 유저로 다시 들어가고 최근 메시지 재전송은 건너뛴다
+// 형식: user_id.room_id.만료(unix 초).인증(0 / 1).HMAC-SHA256(hex)
+//   인증이 1 이면 그 user_id 로 로그인한 세션에 발급한 것이라 다시 들어온 세션도 로그인한 것으로 본다
+//   인증 필드가 없는 이전 형식도 받는다 (로그인하지 않은 것으로)
+// 서명 키는 data/ 아래 파일에 두어서 같은 디렉터리에서 새로 뜬 프로세스도 검증할 수 있다 (POSIX 에서는 0600)
+
+inline const std::string RESUME_KEY_FILE = "data/resume.key";
+const size_t RESUME_KEY_SIZE = 32;
+const std::chrono::seconds RESUME_TOKEN_TTL{ 300 };
+
+struct ResumeToken {
+    int user_id = 0;
+    int room_id = 0;
+    int64_t expires = 0;
+    bool authenticated = false;
+};
+
+class ResumeTokens {
+public:
+    // 키 파일이 없으면 새로 만든다, 읽지도 만들지도 못하면 false
+    bool load_or_create(const std::string& path) {
+        std::ifstream in(path);
+        std::string hex;
+        if (in >> hex && from_hex(hex, key_) && key_.size() >= RESUME_KEY_SIZE) {
+#ifndef _WIN32
+            ::chmod(path.c_str(), S_IRUSR | S_IWUSR);  // 이전 버전이 umask 대로 만든 파일
+#endif
+            return true;
+        }
+
+        uint8_t key[RESUME_KEY_SIZE];
+        std::random_device random;
+        for (size_t i = 0; i < sizeof(key); i += 4) {
+            uint32_t value = random();
+            std::memcpy(key + i, &value, 4);
+        }
+        key_.assign(reinterpret_cast<const char*>(key), sizeof(key));
+#ifndef _WIN32
+        // 키를 쓰기 전에 소유자만 읽고 쓸 수 있는 파일로 만들어 둔다 (umask 와 상관없이, 이미 있던 파일도)
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        if (fd < 0 || ::fchmod(fd, S_IRUSR | S_IWUSR) != 0) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            CHAT_LOG_ERROR << "Failed to create resume key " << path;
+            return false;
+        }
+        ::close(fd);
+#endif
+        std::ofstream out(path, std::ios::trunc);
+        out << to_hex(key, sizeof(key)) << '\n';
+        if (!out) {
+            CHAT_LOG_ERROR << "Failed to write resume key " << path;
+            return false;
+        }
+        CHAT_LOG_INFO << "Created resume key " << path;
+        return true;
+    }
+
+    std::string issue(int user_id, int room_id, bool authenticated) const {
+        std::string body = std::to_string(user_id) + '.' + std::to_string(room_id) + '.' + std::to_string(unix_now() + RESUME_TOKEN_TTL.count())
+            + (authenticated ? ".1" : ".0");
+        Sha256::Digest mac = hmac_sha256(key_, body);
+        return body + '.' + to_hex(mac.data(), mac.size());
+    }
+
+    // 서명이 맞고 만료되지 않았으면 내용을 채우고 true
+    bool verify(std::string_view token, ResumeToken& out) const {
+        size_t mac_pos = token.rfind('.');
+        if (mac_pos == std::string_view::npos) {
+            return false;
+        }
+        std::string_view body = token.substr(0, mac_pos);
+        Sha256::Digest mac = hmac_sha256(key_, body);
+        if (!constant_time_equal(to_hex(mac.data(), mac.size()), token.substr(mac_pos + 1))) {
+            return false;
+        }
+
+        size_t first = body.find('.');
+        size_t second = first == std::string_view::npos ? std::string_view::npos : body.find('.', first + 1);
+        size_t third = second == std::string_view::npos ? std::string_view::npos : body.find('.', second + 1);
+        ResumeToken parsed;
+        int authenticated = 0;
+        if (second == std::string_view::npos
+            || !parse_int(body.substr(0, first), parsed.user_id)
+            || !parse_int(body.substr(first + 1, second - first - 1), parsed.room_id)
+            || !parse_int(body.substr(second + 1, third == std::string_view::npos ? std::string_view::npos : third - second - 1), parsed.expires)
+            || (third != std::string_view::npos && !parse_int(body.substr(third + 1), authenticated))
+            || parsed.expires < unix_now()) {
+            return false;
+        }
+        parsed.authenticated = authenticated == 1;
+        out = parsed;
+        return true;
+    }
+
+private:
+    static int64_t unix_now() {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::string key_;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chat_archive.h"
+#include "chat_db.h"
+#include "chat_metrics.h"
+
+// 채팅 기록 전문 검색
+// 검색은 색인 크기에 따라 오래 걸릴 수 있어서 io 스레드 밖의 전용 풀에서 읽기 전용 연결로 처리한다
+// talks 다음에 월별 보관 파일을 최신 달부터 읽는다 (chat_archive.h)
+// 읽기 전용 연결은 WAL 스냅샷을 읽으므로 기록 스레드의 배치 커밋을 막지도, 기다리지도 않는다
+
+const int SEARCH_PAGE_MAX = 50;          // search_text 한 번에 돌려주는 최대 메시지 수
+const int SEARCH_OFFSET_MAX = 1000;      // 관련도 순은 keyset 으로 이어 읽을 수 없어서 OFFSET 을 여기까지만 허용
+const size_t SEARCH_MAX_PENDING = 256;   // 풀에 쌓인 검색이 이보다 많으면 바로 실패로 돌려준다
+const size_t SEARCH_QUERY_MAX = 256;     // 검색어 최대 길이 (바이트)
+
+struct SearchResult {
+    bool ok = false;                     // false 면 talks 는 비어 있다 (풀이 가득 참, DB 오류, 검색어 없음)
+    std::vector<StoredTalk> talks;
+};
+
+class SearchService {
+public:
+    using Callback = std::function<void(SearchResult)>;
+
+    explicit SearchService(size_t workers) : pool_(workers) {}
+
+    // 아직 시작하지 않은 검색은 버리고, 처리 중인 검색이 끝날 때까지 기다린다
+    ~SearchService() {
+        pool_.stop();
+        pool_.join();
+    }
+
+    // done 은 검색 스레드에서 호출된다 (풀이 가득 차면 호출한 스레드에서 바로)
+    void search(int room_id, std::string query, int offset, int limit, Callback done) {
+        if (query.empty() || query.size() > SEARCH_QUERY_MAX) {
+            done(SearchResult());
+            return;
+        }
+        if (pending_.fetch_add(1, std::memory_order_relaxed) >= SEARCH_MAX_PENDING) {
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            rejected_.add();
+            done(SearchResult());
+            return;
+        }
+        boost::asio::post(pool_, [this, room_id, query = std::move(query), offset, limit, done = std::move(done)]() {
+            SearchResult result;
+            {
+                ScopedLatency timing(latency_);
+                result.ok = search_history(room_id, query, offset, limit, result.talks);
+            }
+            if (!result.ok) {
+                result.talks.clear();
+                failed_.add();
+            }
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            done(std::move(result));
+        });
+    }
+
+    uint64_t rejected() const { return rejected_.value(); }
+    uint64_t failed() const { return failed_.value(); }
+    const ShardedHistogram& latency() const { return latency_; }
+
+private:
+    boost::asio::thread_pool pool_;
+    std::atomic<size_t> pending_{ 0 };
+
+    ShardedCounter rejected_;
+    ShardedCounter failed_;
+    ShardedHistogram latency_;         // 검색 하나를 처리하는 시간
+};
@@ -1,58 +1,76 @@
-﻿#include <boost/asio.hpp>
+﻿// Linux 에서 CHAT_IO_URING 을 정의해서 빌드하면 (-DCHAT_IO_URING, liburing 링크) epoll 대신 Asio 의 io_uring 백엔드로
+// 소켓 I/O 를 한다, 방 브로드캐스트로 여러 세션이 한꺼번에 쓰면 Asio 가 SQE 를 모아서 한 번에 제출한다
+// 다른 헤더가 boost/asio.hpp 를 포함하기 전에 정해야 하므로 맨 앞에 둔다
+#if defined(CHAT_IO_URING) && defined(__linux__)
+#include <boost/version.hpp>
+#if BOOST_VERSION < 107800
+#error "CHAT_IO_URING needs Boost 1.78 or later"
+#endif
+#define BOOST_ASIO_HAS_IO_URING 1
+#define BOOST_ASIO_DISABLE_EPOLL 1
+#endif
+
+#include <boost/asio.hpp>
 #include <boost/bind/bind.hpp>
-#include <sqlite3.h>
 #include <iostream>
 #include <unordered_map>
-#include <unordered_set>
 #include <string>
 #include <memory>
 #include <vector>
+#include <deque>
+#include <array>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <algorithm>
 #include <fstream>
+#include <initializer_list>
+
+#include "chat_archive.h"
+#include "chat_auth.h"
+#include "chat_buffer.h"
+#include "chat_cluster.h"
+#include "chat_compress.h"
+#include "chat_config.h"
+#include "chat_db.h"
+#include "chat_history.h"
+#include "chat_log.h"
+#include "chat_metrics.h"
+#include "chat_pool.h"
+#include "chat_protocol.h"
+#include "chat_rate_limit.h"
+#include "chat_receipts.h"
+#include "chat_resume.h"
+#include "chat_search.h"
+#include "chat_timer.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 using boost::asio::ip::tcp;
 using namespace std;
 
-// 데이터베이스 파일 경로
-const string DB_FILE = "data/chat_server.db";
 /*const int port = 12345;
 const string endpoint = "localhost";*/
 
-// SQLite 데이터베이스 초기화 함수
-//sqlite3 db파일 생성, 전송 (data폴더안 data로 전송) 
-void initialize_database() {
-    sqlite3* db;
-    int rc = sqlite3_open(DB_FILE.c_str(), &db);
-    if (rc) {
-        cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
-        return;
-    }
-
-    // users 테이블 생성
-    const char* users_table = "CREATE TABLE users("
+// 스키마 변경 이력, 새 변경은 항상 맨 뒤에 다음 version 으로 추가한다 (이미 배포된 단계는 고치지 않음)
+// 1 이전에 만들어진 DB 에도 적용할 수 있도록 CREATE 는 IF NOT EXISTS
+const SchemaMigration SCHEMA_MIGRATIONS[] = {
+    { 1, "create users, rooms, talks",
+        "CREATE TABLE IF NOT EXISTS users("
         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
         "login_id TEXT NOT NULL UNIQUE,"
         "login_password TEXT NOT NULL,"
         "name TEXT NOT NULL UNIQUE"
-        ");";
-    rc = sqlite3_exec(db, users_table, nullptr, nullptr, nullptr);
-    if (rc != SQLITE_OK) {
-        cerr << "Failed to create users table: " << sqlite3_errmsg(db) << endl;
-    }
-
-    // rooms 테이블 생성
-    const char* rooms_table = "CREATE TABLE rooms("
+        ");"
+        "CREATE TABLE IF NOT EXISTS rooms("
         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
         "title TEXT NOT NULL UNIQUE,"
         "host_user_id INTEGER NOT NULL,"
         "FOREIGN KEY(host_user_id) REFERENCES users(id)"
-        ");";
-    rc = sqlite3_exec(db, rooms_table, nullptr, nullptr, nullptr);
-    if (rc != SQLITE_OK) {
-        cerr << "Failed to create rooms table: " << sqlite3_errmsg(db) << endl;
-    }
-
-    // talks 테이블 생성
-    const char* talks_table = "CREATE TABLE talks ("
+        ");"
+        "CREATE TABLE IF NOT EXISTS talks ("
         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
         "room_id INTEGER NOT NULL,"
         "user_id INTEGER NOT NULL,"
@@ -60,319 +78,1705 @@ void initialize_database() {
         "published_date TEXT NOT NULL,"
         "FOREIGN KEY(room_id) REFERENCES rooms(id),"
         "FOREIGN KEY(user_id) REFERENCES users(id)"
-        ");";
-    rc = sqlite3_exec(db, talks_table, nullptr, nullptr, nullptr);
-    if (rc != SQLITE_OK) {
-        cerr << "Failed to create talks table: " << sqlite3_errmsg(db) << endl;
+        ");" },
+    // 방별 기록 조회를 (room_id, id) 범위로 읽는다 (이전의 idx_talks_room_id 대체)
+    // 본문까지 담으면 메시지가 두 번 저장되므로 열은 rowid 찾기로 읽는다, 한 페이지 50 행이면 싸다
+    { 2, "room history index",
+        "CREATE INDEX IF NOT EXISTS idx_talks_room_history ON talks(room_id, id);"
+        "DROP INDEX IF EXISTS idx_talks_room_id;" },
+    // 평문 비밀번호 대신 PBKDF2 해시를 저장한다, 남아 있는 평문 행은 다음 로그인 때 해시로 바뀐다
+    { 3, "store password hashes",
+        "ALTER TABLE users RENAME COLUMN login_password TO password_hash;" },
+    // search_text 용 전문 색인, 내용은 talks 에 있고 색인만 따로 둔다 (room_id 는 걸러내기용, 색인하지 않음)
+    // 이후의 메시지는 기록 스레드가 같은 트랜잭션에서 넣는다
+    { 4, "full-text index over talks",
+        "CREATE VIRTUAL TABLE IF NOT EXISTS talks_fts USING fts5(text, room_id UNINDEXED, content='talks', content_rowid='id');"
+        "INSERT INTO talks_fts(talks_fts) VALUES('rebuild');" },
+    // 월별 보관 파일 목록 (chat_archive.h)
+    { 5, "talk partition catalog",
+        "CREATE TABLE IF NOT EXISTS talk_partitions ("
+        "month TEXT PRIMARY KEY,"
+        "path TEXT NOT NULL,"
+        "min_id INTEGER NOT NULL,"
+        "max_id INTEGER NOT NULL,"
+        "rows INTEGER NOT NULL"
+        ");" },
+    // 유저마다 방별로 어디까지 읽었는지 (chat_receipts.h), 유저 하나의 방들을 한 번에 읽으므로 user_id 가 앞
+    { 6, "read receipts",
+        "CREATE TABLE IF NOT EXISTS read_receipts ("
+        "user_id INTEGER NOT NULL,"
+        "room_id INTEGER NOT NULL,"
+        "last_read_id INTEGER NOT NULL,"
+        "PRIMARY KEY(user_id, room_id)"
+        ") WITHOUT ROWID;" },
+    // 접속해 있지 않은 유저에게 온 귓속말 / 초대, 만료된 행은 created 색인으로 지운다
+    { 7, "offline inbox",
+        "CREATE TABLE IF NOT EXISTS inbox ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "user_id INTEGER NOT NULL,"
+        "kind INTEGER NOT NULL,"
+        "from_user_id INTEGER NOT NULL,"
+        "room_id INTEGER NOT NULL,"
+        "created INTEGER NOT NULL,"
+        "text TEXT NOT NULL"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_inbox_user ON inbox(user_id, id);"
+        "CREATE INDEX IF NOT EXISTS idx_inbox_created ON inbox(created);" },
+};
+
+// SQLite 데이터베이스 초기화 함수
+//sqlite3 db파일 생성, 전송 (data폴더안 data로 전송) 
+// 아직 적용하지 않은 스키마 변경을 순서대로 적용, 실패하면 false
+bool initialize_database() {
+    DBConnection& db = DBConnection::for_this_thread();
+    if (!db.is_open()) {
+        return false;
+    }
+    return run_migrations(db, SCHEMA_MIGRATIONS, sizeof(SCHEMA_MIGRATIONS) / sizeof(SCHEMA_MIGRATIONS[0]));
+}
+
+class ChatUser {
+public:
+    int get_userID() { return user_id_; }
+    string get_address() { return endpoint_ + ":" + to_string(port_); }
+    string get_name() { return name_; }
+    //void set_login(bool stat) {is_logined_ = stat;}
+    //bool get_login() { return is_logined_; }
+private:
+    int user_id_;
+    string endpoint_;
+    int port_;
+    string name_;
+    //bool is_logined_;
+};
+
+class ChatSession;
+class ChatServer;
+
+// 서버 전체 계측 값, 관리용 포트의 /metrics 로 노출
+struct ServerMetrics {
+    ShardedCounter accepts;
+    ShardedGauge active_sessions;
+    ShardedCounter messages_received;          // 클라이언트가 보낸 줄 / 프레임
+    ShardedCounter messages_sent;              // 소켓에 다 쓴 메시지
+    ShardedCounter write_batches;              // 송신 큐를 묶어서 보낸 async_write 수
+    ShardedCounter messages_dropped;           // 송신 큐가 가득 차서 버린 메시지
+    ShardedCounter slow_consumer_disconnects;
+    ShardedHistogram broadcast_fanout;         // 브로드캐스트 한 번을 멤버 송신 큐에 넣는 시간
+    ShardedCounter handshake_timeouts;
+    ShardedCounter heartbeat_timeouts;         // ping 에 답이 없어서 끊은 연결 (half-open 포함)
+    ShardedCounter idle_timeouts;
+    ShardedCounter connections_rejected;       // 최대 접속 수를 넘어서 바로 닫은 연결
+    ShardedCounter accept_pauses;              // 접속 속도 제한으로 accept 를 쉰 횟수
+    ShardedCounter user_rate_limited;          // 유저 버킷이 비어서 버린 명령
+    ShardedCounter room_rate_limited;          // 방 버킷이 비어서 버린 채팅
+    ShardedCounter abuse_disconnects;          // 제한에 계속 걸려서 끊은 연결
+    ShardedCounter presence_flushes;           // 모아 둔 입장 / 퇴장을 방에 보낸 횟수
+    ShardedCounter presence_suppressed;        // 큰 방이라 알리지 않은 입장 / 퇴장
+    ShardedCounter resumed_sessions;           // 재접속 토큰으로 다시 들어온 세션
+    ShardedCounter resume_failures;            // 서명이 틀렸거나 만료된 토큰
+    ShardedCounter unauthenticated_joins;      // require_auth 인데 로그인한 것과 다른 user_id 로 들어오려다 닫힌 연결
+    ShardedCounter compressions;               // 압축을 시도한 메시지, 브로드캐스트는 방마다 한 번
+    ShardedCounter compressed_frames;          // 압축해서 송신 큐에 넣은 프레임
+    ShardedCounter compression_saved_bytes;    // 압축으로 줄어든 송신 바이트
+    ShardedCounter inbox_delivered;            // 입장할 때 inbox 에서 꺼내 보낸 알림
+};
+
+inline ServerMetrics& server_metrics() {
+    static ServerMetrics metrics;
+    return metrics;
+}
+
+// 메시지 구분자, 본문에 붙이지 않고 scatter-gather로 함께 전송
+const char MESSAGE_DELIMITER[] = "\n";
+
+// 방마다 메모리에 들고 있다가 입장할 때 다시 보내 주는 최근 메시지 수
+const size_t ROOM_HISTORY_SIZE = 50;
+
+// fetch_history 한 번에 돌려주는 최대 메시지 수
+const int HISTORY_PAGE_MAX = 100;
+
+// 기록 조회 / 검색 결과를 요청한 세션의 프로토콜에 맞춰 응답 하나로 묶는다 (형식은 chat_protocol.h)
+// 텍스트는 text_header 줄 뒤에 talk? 줄들, 바이너리는 header_fields 와 count 뒤에 행들
+// 바이너리는 프레임 한도를 넘기 전까지만 담으므로 count 가 요청보다 적을 수 있다
+SharedMessage encode_talk_page(bool binary, const string& text_header, initializer_list<uint64_t> header_fields, const vector<StoredTalk>& page) {
+    string out;
+    size_t count = 0;
+    if (binary) {
+        string rows;
+        BinaryWriter writer(rows);
+        for (const auto& talk : page) {
+            size_t before = rows.size();
+            writer.write_varint(static_cast<uint64_t>(talk.id));
+            writer.write_varint(static_cast<uint64_t>(talk.user_id));
+            writer.write_varint(static_cast<uint64_t>(talk.published));
+            writer.write_string(*talk.text);
+            if (rows.size() + (header_fields.size() + 1) * 10 > BINARY_MAX_PAYLOAD) {  // 앞 필드와 count varint 자리
+                rows.resize(before);
+                break;
+            }
+            ++count;
+        }
+        BinaryWriter header(out);
+        for (uint64_t field : header_fields) {
+            header.write_varint(field);
+        }
+        header.write_varint(count);
+        out += rows;
+    }
+    else {
+        out = text_header;
+        for (const auto& talk : page) {
+            out += "\ntalk?id:" + to_string(talk.id) + "/user_id:" + to_string(talk.user_id)
+                + "/published:" + to_string(talk.published) + "/text:";
+            out += *talk.text;
+        }
+    }
+    return make_shared_message(move(out));
+}
+
+SharedMessage encode_history_page(bool binary, int room_id, const vector<StoredTalk>& page) {
+    return encode_talk_page(binary, "history?room_id:" + to_string(room_id) + "/count:" + to_string(page.size()),
+        { static_cast<uint64_t>(room_id) }, page);
+}
+
+SharedMessage encode_search_page(bool binary, int room_id, int offset, const vector<StoredTalk>& page) {
+    return encode_talk_page(binary, "search?room_id:" + to_string(room_id) + "/offset:" + to_string(offset) + "/count:" + to_string(page.size()),
+        { static_cast<uint64_t>(room_id), static_cast<uint64_t>(offset) }, page);
+}
+
+// unread_summary 응답 (형식은 chat_protocol.h), 바이너리는 프레임 한도를 넘기 전까지만 담는다
+SharedMessage encode_unread(bool binary, const vector<UnreadRoom>& rooms) {
+    string out;
+    if (binary) {
+        string rows;
+        BinaryWriter writer(rows);
+        size_t count = 0;
+        for (const auto& room : rooms) {
+            if (rows.size() + 3 * 10 + 10 > BINARY_MAX_PAYLOAD) {  // 이 행과 count varint 자리
+                break;
+            }
+            writer.write_varint(static_cast<uint64_t>(room.room_id));
+            writer.write_varint(static_cast<uint64_t>(room.last_read_id));
+            writer.write_varint(room.unread);
+            ++count;
+        }
+        BinaryWriter header(out);
+        header.write_varint(count);
+        out += rows;
+    }
+    else {
+        out = "unread?count:" + to_string(rooms.size());
+        for (const auto& room : rooms) {
+            out += "\nroom?room_id:" + to_string(room.room_id) + "/last_read_id:" + to_string(room.last_read_id)
+                + "/unread:" + to_string(room.unread);
+        }
+    }
+    return make_shared_message(move(out));
+}
+
+// 한 사람에게만 보내는 알림 (형식은 chat_protocol.h)
+SharedMessage encode_direct(bool binary, int from_user_id, string_view text) {
+    string out;
+    if (binary) {
+        BinaryWriter writer(out);
+        writer.write_varint(static_cast<uint64_t>(from_user_id));
+        writer.write_string(text);
+    }
+    else {
+        out = "direct?user_id:" + to_string(from_user_id) + "/text:";
+        out += text;
+    }
+    return make_shared_message(move(out));
+}
+
+// 접속해 있지 않은 동안 온 알림 (형식은 chat_protocol.h)
+// 텍스트는 한 번에, 바이너리는 프레임 한도 안에서 채울 수 있는 만큼씩 나눈다
+vector<SharedMessage> encode_inbox(bool binary, const vector<InboxEntry>& entries) {
+    vector<SharedMessage> frames;
+    if (!binary) {
+        string out = "inbox?count:" + to_string(entries.size());
+        for (const auto& entry : entries) {
+            if (entry.kind == static_cast<uint8_t>(CommandType::deliver_invite)) {
+                out += "\ninvite?room_id:" + to_string(entry.room_id) + "/user_id:" + to_string(entry.from_user_id)
+                    + "/published:" + to_string(entry.created);
+            }
+            else {
+                out += "\ndirect?user_id:" + to_string(entry.from_user_id) + "/published:" + to_string(entry.created) + "/text:";
+                out += entry.text;
+            }
+        }
+        frames.push_back(make_shared_message(move(out)));
+        return frames;
+    }
+
+    string rows;
+    size_t count = 0;
+    auto flush = [&]() {
+        string out;
+        BinaryWriter header(out);
+        header.write_varint(count);
+        out += rows;
+        frames.push_back(make_shared_message(move(out)));
+        rows.clear();
+        count = 0;
+    };
+    for (const auto& entry : entries) {
+        string row;
+        BinaryWriter writer(row);
+        writer.write_varint(entry.kind);
+        writer.write_varint(static_cast<uint64_t>(entry.from_user_id));
+        writer.write_varint(static_cast<uint64_t>(entry.room_id));
+        writer.write_varint(static_cast<uint64_t>(entry.created));
+        writer.write_string(entry.text);
+        if (count > 0 && rows.size() + row.size() + 10 > BINARY_MAX_PAYLOAD) {  // count varint 자리
+            flush();
+        }
+        rows += row;
+        ++count;
+    }
+    if (count > 0) {
+        flush();
+    }
+    return frames;
+}
+
+SharedMessage encode_auth_result(bool binary, const AuthResult& result) {
+    string out;
+    if (binary) {
+        BinaryWriter writer(out);
+        writer.write_varint(static_cast<uint64_t>(result.status));
+        writer.write_varint(static_cast<uint64_t>(result.user_id));
+    }
+    else {
+        out = "auth?status:" + to_string(static_cast<int>(result.status)) + "/user_id:" + to_string(result.user_id);
+    }
+    return make_shared_message(move(out));
+}
+
+// 방 전체 알림, 입장 / 퇴장을 모아서 한 번에 보낸다
+// 수는 정확하고 id 는 앞에서부터 일부만 실릴 수 있다
+SharedMessage encode_presence(bool binary, int room_id, size_t joins, size_t leaves,
+    const vector<int>& joined_ids, const vector<int>& left_ids) {
+    string out;
+    if (binary) {
+        BinaryWriter writer(out);
+        writer.write_varint(static_cast<uint64_t>(room_id));
+        writer.write_varint(joins);
+        writer.write_varint(leaves);
+        for (const auto* ids : { &joined_ids, &left_ids }) {
+            writer.write_varint(ids->size());
+            for (int id : *ids) {
+                writer.write_varint(static_cast<uint64_t>(id));
+            }
+        }
+    }
+    else {
+        out = "presence?room_id:" + to_string(room_id) + "/joined:" + to_string(joins) + "/left:" + to_string(leaves);
+        const char* names[] = { "/joined_ids:", "/left_ids:" };
+        const vector<int>* lists[] = { &joined_ids, &left_ids };
+        for (size_t i = 0; i < 2; ++i) {
+            out += names[i];
+            for (size_t j = 0; j < lists[i]->size(); ++j) {
+                if (j > 0) {
+                    out += ',';
+                }
+                out += to_string((*lists[i])[j]);
+            }
+        }
     }
+    return make_shared_message(move(out));
+}
 
-    sqlite3_close(db);
+SharedMessage encode_resume_token(bool binary, const string& token) {
+    string out;
+    if (binary) {
+        BinaryWriter writer(out);
+        writer.write_string(token);
+    }
+    else {
+        out = "resume?token:" + token;
+    }
+    return make_shared_message(move(out));
+}
+
+SharedMessage encode_invite(bool binary, int room_id, int from_user_id) {
+    string out;
+    if (binary) {
+        BinaryWriter writer(out);
+        writer.write_varint(static_cast<uint64_t>(room_id));
+        writer.write_varint(static_cast<uint64_t>(from_user_id));
+    }
+    else {
+        out = "invite?room_id:" + to_string(room_id) + "/user_id:" + to_string(from_user_id);
+    }
+    return make_shared_message(move(out));
 }
 
 // 채팅방 클래스
-class ChatRoom {
+// members_ 는 방의 strand 안에서만 접근하므로 같은 방의 입장/퇴장/브로드캐스트는 직렬화되고
+// 서로 다른 방은 여러 io 스레드에서 병렬로 처리된다
+// 멤버는 연속된 vector 에 두어서 브로드캐스트가 노드를 따라가지 않고 앞에서부터 훑기만 한다
+class ChatRoom : public enable_shared_from_this<ChatRoom> {
 public:
-    void join(shared_ptr<ChatSession> session) {
-        members_.insert(session);
-        broadcast("A new user has joined the chat.");
+    ChatRoom(boost::asio::io_context& io_context, int room_id, const RateLimits& limits, const PresenceOptions& presence,
+        HistoryService& history_service)
+        : strand_(boost::asio::make_strand(io_context)), room_id_(room_id), rate_limit_(limits.room_rate, limits.room_burst),
+        presence_(presence), presence_timer_(strand_), history_service_(history_service) {
+    }
+
+    // 보내는 세션의 strand 에서 브로드캐스트 전에 호출, 방 strand 를 거치지 않는다
+    bool admit(TokenBucket::Clock::time_point now, double cost = 1.0) {
+        return rate_limit_.try_acquire(now, cost);
     }
 
+    // 새로 들어온 세션에는 최근 메시지를 DB 없이 메모리에서 먼저 보내 준다
+    // 재접속한 세션은 이미 받은 것이므로 replay 가 false
+    void join(shared_ptr<ChatSession> session, bool replay = true) {
+        auto self = shared_from_this();
+        boost::asio::dispatch(strand_, [this, self, session, replay]() {
+            with_history([this, session, replay]() {
+                if (replay) {
+                    replay_history(session);
+                }
+                members_.push_back(session);
+                announce_join(session);
+            });
+        });
+    }
+
+    // 캐시를 채우는 중이면 미뤄 둔 입장보다 먼저 나가지 않게 같이 미룬다
     void leave(shared_ptr<ChatSession> session) {
-        members_.erase(session);
-        // if(members_)
-        broadcast("A user has left the chat.");
+        auto self = shared_from_this();
+        boost::asio::dispatch(strand_, [this, self, session]() {
+            with_history([this, session]() {
+                remove_member(session);
+                announce_leave(session);
+            });
+        });
     }
 
+    // 각 멤버의 송신 큐에 넣기만 하므로 느린 수신자가 방 전체를 막지 않는다
+    // 멤버 수와 상관없이 할당은 한 번
     void broadcast(const string& message) {
-        for (auto& member : members_) {
-            boost::asio::write(member->get_socket(), boost::asio::buffer(message + "\n"));
-        }
+        broadcast(make_shared_message(message));
+    }
+
+    void broadcast(const SharedMessage& payload) {
+        auto self = shared_from_this();
+        boost::asio::dispatch(strand_, [this, self, payload]() {
+            deliver_all(payload);
+        });
     }
 
-    void save_message_to_db(int room_id, int user_id, const string& message) {
-        sqlite3* db;
-        int rc = sqlite3_open(DB_FILE.c_str(), &db);
-        if (rc) {
-            cerr << "Can't open database: " << sqlite3_errmsg(db) << endl;
+    // 기록 파이프라인이 커밋한 메시지를 id 순서대로 최근 메시지 캐시에 넣는다
+    void remember(vector<StoredTalk> talks) {
+        auto self = shared_from_this();
+        boost::asio::dispatch(strand_, [this, self, talks = move(talks)]() mutable {
+            with_history([this, talks = move(talks)]() mutable {
+                for (auto& talk : talks) {
+                    push_history(move(talk));
+                }
+            });
+        });
+    }
+
+    // before_id 보다 오래된 메시지를 최신순으로 limit 개 찾아 session 에게 한 번에 보낸다
+    // 메모리 캐시로 채울 수 있는 만큼 먼저 쓰고, 캐시보다 오래된 구간만 DB에서 읽는다
+    void fetch_history(shared_ptr<ChatSession> session, sqlite3_int64 before_id, int limit);
+
+    // 방에 들어와 있는 세션 수, ChatServer::rooms_mutex_ 를 잡은 상태에서만 변경/조회
+    size_t member_count() const {
+        return occupants_;
+    }
+    void add_occupant() { ++occupants_; }
+    void remove_occupant() { --occupants_; }
+
+    // strand 에서만 올리고, 계측 스레드가 읽는다
+    uint64_t messages_in() const { return messages_in_.load(memory_order_relaxed); }
+    uint64_t messages_out() const { return messages_out_.load(memory_order_relaxed); }
+    int room_id() const { return room_id_; }
+
+private:
+    // 이하 strand 안에서만 호출
+    void deliver_all(const SharedMessage& payload);
+    void replay_history(const shared_ptr<ChatSession>& session);
+    void announce_join(const shared_ptr<ChatSession>& session);
+    void announce_leave(const shared_ptr<ChatSession>& session);
+    void flush_presence();
+
+    // 첫 입장 / 퇴장이 window 를 시작하고, window 가 끝나면 그동안 모인 것을 한 번에 보낸다
+    void note_presence(int user_id, bool joined) {
+        if (presence_.off_members > 0 && members_.size() > presence_.off_members) {
+            server_metrics().presence_suppressed.add();
             return;
         }
+        if (joined) {
+            ++presence_joins_;
+            if (presence_joined_.size() < presence_.max_ids) {
+                presence_joined_.push_back(user_id);
+            }
+        }
+        else {
+            // 같은 window 안에서 들어왔다 나간 세션 (빠른 재접속 등) 은 서로 지운다
+            auto it = find(presence_joined_.begin(), presence_joined_.end(), user_id);
+            if (it != presence_joined_.end()) {
+                presence_joined_.erase(it);
+                --presence_joins_;
+            }
+            else {
+                ++presence_leaves_;
+                if (presence_left_.size() < presence_.max_ids) {
+                    presence_left_.push_back(user_id);
+                }
+            }
+        }
+        if (presence_pending_) {
+            return;
+        }
+        presence_pending_ = true;
+        presence_timer_.expires_after(members_.size() > presence_.sample_members ? presence_.sample_window : presence_.window);
+        auto self = shared_from_this();
+        presence_timer_.async_wait([this, self](boost::system::error_code ec) {
+            if (!ec) {
+                flush_presence();
+            }
+        });
+    }
 
-        string sql = "INSERT INTO talks (room_id, user_id, text, published_date) VALUES (?, ?, ?, datetime('now'));";
-        sqlite3_stmt* stmt;
-        rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
-        if (rc != SQLITE_OK) {
-            cerr << "Failed to prepare statement: " << sqlite3_errmsg(db) << endl;
-            sqlite3_close(db);
+    // 순서는 상관없으므로 마지막 멤버를 빈자리로 옮겨서 뒤를 당기지 않는다
+    void remove_member(const shared_ptr<ChatSession>& session) {
+        auto it = find(members_.begin(), members_.end(), session);
+        if (it == members_.end()) {
             return;
         }
+        if (it != members_.end() - 1) {
+            *it = move(members_.back());
+        }
+        members_.pop_back();
+    }
 
-        sqlite3_bind_int(stmt, 1, room_id);
-        sqlite3_bind_int(stmt, 2, user_id);
-        sqlite3_bind_text(stmt, 3, message.c_str(), -1, SQLITE_STATIC);
+    // 방이 열린 뒤 처음 한 번만 조회 풀에서 최근 메시지를 채운다
+    // 채우는 동안 들어온 입장 / 퇴장 / 커밋 알림 / 기록 조회는 받은 순서대로 미뤘다가 채운 뒤에 처리한다
+    void with_history(function<void()> action) {
+        if (history_loaded_) {
+            action();
+            return;
+        }
+        history_waiters_.push_back(move(action));
+        if (history_waiters_.size() > 1) {
+            return;
+        }
+        auto self = shared_from_this();
+        history_service_.load(room_id_, INT64_MAX, static_cast<int>(ROOM_HISTORY_SIZE), [this, self](vector<StoredTalk> talks) {
+            boost::asio::post(strand_, [this, self, talks = move(talks)]() mutable {
+                history_loaded_ = true;
+                for (auto it = talks.rbegin(); it != talks.rend(); ++it) {
+                    push_history(move(*it));
+                }
+                vector<function<void()>> waiters;
+                waiters.swap(history_waiters_);
+                for (auto& waiter : waiters) {
+                    waiter();
+                }
+            });
+        });
+    }
 
-        rc = sqlite3_step(stmt);
-        if (rc != SQLITE_DONE) {
-            cerr << "Failed to insert message: " << sqlite3_errmsg(db) << endl;
+    void push_history(StoredTalk talk) {
+        // DB에서 읽어 온 것과 커밋 알림이 겹칠 수 있으므로 이미 가진 id는 건너뛴다
+        if (talk.id <= last_history_id_) {
+            return;
         }
+        last_history_id_ = talk.id;
 
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
+        if (history_.size() < ROOM_HISTORY_SIZE) {
+            history_.push_back(move(talk));
+            return;
+        }
+        history_[history_head_] = move(talk);
+        history_head_ = (history_head_ + 1) % ROOM_HISTORY_SIZE;
     }
 
-    size_t member_count() const {
-        return members_.size();
-    }
-private:
-    unordered_set<shared_ptr<ChatSession>> members_;  // shared_ptr 관리
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    int room_id_;
+    vector<shared_ptr<ChatSession>> members_;  // shared_ptr 관리, 순서 없음
+    size_t occupants_ = 0;
+    SharedRateLimiter rate_limit_;
+    const PresenceOptions& presence_;
+    boost::asio::steady_timer presence_timer_;  // strand 위에서 돈다
+    bool presence_pending_ = false;
+    size_t presence_joins_ = 0;                 // 이번 window 의 입장 / 퇴장 수
+    size_t presence_leaves_ = 0;
+    vector<int> presence_joined_;
+    vector<int> presence_left_;
+    atomic<uint64_t> messages_in_{ 0 };   // 이 방에 브로드캐스트된 메시지
+    atomic<uint64_t> messages_out_{ 0 };  // 멤버들의 송신 큐에 넣은 메시지
+
+    // 최근 메시지 원형 버퍼, 가득 차면 history_head_ 가 가장 오래된 메시지
+    vector<StoredTalk> history_;
+    size_t history_head_ = 0;
+    sqlite3_int64 last_history_id_ = 0;
+    bool history_loaded_ = false;
+    vector<function<void()>> history_waiters_;  // 캐시를 채우는 동안 미뤄 둔 일
+    HistoryService& history_service_;
 };
 
+// 세션별 송신 큐 한도 (느린 수신자 보호)
+const size_t WRITE_QUEUE_HIGH_WATER = 256;   // 큐에 쌓인 메시지가 이 수를 넘으면 새 메시지는 버림
+const size_t SLOW_CONSUMER_DROP_LIMIT = 64;  // 연속으로 이만큼 버려지면 연결을 끊음
+// 송신 큐에 쌓인 메시지를 async_write 한 번 (writev) 에 이만큼까지 묶는다
+// 메시지마다 버퍼가 둘이라 Asio 가 한 번에 넘기는 iovec 수 (64) 에 맞춘다
+const size_t WRITE_BATCH_MAX = 32;
+
+// 빌드에 따라 정해지는 소켓 I/O 백엔드, 시작 로그와 /metrics 에 보인다
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+const char IO_BACKEND[] = "io_uring";
+#elif defined(BOOST_ASIO_HAS_IOCP)
+const char IO_BACKEND[] = "iocp";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+const char IO_BACKEND[] = "epoll";
+#elif defined(BOOST_ASIO_HAS_KQUEUE)
+const char IO_BACKEND[] = "kqueue";
+#else
+const char IO_BACKEND[] = "select";
+#endif
+
+// 세션 마감은 서버 전체가 공유하는 timing wheel 로 tick 단위로 확인한다
+const chrono::seconds SESSION_TIMER_TICK{ 1 };
+const size_t SESSION_TIMER_SLOTS = 512;
+const chrono::seconds HANDSHAKE_TIMEOUT{ 10 };   // 접속 후 room_id,user_id (바이너리는 hello) 를 보내야 하는 시간
+const chrono::seconds HEARTBEAT_INTERVAL{ 30 };  // 이만큼 아무것도 받지 못하면 ping
+const chrono::seconds HEARTBEAT_TIMEOUT{ 20 };   // ping 뒤 이 안에 아무것도 오지 않으면 끊어진 연결로 본다
+
+// fd 가 모자란 경우 등, 바로 다시 accept 하면 같은 에러로 계속 돈다
+const chrono::milliseconds ACCEPT_ERROR_BACKOFF{ 100 };
+
+// 텍스트 / 바이너리 세션에 보내는 heartbeat, 내용이 없으므로 만들어 둔 것을 같이 쓴다
+SharedMessage heartbeat_message(bool binary, CommandType type) {
+    static const SharedMessage TEXT_PING = make_static_message(string("ping?"));
+    static const SharedMessage TEXT_PONG = make_static_message(string("pong?"));
+    static const SharedMessage EMPTY = make_static_message(string());
+    if (binary) {
+        return EMPTY;
+    }
+    return type == CommandType::ping ? TEXT_PING : TEXT_PONG;
+}
+
+// 핸드셰이크 전에 받을 수 있는 명령
+bool usable_before_join(CommandType type) {
+    return type == CommandType::hello || type == CommandType::resume
+        || type == CommandType::login_user || type == CommandType::create_user;
+}
+
 // 채팅 세션 클래스
 class ChatSession : public enable_shared_from_this<ChatSession> {
 public:
-    ChatSession(tcp::socket socket, ChatServer& server)
-        : socket_(move(socket)), server_(server) {
+    ChatSession(tcp::socket socket, ChatServer& server, size_t max_frame_size, const RateLimits& limits)
+        : socket_(move(socket)), server_(server), buffer_(max_frame_size + BINARY_HEADER_SIZE),
+        limits_(limits), rate_limit_(limits.user_rate, limits.user_burst) {
+        server_metrics().active_sessions.add();
     }
 
-    void start(shared_ptr<ChatSession> self, shared_ptr<ChatUser> user) {
-        self_ = self;
-        user_ = user;
-        read_initial_data();
+    ~ChatSession() {
+        server_metrics().active_sessions.sub();
     }
 
-    void leave_room() {
-        server_.get_or_create_room(room_id_).leave(self_);
-        server_.remove_empty_room(room_id_); // 사용자가 나간 후 방을 확인하여 제거
+    void start(shared_ptr<ChatSession> self, shared_ptr<ChatUser> user);
+
+    // timing wheel 이 마감 tick 에 부른다
+    void on_deadline() {
+        auto self = shared_from_this();
+        boost::asio::dispatch(socket_.get_executor(), [this, self]() {
+            check_deadlines();
+        });
+    }
+
+    // heartbeat 가 아닌 명령이나 채팅을 받았을 때 (세션 strand에서)
+    void mark_active();
+
+    // 명령을 처리해도 되는지 유저 버킷, room 이 있으면 방 버킷까지 확인 (세션 strand에서)
+    // 시각은 읽기 한 번에 한 번만 재서 그 안의 줄 / 프레임이 같이 쓴다
+    bool admit(ChatRoom* room, double cost = 1.0);
+
+    // 핸드셰이크(텍스트 첫 줄 또는 바이너리 hello)를 받으면 방에 입장
+    void join_room(int room_id, int user_id, bool replay = true);
+    void leave_room();
+
+    // 서버가 내려가기 전에 호출, 재접속 토큰을 보내고 송신 큐를 다 비우면 연결을 닫는다
+    void drain();
+
+    int room_id() const { return room_id_; }
+    int user_id() const { return user_id_; }
+    shared_ptr<ChatRoom> room() const { return room_; }
+
+    // ping / pong 을 받았을 때 (세션 strand에서), 이후로 서버도 heartbeat 를 보낸다
+    void enable_heartbeat() { heartbeat_ = true; }
+
+    // login_user / create_user 로 확인된 user_id, 0 이면 로그인하지 않음 (세션 strand에서)
+    int authenticated_user_id() const { return authenticated_user_id_; }
+
+    // 재접속 토큰처럼 이미 확인된 신원을 묶는다 (세션 strand에서)
+    void bind_user(int user_id) { authenticated_user_id_ = user_id; }
+
+    // 인증 요청을 보내기 전에 (세션 strand에서), 결과가 올 때까지 입장 전의 다음 줄 / 프레임은 읽지 않는다
+    void begin_auth() { ++auth_pending_; }
+
+    // 인증 풀에서 호출, 세션 strand로 넘겨서 성공했으면 user_id 를 묶고 결과를 보낸다
+    void on_auth_result(const AuthResult& result, SharedMessage reply);
+
+    // 핸드셰이크 이후에는 바뀌지 않으므로 다른 strand에서 읽어도 된다
+    bool is_binary() const { return protocol_ == Protocol::binary; }
+
+    // hello / resume 에서 클라이언트가 보낸 codecs 중 서버도 아는 것을 고른다, join_room 전에 세션 strand에서
+    // 텍스트 세션은 항상 압축하지 않는다
+    void negotiate_compression(uint64_t codecs, size_t min_size) {
+        if (is_binary()) {
+            codecs_ = codecs & CODEC_LZ4_CHAT;
+            compress_min_size_ = min_size;
+        }
+    }
+
+    // 입장 전에 정해지고 바뀌지 않으므로 방의 strand에서 읽어도 된다
+    bool compresses(size_t payload_size) const {
+        return codecs_ != 0 && payload_size >= compress_min_size_;
+    }
+
+    // 방의 strand에서 호출되므로 세션 strand로 넘겨서 송신 큐에 넣는다
+    // type 은 바이너리 프레임의 opcode, 텍스트 세션은 무시
+    // 압축을 협상한 세션이면 세션 strand에서 이 세션 몫으로 압축한다
+    void deliver(const SharedMessage& message, CommandType type = CommandType::deliver_text) {
+        auto self = shared_from_this();
+        boost::asio::dispatch(socket_.get_executor(), [this, self, message, type]() {
+            SharedMessage compressed;
+            if (compresses(message->size())) {
+                server_metrics().compressions.add();
+                compressed = compress_message(*message);
+            }
+            enqueue_payload(message, compressed, type);
+        });
+    }
+
+    // 브로드캐스트용, 방에서 한 번 압축한 compressed 를 압축을 협상한 멤버들이 같이 쓴다
+    // compressed 가 nullptr 이면 (줄지 않았거나 아무도 압축하지 않음) message 를 그대로 보낸다
+    void deliver_shared(const SharedMessage& message, const SharedMessage& compressed, CommandType type = CommandType::deliver_text) {
+        auto self = shared_from_this();
+        boost::asio::dispatch(socket_.get_executor(), [this, self, message, compressed, type]() {
+            enqueue_payload(message, compressed, type);
+        });
+    }
+
+    // 어느 스레드에서든 호출 가능, 실제 종료는 세션 strand에서 처리
+    void close() {
+        auto self = shared_from_this();
+        boost::asio::dispatch(socket_.get_executor(), [this, self]() {
+            do_close();
+        });
     }
 
     tcp::socket& get_socket() { return socket_; }
 
 private:
-    void read_initial_data() {
+    enum class Protocol {
+        negotiating,  // 첫 바이트를 기다리는 중
+        text,
+        binary
+    };
+
+    struct OutboundMessage {
+        SharedMessage payload;
+        CommandType type;
+        bool compressed = false;  // payload 가 압축된 것, 프레임 헤더에 FRAME_FLAG_COMPRESSED
+    };
+
+    void parse_initial_data(string_view data) {
+        auto comma_pos = data.find(',');
+        if (comma_pos != string_view::npos) {
+            if (!parse_int(data.substr(0, comma_pos), room_id_) || !parse_int(data.substr(comma_pos + 1), user_id_)) {
+                CHAT_LOG_WARN << "Invalid data format: " << data;
+            }
+        }
+        else {
+            CHAT_LOG_WARN << "Invalid data format: " << data;
+        }
+    }
+
+    // 수신 버퍼에 쌓인 완성된 줄 / 프레임을 모두 처리, 프로토콜 위반이면 false
+    void do_read();
+    bool process_frames();
+    bool process_text_lines();
+    bool process_binary_frames();
+
+    // 입장 전에 인증 결과를 기다려야 하면 waiting_auth_ 를 세운다
+    bool must_wait_for_auth() {
+        if (!room_ && auth_pending_ > 0) {
+            waiting_auth_ = true;
+        }
+        return waiting_auth_;
+    }
+
+    // 이하 세션 strand에서만 호출
+    // 송신 큐에 메시지를 넣고, 진행 중인 쓰기가 없으면 async_write 시작
+    // 큐가 가득 찬 느린 수신자는 메시지를 버리고, 계속 밀리면 연결을 끊는다
+    void enqueue(OutboundMessage message) {
+        if (closed_) {
+            return;
+        }
+        if (protocol_ == Protocol::binary && message.payload->size() > BINARY_MAX_PAYLOAD) {
+            CHAT_LOG_WARN << "Message too large for binary frame (" << message.payload->size() << " bytes), dropped";
+            return;
+        }
+        if (write_queue_.size() >= WRITE_QUEUE_HIGH_WATER) {
+            server_metrics().messages_dropped.add();
+            if (++dropped_messages_ >= SLOW_CONSUMER_DROP_LIMIT) {
+                CHAT_LOG_WARN << "Disconnecting slow consumer (" << dropped_messages_ << " messages dropped)";
+                server_metrics().slow_consumer_disconnects.add();
+                do_close();
+            }
+            return;
+        }
+
+        bool write_in_progress = !write_queue_.empty();
+        write_queue_.push_back(move(message));
+        if (!write_in_progress) {
+            do_write();
+        }
+    }
+
+    void enqueue_payload(const SharedMessage& message, const SharedMessage& compressed, CommandType type) {
+        if (compressed && compresses(message->size())) {
+            server_metrics().compressed_frames.add();
+            server_metrics().compression_saved_bytes.add(message->size() - compressed->size());
+            enqueue(OutboundMessage{ compressed, type, true });
+        }
+        else {
+            enqueue(OutboundMessage{ message, type });
+        }
+    }
+
+    // 핸드셰이크 / heartbeat / idle 마감을 확인하고 다음 마감을 예약 (세션 strand에서)
+    void check_deadlines();
+
+    void do_close() {
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+        // 전송 중인 앞쪽 메시지들은 async_write 가 끝날 때까지 살아 있어야 하므로 나머지만 버린다
+        write_queue_.erase(write_queue_.begin() + writing_count_, write_queue_.end());
+
+        // 소켓을 닫으면 대기 중인 do_read가 에러로 끝나면서 방에서 나가게 된다
+        boost::system::error_code ignored;
+        socket_.shutdown(tcp::socket::shutdown_both, ignored);
+        socket_.close(ignored);
+    }
+
+    // 큐 앞에서부터 WRITE_BATCH_MAX 개까지 복사 없이 한 번에 보낸다
+    // deque 는 push_back 해도 기존 원소의 참조가 유지되므로 전송 중에 큐에 더 넣어도 된다
+    void do_write() {
         auto self = shared_from_this();
-        boost::asio::async_read_until(socket_, boost::asio::dynamic_buffer(buffer_), "\n",
-            [this, self](boost::system::error_code ec, size_t length) {
+        writing_count_ = min(write_queue_.size(), WRITE_BATCH_MAX);
+        write_buffers_.clear();
+        for (size_t i = 0; i < writing_count_; ++i) {
+            const OutboundMessage& message = write_queue_[i];
+            const string& payload = *message.payload;
+
+            // 텍스트는 본문 뒤에 구분자, 바이너리는 본문 앞에 프레임 헤더를 붙여 보낸다
+            if (protocol_ == Protocol::binary) {
+                encode_frame_header(write_headers_[i].data(), message.type, payload.size(), message.compressed ? FRAME_FLAG_COMPRESSED : 0);
+                write_buffers_.push_back(boost::asio::buffer(write_headers_[i]));
+                write_buffers_.push_back(boost::asio::buffer(payload));
+            }
+            else {
+                write_buffers_.push_back(boost::asio::buffer(payload));
+                write_buffers_.push_back(boost::asio::buffer(MESSAGE_DELIMITER, 1));
+            }
+        }
+        server_metrics().write_batches.add();
+        boost::asio::async_write(socket_, write_buffers_, make_custom_alloc_handler(write_memory_,
+            [this, self](boost::system::error_code ec, size_t /*length*/) {
+                if (closed_) {
+                    return;
+                }
                 if (!ec) {
-                    string data = buffer_.substr(0, length - 1);
-                    buffer_.erase(0, length);
+                    write_queue_.erase(write_queue_.begin(), write_queue_.begin() + writing_count_);
+                    server_metrics().messages_sent.add(writing_count_);
+                    writing_count_ = 0;
+                    dropped_messages_ = 0;
+                    if (!write_queue_.empty()) {
+                        do_write();
+                    }
+                    else if (draining_) {
+                        do_close();
+                    }
+                }
+                else {
+                    do_close();
+                }
+            }));
+    }
+
+    tcp::socket socket_;
+    ChatServer& server_;
+    int room_id_ = 0;
+    int user_id_ = 0;
+    ReceiveBuffer buffer_;
+    HandlerMemory read_memory_;        // do_read 핸들러 전용 메모리
+    HandlerMemory write_memory_;       // do_write 핸들러 전용 메모리
+    Protocol protocol_ = Protocol::negotiating;
+    array<array<uint8_t, BINARY_HEADER_SIZE>, WRITE_BATCH_MAX> write_headers_{}; // 전송 중인 바이너리 프레임 헤더
+    vector<boost::asio::const_buffer> write_buffers_; // 전송 중인 묶음의 gather 버퍼, 용량은 재사용
+    deque<OutboundMessage> write_queue_; // 전송 대기 중인 메시지 (앞의 writing_count_ 개가 전송 중)
+    size_t writing_count_ = 0;
+    size_t dropped_messages_ = 0;     // 큐가 가득 차서 연속으로 버린 메시지 수
+    uint64_t codecs_ = 0;             // 협상한 압축, 0 이면 압축하지 않음
+    size_t compress_min_size_ = 0;
+    const RateLimits& limits_;
+    TokenBucket rate_limit_;          // 세션 strand 에서만 사용
+    TokenBucket::Clock::time_point received_at_; // 마지막으로 읽기가 끝난 시각
+    size_t rate_limited_ = 0;         // 연속으로 거절한 명령 수
+    int authenticated_user_id_ = 0;   // 로그인으로 확인된 user_id
+    unsigned auth_pending_ = 0;       // 결과를 기다리는 login_user / create_user
+    bool waiting_auth_ = false;       // 인증 결과를 기다리느라 읽기를 멈췄다
+    uint64_t accepted_tick_ = 0;      // 이하 timing wheel tick
+    uint64_t last_receive_tick_ = 0;  // 무엇이든 받은 마지막 tick
+    uint64_t last_active_tick_ = 0;   // heartbeat 가 아닌 것을 받은 마지막 tick
+    bool ping_outstanding_ = false;
+    bool heartbeat_ = false;          // 바이너리이거나 ping / pong 을 보낸 적이 있다, 이때만 ping 을 보내고 답이 없으면 끊는다
+    bool draining_ = false;
+    bool closed_ = false;
+    shared_ptr<ChatSession> self_;
+    shared_ptr<ChatRoom> room_;
+    shared_ptr<ChatUser> user_;
+};
+
+
+// drain 을 시작하고 나서 세션들이 송신 큐를 비우고 나가기를 기다리는 최대 시간
+const chrono::seconds DRAIN_TIMEOUT{ 10 };
+const chrono::milliseconds DRAIN_POLL_INTERVAL{ 100 };
+const chrono::seconds DRAIN_CLOSE_GRACE{ 2 };   // DRAIN_TIMEOUT 뒤 강제로 닫은 세션들이 빠져나가기를 기다리는 시간
+
+// 수신 대기 소켓들
+// 상위 프로세스 (systemd 소켓 활성화 등) 가 LISTEN_FDS 로 넘겨준 소켓이 있으면 그것들을 그대로 쓴다
+// 직접 열 때는 SO_REUSEPORT 로 같은 포트에 count 개를 열어서 커널이 접속을 나눠 주게 한다 (없는 OS 는 하나)
+// 새 프로세스가 같은 포트로 먼저 뜬 뒤 이전 프로세스를 drain 할 수 있는 것도 SO_REUSEPORT 덕분
+// acceptor 마다 strand 를 붙여서 걸어 둔 accept 들의 핸들러가 같은 acceptor 를 동시에 만지지 않게 한다
+vector<tcp::acceptor> open_listeners(boost::asio::io_context& io_context, const tcp::endpoint& endpoint, unsigned count, int backlog) {
+    vector<tcp::acceptor> listeners;
+#ifndef _WIN32
+    const char* listen_pid = getenv("LISTEN_PID");
+    const char* listen_fds = getenv("LISTEN_FDS");
+    int pid = 0;
+    int fds = 0;
+    if (listen_pid && listen_fds && parse_int(string_view(listen_pid), pid) && pid == getpid()
+        && parse_int(string_view(listen_fds), fds) && fds >= 1) {
+        const int SD_LISTEN_FDS_START = 3;
+        for (int i = 0; i < fds; ++i) {
+            listeners.emplace_back(boost::asio::make_strand(io_context));
+            listeners.back().assign(endpoint.protocol(), SD_LISTEN_FDS_START + i);
+        }
+        CHAT_LOG_INFO << "Using " << fds << " listening sockets passed by the parent process";
+        return listeners;
+    }
+#endif
+#ifndef SO_REUSEPORT
+    count = 1;
+#endif
+    for (unsigned i = 0; i < max(count, 1u); ++i) {
+        tcp::acceptor acceptor(boost::asio::make_strand(io_context));
+        acceptor.open(endpoint.protocol());
+        acceptor.set_option(tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+        acceptor.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+        acceptor.bind(endpoint);
+        acceptor.listen(backlog);
+        listeners.push_back(move(acceptor));
+    }
+    return listeners;
+}
+
+// 접속마다 소켓 옵션 적용, 실패해도 연결은 그대로 쓴다
+void configure_socket(tcp::socket& socket, const SocketOptions& options) {
+    boost::system::error_code ignored;
+    socket.set_option(tcp::no_delay(options.no_delay), ignored);
+    socket.set_option(boost::asio::socket_base::keep_alive(options.keep_alive), ignored);
+    if (options.send_buffer > 0) {
+        socket.set_option(boost::asio::socket_base::send_buffer_size(options.send_buffer), ignored);
+    }
+    if (options.receive_buffer > 0) {
+        socket.set_option(boost::asio::socket_base::receive_buffer_size(options.receive_buffer), ignored);
+    }
+}
+
+MessageWriterConfig message_writer_config(const ServerConfig& config) {
+    MessageWriterConfig writer;
+    writer.inbox_max_per_user = config.inbox.max_per_user;
+    writer.inbox_ttl = config.inbox.ttl;
+    return writer;
+}
+
+// 채팅 서버 클래스
+class ChatServer {
+public:
+    // config.threads 는 main 에서 실제 io 스레드 수로 채워서 넘긴다
+    ChatServer(boost::asio::io_context& io_context, const ServerConfig& config, ClusterConfig cluster = {})
+        : io_context_(io_context), config_(config), message_writer_(message_writer_config(config)),
+        auth_(config.auth_threads, AUTH_CACHE_CAPACITY),
+        search_(config.search_threads), history_(config.history_threads), archiver_(config_.archive), receipts_(config.receipt_flush),
+        session_timers_(io_context, SESSION_TIMER_TICK, SESSION_TIMER_SLOTS),
+        accept_rate_(config.accept_rate, config.accept_burst), drain_timer_(io_context) {
+        // 서버 시작 시 데이터베이스 초기화, 스키마가 맞지 않으면 기록/조회가 깨지므로 시작하지 않는다
+        if (!initialize_database()) {
+            throw runtime_error("Failed to initialize database");
+        }
+        if (!resume_tokens_.load_or_create(RESUME_KEY_FILE)) {
+            throw runtime_error("Failed to load resume key");
+        }
+        if (!talk_partitions().load(DBConnection::for_this_thread())) {
+            throw runtime_error("Failed to load talk partitions");
+        }
+        auth_.warm(AUTH_CACHE_WARM);
+        message_writer_.set_commit_listener([this](vector<StoredTalk>& talks) {
+            on_talks_committed(talks);
+        });
+        message_writer_.start();
+        archiver_.start();
+        receipts_.start();
+
+        if (cluster.enabled()) {
+            cluster_ = make_unique<ClusterBus>(io_context_, move(cluster));
+            cluster_->set_handlers(
+                [this](int room_id, int user_id, SharedMessage text) {
+                    publish_text(find_room(room_id), room_id, user_id, move(text));
+                },
+                [this](int room_id, SharedMessage text) {
+                    if (auto room = find_room(room_id)) {
+                        room->broadcast(text);
+                    }
+                });
+            cluster_->start();
+        }
+        session_timers_.start();
+
+        tcp::endpoint endpoint(tcp::v4(), config_.port);
+        for (auto& acceptor : open_listeners(io_context_, endpoint, config_.acceptors ? config_.acceptors : config_.threads, config_.backlog)) {
+            auto listener = make_unique<Listener>(move(acceptor));
+            for (unsigned i = 0; i < config_.accepts_per_acceptor; ++i) {
+                listener->slots.push_back(make_unique<AcceptSlot>(*listener));
+            }
+            listeners_.push_back(move(listener));
+        }
+        for (auto& listener : listeners_) {
+            for (auto& slot : listener->slots) {
+                do_accept(*slot);
+            }
+        }
+    }
+
+    size_t listener_count() const { return listeners_.size(); }
 
-                    // room_id와 user_id 파싱
-                    parse_initial_data(data);
+    ~ChatServer() {
+        // 기록 스레드가 콜백으로 rooms_ 를 만지므로 멤버들이 사라지기 전에 먼저 멈춘다
+        finish_drain();
+    }
 
-                    // ChatServer를 통해 적절한 방 찾기
-                    ChatRoom& room = server_.get_or_create_room(room_id_);
-                    room.join(self);
+    // io 스레드가 모두 끝난 뒤에 호출, 더 넣을 스레드가 없으므로 남은 기록 배치와 읽음 표시를 DB 에 쓰고 멈춘다
+    void finish_drain() {
+        message_writer_.stop();
+        archiver_.stop();
+        receipts_.stop();
+    }
 
-                    do_read();
+    // 재시작 전 정리, 어느 스레드에서든 한 번만
+    // accept 를 멈추고 (클러스터 포트 포함), 세션마다 재접속 토큰을 보낸 뒤 송신 큐가 비면 닫고,
+    // 모두 나가거나 DRAIN_TIMEOUT 이 지나면 남은 세션을 닫고, 그 세션들이 나간 뒤 on_drained 를 부른다
+    // 기록 스레드들은 여기서 멈추지 않는다, io 스레드가 모두 끝난 뒤 main 에서 finish_drain 으로
+    void drain(function<void()> on_drained) {
+        if (draining_.exchange(true)) {
+            return;
+        }
+        CHAT_LOG_INFO << "Draining: no longer accepting connections";
+        for (auto& listener : listeners_) {
+            Listener* target = listener.get();
+            boost::asio::dispatch(target->acceptor.get_executor(), [target]() {
+                boost::system::error_code ignored;
+                target->acceptor.close(ignored);
+                for (auto& slot : target->slots) {
+                    slot->pause.cancel();
                 }
-                else {
-                    cerr << "Error reading initial data: " << ec.message() << endl;
+            });
+        }
+        if (cluster_) {
+            cluster_->close_listener();
+        }
+        for (auto& session : registered_sessions()) {
+            session->drain();
+        }
+        drain_deadline_ = chrono::steady_clock::now() + DRAIN_TIMEOUT;
+        wait_drained(move(on_drained));
+    }
+
+    bool draining() const { return draining_.load(memory_order_relaxed); }
+    bool requires_auth() const { return config_.require_auth; }
+    chrono::minutes idle_timeout() const { return config_.idle_timeout; }
+
+    // 세션 strand에서 호출
+    SharedMessage resume_message(bool binary, int user_id, int room_id, bool authenticated) const {
+        return encode_resume_token(binary, resume_tokens_.issue(user_id, room_id, authenticated));
+    }
+
+    // 채팅 메시지 저장은 기록 스레드에 넘기고 바로 반환
+    // 브로드캐스트한 버퍼를 그대로 넘기므로 복사가 없다
+    void save_message(int room_id, int user_id, SharedMessage text) {
+        message_writer_.enqueue(room_id, user_id, move(text));
+    }
+
+    // 기록 스레드에서 호출, 열려 있는 방의 최근 메시지 캐시에 방별로 한 번씩 넘긴다
+    void on_talks_committed(vector<StoredTalk>& talks) {
+        receipts_.on_committed(talks);
+        stable_sort(talks.begin(), talks.end(), [](const StoredTalk& a, const StoredTalk& b) {
+            return a.room_id < b.room_id;
+        });
+        for (auto first = talks.begin(); first != talks.end();) {
+            int room_id = first->room_id;
+            auto last = find_if(first, talks.end(), [room_id](const StoredTalk& talk) {
+                return talk.room_id != room_id;
+            });
+            if (auto room = find_room(room_id)) {
+                room->remember(vector<StoredTalk>(make_move_iterator(first), make_move_iterator(last)));
+            }
+            first = last;
+        }
+    }
+
+    const MessageWriter& message_writer() const { return message_writer_; }
+    TimingWheel<ChatSession>& session_timers() { return session_timers_; }
+
+    // 관리용 포트에서 scrape 할 때 호출, Prometheus 텍스트 형식
+    string render_metrics() {
+        ServerMetrics& metrics = server_metrics();
+        string out;
+        write_metric_header(out, "chat_accepts_total", "counter", "Accepted client connections.");
+        write_metric_sample(out, "chat_accepts_total", "", metrics.accepts.value());
+        write_metric_header(out, "chat_active_sessions", "gauge", "Client sessions currently alive.");
+        write_metric_sample(out, "chat_active_sessions", "", metrics.active_sessions.value());
+        write_metric_header(out, "chat_messages_received_total", "counter", "Lines or frames received from clients.");
+        write_metric_sample(out, "chat_messages_received_total", "", metrics.messages_received.value());
+        write_metric_header(out, "chat_messages_sent_total", "counter", "Messages fully written to client sockets.");
+        write_metric_sample(out, "chat_messages_sent_total", "", metrics.messages_sent.value());
+        write_metric_header(out, "chat_write_batches_total", "counter", "Gather writes issued; messages_sent / write_batches is the average batch.");
+        write_metric_sample(out, "chat_write_batches_total", "", metrics.write_batches.value());
+        write_metric_header(out, "chat_io_backend", "gauge", "Socket I/O backend this binary was built with.");
+        write_metric_sample(out, "chat_io_backend", string("backend=\"") + IO_BACKEND + "\"", 1);
+        write_metric_header(out, "chat_messages_dropped_total", "counter", "Messages dropped because a send queue was full.");
+        write_metric_sample(out, "chat_messages_dropped_total", "", metrics.messages_dropped.value());
+        write_metric_header(out, "chat_slow_consumer_disconnects_total", "counter", "Sessions closed for falling too far behind.");
+        write_metric_sample(out, "chat_slow_consumer_disconnects_total", "", metrics.slow_consumer_disconnects.value());
+        write_metric_header(out, "chat_connections_rejected_total", "counter", "Connections closed at accept because the connection limit was reached.");
+        write_metric_sample(out, "chat_connections_rejected_total", "", metrics.connections_rejected.value());
+        write_metric_header(out, "chat_listeners", "gauge", "Listening sockets accepting client connections.");
+        write_metric_sample(out, "chat_listeners", "", listeners_.size());
+        write_metric_header(out, "chat_accept_pauses_total", "counter", "Times accepting paused for the accept rate limit.");
+        write_metric_sample(out, "chat_accept_pauses_total", "", metrics.accept_pauses.value());
+        write_metric_header(out, "chat_rate_limited_total", "counter", "Commands dropped by a rate limit.");
+        write_metric_sample(out, "chat_rate_limited_total", "scope=\"user\"", metrics.user_rate_limited.value());
+        write_metric_sample(out, "chat_rate_limited_total", "scope=\"room\"", metrics.room_rate_limited.value());
+        write_metric_header(out, "chat_abuse_disconnects_total", "counter", "Sessions closed for staying over the rate limit.");
+        write_metric_sample(out, "chat_abuse_disconnects_total", "", metrics.abuse_disconnects.value());
+        write_metric_header(out, "chat_presence_flushes_total", "counter", "Coalesced join/leave notices broadcast to a room.");
+        write_metric_sample(out, "chat_presence_flushes_total", "", metrics.presence_flushes.value());
+        write_metric_header(out, "chat_presence_suppressed_total", "counter", "Joins and leaves not announced because the room was too large.");
+        write_metric_sample(out, "chat_presence_suppressed_total", "", metrics.presence_suppressed.value());
+        write_metric_header(out, "chat_resumes_total", "counter", "Reconnects that presented a resume token.");
+        write_metric_sample(out, "chat_resumes_total", "result=\"ok\"", metrics.resumed_sessions.value());
+        write_metric_sample(out, "chat_resumes_total", "result=\"rejected\"", metrics.resume_failures.value());
+        write_metric_header(out, "chat_unauthenticated_joins_total", "counter", "Handshakes refused because the user id was not the logged in one.");
+        write_metric_sample(out, "chat_unauthenticated_joins_total", "", metrics.unauthenticated_joins.value());
+        write_metric_header(out, "chat_compressions_total", "counter", "Payloads run through the compressor (once per broadcast).");
+        write_metric_sample(out, "chat_compressions_total", "", metrics.compressions.value());
+        write_metric_header(out, "chat_compressed_frames_total", "counter", "Frames queued to clients in compressed form.");
+        write_metric_sample(out, "chat_compressed_frames_total", "", metrics.compressed_frames.value());
+        write_metric_header(out, "chat_compression_saved_bytes_total", "counter", "Bytes saved by compressing outbound frames.");
+        write_metric_sample(out, "chat_compression_saved_bytes_total", "", metrics.compression_saved_bytes.value());
+        write_metric_header(out, "chat_draining", "gauge", "1 while the server is draining before a restart.");
+        write_metric_sample(out, "chat_draining", "", draining() ? 1 : 0);
+        write_metric_header(out, "chat_session_timeouts_total", "counter", "Sessions closed by a deadline.");
+        write_metric_sample(out, "chat_session_timeouts_total", "reason=\"handshake\"", metrics.handshake_timeouts.value());
+        write_metric_sample(out, "chat_session_timeouts_total", "reason=\"heartbeat\"", metrics.heartbeat_timeouts.value());
+        write_metric_sample(out, "chat_session_timeouts_total", "reason=\"idle\"", metrics.idle_timeouts.value());
+        write_metric_header(out, "chat_session_timers_pending", "gauge", "Deadlines waiting in the session timing wheel.");
+        write_metric_sample(out, "chat_session_timers_pending", "", session_timers_.pending());
+        write_metric_header(out, "chat_log_dropped_total", "counter", "Log lines dropped because a logger ring was full.");
+        write_metric_sample(out, "chat_log_dropped_total", "", Logger::instance().dropped());
+        write_histogram(out, "chat_broadcast_fanout_seconds", "Time to queue one broadcast to every room member.",
+            metrics.broadcast_fanout.snapshot());
+
+        MessageWriterStats writer = message_writer_.stats();
+        write_histogram(out, "chat_db_batch_seconds", "Time of one message writer transaction.",
+            message_writer_.batch_latency().snapshot());
+        write_histogram(out, "chat_auth_seconds", "Time to handle one login or signup on the auth pool.",
+            auth_.latency().snapshot());
+        write_histogram(out, "chat_search_seconds", "Time to run one search_text query on the search pool.",
+            search_.latency().snapshot());
+        write_metric_header(out, "chat_search_rejected_total", "counter", "Searches refused because the search pool was full.");
+        write_metric_sample(out, "chat_search_rejected_total", "", search_.rejected());
+        write_metric_header(out, "chat_search_failed_total", "counter", "Searches that failed in the database.");
+        write_metric_sample(out, "chat_search_failed_total", "", search_.failed());
+        write_histogram(out, "chat_history_load_seconds", "Time to read one history page or room cache fill on the history pool.",
+            history_.latency().snapshot());
+        write_metric_header(out, "chat_history_rejected_total", "counter", "History reads answered empty because the history pool was full.");
+        write_metric_sample(out, "chat_history_rejected_total", "", history_.rejected());
+        write_metric_header(out, "chat_inbox_stored_total", "counter", "Notices kept in the offline inbox for users who were not connected.");
+        write_metric_sample(out, "chat_inbox_stored_total", "", writer.inbox_written);
+        write_metric_header(out, "chat_inbox_dropped_total", "counter", "Inbox notices deleted undelivered for exceeding the per-user cap or the TTL.");
+        write_metric_sample(out, "chat_inbox_dropped_total", "", writer.inbox_dropped);
+        write_metric_header(out, "chat_inbox_delivered_total", "counter", "Inbox notices sent in bulk when their user joined a room.");
+        write_metric_sample(out, "chat_inbox_delivered_total", "", metrics.inbox_delivered.value());
+        write_metric_header(out, "chat_receipts_written_total", "counter", "Read receipt rows written in batches.");
+        write_metric_sample(out, "chat_receipts_written_total", "", receipts_.written());
+        write_metric_header(out, "chat_receipt_write_failures_total", "counter", "Read receipt batches that failed and were kept for the next flush.");
+        write_metric_sample(out, "chat_receipt_write_failures_total", "", receipts_.write_failures());
+        write_metric_header(out, "chat_unread_recounts_total", "counter", "Unread counts recomputed from the database instead of memory.");
+        write_metric_sample(out, "chat_unread_recounts_total", "", receipts_.recounts());
+        write_metric_header(out, "chat_unread_rejected_total", "counter", "unread_summary requests refused because too many were queued.");
+        write_metric_sample(out, "chat_unread_rejected_total", "", receipts_.rejected());
+        write_metric_header(out, "chat_receipts_tracked", "gauge", "User and room read positions held in memory.");
+        write_metric_sample(out, "chat_receipts_tracked", "", receipts_.tracked());
+        write_metric_header(out, "chat_auth_cache_hits_total", "counter", "User lookups served from the cache.");
+        write_metric_sample(out, "chat_auth_cache_hits_total", "", auth_.cache_hits());
+        write_metric_header(out, "chat_auth_cache_misses_total", "counter", "User lookups that read the users table.");
+        write_metric_sample(out, "chat_auth_cache_misses_total", "", auth_.cache_misses());
+        write_metric_header(out, "chat_auth_coalesced_loads_total", "counter", "User lookups that waited for an identical load.");
+        write_metric_sample(out, "chat_auth_coalesced_loads_total", "", auth_.coalesced_loads());
+        write_metric_header(out, "chat_auth_rejected_total", "counter", "Auth requests refused because the pool was full.");
+        write_metric_sample(out, "chat_auth_rejected_total", "", auth_.rejected());
+        write_metric_header(out, "chat_auth_cached_users", "gauge", "Users held in the auth cache.");
+        write_metric_sample(out, "chat_auth_cached_users", "", auth_.cache().size());
+        write_metric_header(out, "chat_archive_rows_total", "counter", "Talks moved from the hot table into monthly archive files.");
+        write_metric_sample(out, "chat_archive_rows_total", "", archiver_.archived_rows());
+        write_metric_header(out, "chat_archive_failures_total", "counter", "Archive runs that stopped on a database error.");
+        write_metric_sample(out, "chat_archive_failures_total", "", archiver_.failures());
+        write_metric_header(out, "chat_archive_partitions", "gauge", "Frozen monthly archive files.");
+        write_metric_sample(out, "chat_archive_partitions", "", talk_partitions().size());
+        write_metric_header(out, "chat_db_queue_depth", "gauge", "Messages waiting for the message writer.");
+        write_metric_sample(out, "chat_db_queue_depth", "", writer.queue_depth);
+        write_metric_header(out, "chat_db_max_queue_depth", "gauge", "Highest message writer queue depth seen.");
+        write_metric_sample(out, "chat_db_max_queue_depth", "", writer.max_queue_depth);
+        write_metric_header(out, "chat_db_messages_written_total", "counter", "Messages committed to the talks table.");
+        write_metric_sample(out, "chat_db_messages_written_total", "", writer.written);
+        write_metric_header(out, "chat_db_messages_failed_total", "counter", "Messages the writer failed to store.");
+        write_metric_sample(out, "chat_db_messages_failed_total", "", writer.failed);
+
+        vector<shared_ptr<ChatRoom>> rooms;
+        vector<size_t> members;
+        {
+            lock_guard<mutex> lock(rooms_mutex_);
+            for (const auto& entry : rooms_) {
+                rooms.push_back(entry.second);
+                members.push_back(entry.second->member_count());
+            }
+        }
+        write_metric_header(out, "chat_rooms_open", "gauge", "Rooms with at least one session on this node.");
+        write_metric_sample(out, "chat_rooms_open", "", rooms.size());
+        write_metric_header(out, "chat_room_members", "gauge", "Sessions in each open room on this node.");
+        for (size_t i = 0; i < rooms.size(); ++i) {
+            write_metric_sample(out, "chat_room_members", "room_id=\"" + to_string(rooms[i]->room_id()) + "\"", members[i]);
+        }
+        write_metric_header(out, "chat_room_messages_in_total", "counter", "Messages broadcast in each open room.");
+        for (const auto& room : rooms) {
+            write_metric_sample(out, "chat_room_messages_in_total", "room_id=\"" + to_string(room->room_id()) + "\"", room->messages_in());
+        }
+        write_metric_header(out, "chat_room_messages_out_total", "counter", "Messages queued to members of each open room.");
+        for (const auto& room : rooms) {
+            write_metric_sample(out, "chat_room_messages_out_total", "room_id=\"" + to_string(room->room_id()) + "\"", room->messages_out());
+        }
+        return out;
+    }
+
+    // 방에 보낸 채팅 메시지 하나를 처리 (room 은 이 노드에 열려 있지 않으면 nullptr)
+    // 클러스터 모드에서 다른 노드가 소유한 방이면 소유 노드로 넘기고,
+    // 소유 노드가 순서를 정해서 다시 보내 줄 때 이 노드의 멤버에게 전달된다
+    void publish_text(const shared_ptr<ChatRoom>& room, int room_id, int user_id, SharedMessage payload) {
+        if (cluster_ && !cluster_->owns(room_id)) {
+            cluster_->publish(room_id, user_id, payload);
+            return;
+        }
+        if (room) {
+            room->broadcast(payload);
+        }
+        if (cluster_) {
+            cluster_->deliver_to_subscribers(room_id, payload);
+        }
+        save_message(room_id, user_id, move(payload));
+    }
+
+    // 이미 열려 있는 방만 찾는다 (입장 인원은 바꾸지 않음)
+    shared_ptr<ChatRoom> find_room(int room_id) {
+        lock_guard<mutex> lock(rooms_mutex_);
+        auto it = rooms_.find(room_id);
+        return it != rooms_.end() ? it->second : nullptr;
+    }
+
+    // 특정 room_id에 해당하는 ChatRoom을 반환 (없으면 생성)
+    // 입장하는 세션 수를 같은 잠금 안에서 올려서 remove_empty_room 과 경쟁하지 않게 한다
+    shared_ptr<ChatRoom> get_or_create_room(int room_id) {
+        lock_guard<mutex> lock(rooms_mutex_);
+        auto it = rooms_.find(room_id);
+        if (it == rooms_.end()) {
+            it = rooms_.emplace(room_id, make_shared<ChatRoom>(io_context_, room_id, config_.limits, config_.presence, history_)).first;
+        }
+        it->second->add_occupant();
+        report_membership(room_id, it->second->member_count());
+        return it->second;
+    }
+
+    // 세션 하나가 방을 나갔음을 기록하고, 아무도 없으면 방을 제거
+    void remove_empty_room(int room_id) {
+        lock_guard<mutex> lock(rooms_mutex_);
+        auto it = rooms_.find(room_id);
+        if (it == rooms_.end()) {
+            return;
+        }
+        it->second->remove_occupant();
+        report_membership(room_id, it->second->member_count());
+        if (it->second->member_count() == 0) {
+            rooms_.erase(it);
+            CHAT_LOG_DEBUG << "Room " << room_id << " has been removed (no members).";
+        }
+    }
+
+    // 방에 입장한 세션을 user_id, (room_id, user_id) 로 바로 찾을 수 있게 등록
+    // 같은 user_id 로 다시 접속하면 새 세션이 이전 세션을 대신한다
+    void register_session(const shared_ptr<ChatSession>& session, int room_id, int user_id) {
+        unique_lock<shared_mutex> lock(users_mutex_);
+        sessions_[user_id] = session;
+        room_sessions_[room_user_key(room_id, user_id)] = session;
+    }
+
+    // 방에서 나가거나 연결이 끊길 때, 그 사이 다른 세션이 등록됐으면 그대로 둔다
+    void unregister_session(const shared_ptr<ChatSession>& session, int room_id, int user_id) {
+        unique_lock<shared_mutex> lock(users_mutex_);
+        auto it = sessions_.find(user_id);
+        if (it != sessions_.end() && it->second == session) {
+            sessions_.erase(it);
+        }
+        auto room_it = room_sessions_.find(room_user_key(room_id, user_id));
+        if (room_it != room_sessions_.end() && room_it->second == session) {
+            room_sessions_.erase(room_it);
+        }
+    }
+
+    shared_ptr<ChatSession> find_session(int user_id) {
+        shared_lock<shared_mutex> lock(users_mutex_);
+        auto it = sessions_.find(user_id);
+        return it != sessions_.end() ? it->second : nullptr;
+    }
+
+    // 받을 세션이 없는 귓속말 / 초대는 inbox 에 남겨서 다음 입장 때 보낸다
+    void store_offline(int to_user_id, CommandType kind, int from_user_id, int room_id, string_view text) {
+        if (!config_.inbox.enabled || to_user_id <= 0) {
+            CHAT_LOG_WARN << "User " << to_user_id << " is not connected";
+            return;
+        }
+        CHAT_LOG_DEBUG << "User " << to_user_id << " is not connected, keeping the notice in the inbox";
+        message_writer_.enqueue_inbox(to_user_id, static_cast<uint8_t>(kind), from_user_id, room_id,
+            text.empty() ? nullptr : make_shared_message(string(text)));
+    }
+
+    // 로그인한 user_id 로 입장한 세션에게 inbox 를 한 번에 보낸다, 세션 strand 에서
+    // 읽기와 지우기는 기록 스레드가 한 트랜잭션에서 하므로 io 스레드는 DB 를 기다리지 않고, 같은 알림이 두 번 나가지 않는다
+    void deliver_inbox(const shared_ptr<ChatSession>& session) {
+        if (!config_.inbox.enabled || session->user_id() == 0 || session->authenticated_user_id() != session->user_id()) {
+            return;
+        }
+        time_t oldest = time(nullptr) - chrono::duration_cast<chrono::seconds>(config_.inbox.ttl).count();
+        message_writer_.take_inbox(session->user_id(), oldest, static_cast<int>(config_.inbox.max_per_user),
+            [session](vector<InboxEntry> entries) {
+                if (entries.empty()) {
+                    return;
+                }
+                for (auto& frame : encode_inbox(session->is_binary(), entries)) {
+                    session->deliver(frame, CommandType::deliver_inbox);
                 }
+                server_metrics().inbox_delivered.add(entries.size());
             });
     }
 
-    void parse_initial_data(const string& data) {
-        auto comma_pos = data.find(',');
-        if (comma_pos != string::npos) {
-            room_id_ = stoi(data.substr(0, comma_pos));
-            //user_id_ = stoi(data.substr(comma_pos + 1));
+    shared_ptr<ChatSession> find_room_session(int room_id, int user_id) {
+        shared_lock<shared_mutex> lock(users_mutex_);
+        auto it = room_sessions_.find(room_user_key(room_id, user_id));
+        return it != room_sessions_.end() ? it->second : nullptr;
+    }
+
+private:
+    struct Listener;
+
+    // acceptor 하나에 동시에 걸어 두는 accept 하나, 핸들러 메모리와 쉬는 타이머를 따로 가진다
+    struct AcceptSlot {
+        explicit AcceptSlot(Listener& owner) : listener(owner), pause(owner.acceptor.get_executor()) {}
+
+        Listener& listener;
+        boost::asio::steady_timer pause;
+        HandlerMemory memory;
+    };
+
+    struct Listener {
+        explicit Listener(tcp::acceptor socket) : acceptor(move(socket)) {}
+
+        tcp::acceptor acceptor;
+        vector<unique_ptr<AcceptSlot>> slots;
+    };
+
+    // rooms_mutex_ 를 잡은 상태에서 호출하므로 같은 방의 인원 변경은 보낸 순서대로 도착한다
+    void report_membership(int room_id, size_t count) {
+        if (cluster_ && !cluster_->owns(room_id)) {
+            cluster_->report_membership(room_id, count);
+        }
+    }
+
+    static uint64_t room_user_key(int room_id, int user_id) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(room_id)) << 32) | static_cast<uint32_t>(user_id);
+    }
+
+    // 요청한 세션이 명령에 적힌 사용자로 그 방에 들어가 있는지
+    static bool acts_in_room(const shared_ptr<ChatSession>& session, const ChatCommand& command) {
+        return session->room() && session->room_id() == command.room_id && session->user_id() == command.user_id;
+    }
+
+    // 걸어 둔 accept 하나를 계속 이어 간다, 핸들러는 listener 의 strand 에서 돈다
+    void do_accept(AcceptSlot& slot) {
+        if (draining()) {
+            return;
         }
-        else {
-            cerr << "Invalid data format: " << data << endl;
+        // 초당 접속 수를 넘으면 토큰이 생길 때까지 accept 를 쉬고, 그동안 온 연결은 커널 backlog 에서 기다린다
+        auto now = SharedRateLimiter::Clock::now();
+        if (!accept_rate_.try_acquire(now)) {
+            server_metrics().accept_pauses.add();
+            pause_accept(slot, accept_rate_.time_until(now));
+            return;
         }
-    }
 
-    void do_read() {
-        auto self = shared_from_this();
-        boost::asio::async_read_until(socket_, boost::asio::dynamic_buffer(buffer_), "\n",
-            [this, self](boost::system::error_code ec, size_t length) {
-                if (!ec) {
-                    string message = buffer_.substr(0, length - 1);
-                    buffer_.erase(0, length);
-                    server_.get_or_create_room(room_id_).broadcast(message);
-                    do_read();
+        // 세션마다 strand를 붙여서 소켓 핸들러가 여러 스레드에서 동시에 돌지 않게 한다
+        slot.listener.acceptor.async_accept(boost::asio::make_strand(io_context_), make_custom_alloc_handler(slot.memory,
+            [this, &slot](boost::system::error_code ec, tcp::socket socket) {
+                if (ec == boost::asio::error::operation_aborted && draining()) {
+                    return;
                 }
-                else {
-                    server_.get_or_create_room(room_id_).leave(self);
+                if (ec) {
+                    CHAT_LOG_WARN << "Accept failed: " << ec.message();
+                    pause_accept(slot, ACCEPT_ERROR_BACKOFF);
+                    return;
                 }
-            });
-    }
-
-    tcp::socket socket_;
-    //ChatServer& server_;
-    int room_id_;
-    string buffer_;
-    shared_ptr<ChatSession> self_;
-    shared_ptr<ChatRoom> room_;
-    shared_ptr<ChatUser> user_;
-};
-
 
-// 채팅 서버 클래스
-class ChatServer {
-public:
-    ChatServer(boost::asio::io_context& io_context, const tcp::endpoint& endpoint)
-        : acceptor_(io_context, endpoint) {
-        initialize_database(); // 서버 시작 시 데이터베이스 초기화
-        do_accept();
+                server_metrics().accepts.add();
+                if (static_cast<size_t>(server_metrics().active_sessions.value()) >= config_.max_connections) {
+                    // backlog 에 묶어 두지 않고 바로 닫아서 클라이언트가 다른 노드로 가거나 나중에 다시 오게 한다
+                    server_metrics().connections_rejected.add();
+                    CHAT_LOG_DEBUG << "Connection limit (" << config_.max_connections << ") reached, closing new connection";
+                    boost::system::error_code ignored;
+                    socket.close(ignored);
+                }
+                else {
+                    configure_socket(socket, config_.socket);
+                    boost::system::error_code endpoint_ec;
+                    tcp::endpoint remote = socket.remote_endpoint(endpoint_ec);
+                    CHAT_LOG_INFO << "New connection from " << remote.address().to_string() << ':' << remote.port();
+
+                    // 세션 객체와 shared_ptr 제어 블록은 스레드별 풀에서 재사용
+                    auto session = allocate_shared<ChatSession>(PoolAllocator<ChatSession>(), move(socket), *this,
+                        config_.max_frame_size, config_.limits);
+                    session->start(session, nullptr);  // ChatSession에서 room_id와 user_id를 받아 방에 입장
+                }
+                do_accept(slot);
+            }));
     }
 
-    // 특정 room_id에 해당하는 ChatRoom을 반환 (없으면 생성)
-    ChatRoom& get_or_create_room(int room_id) {
-        auto it = rooms_.find(room_id);
-        if (it == rooms_.end()) {
-            auto emplace_result = rooms_.emplace(room_id, make_unique<ChatRoom>());
-            auto& new_it = emplace_result.first;  // 삽입된 요소의 반복자
-            bool success = emplace_result.second; // 삽입 성공 여부
-            return *(new_it->second);
-        }
-        return *(it->second);
+    void wait_drained(function<void()> on_drained) {
+        drain_timer_.expires_after(DRAIN_POLL_INTERVAL);
+        drain_timer_.async_wait([this, on_drained = move(on_drained)](boost::system::error_code ec) mutable {
+            if (ec) {
+                return;
+            }
+            vector<shared_ptr<ChatSession>> remaining = registered_sessions();
+            if (!remaining.empty() && chrono::steady_clock::now() < drain_deadline_) {
+                wait_drained(move(on_drained));
+                return;
+            }
+            // 닫는 것은 세션 strand 에서 비동기로 일어나므로, 나가면서 넘긴 기록까지 받도록 한 번 더 기다린다
+            if (!remaining.empty() && !drain_closing_) {
+                CHAT_LOG_WARN << "Drain timed out, closing " << remaining.size() << " sessions";
+                drain_closing_ = true;
+                for (auto& session : remaining) {
+                    session->close();
+                }
+                drain_deadline_ = chrono::steady_clock::now() + DRAIN_CLOSE_GRACE;
+                wait_drained(move(on_drained));
+                return;
+            }
+            if (!remaining.empty()) {
+                CHAT_LOG_WARN << remaining.size() << " sessions did not close in time";
+            }
+            on_drained();
+        });
     }
 
-    void remove_empty_room(int room_id) {
-        auto it = rooms_.find(room_id);
-        if (it != rooms_.end() && it->second->member_count() == 0) {
-            rooms_.erase(it);
-            cout << "Room " << room_id << " has been removed (no members)." << endl;
+    vector<shared_ptr<ChatSession>> registered_sessions() {
+        shared_lock<shared_mutex> lock(users_mutex_);
+        vector<shared_ptr<ChatSession>> out;
+        out.reserve(room_sessions_.size());
+        for (auto& entry : room_sessions_) {
+            out.push_back(entry.second);
         }
+        return out;
     }
 
-    void add_user(shared_ptr<ChatUser> user) {
-        users_[user->get_userID()] = user;
+    void pause_accept(AcceptSlot& slot, SharedRateLimiter::Clock::duration wait) {
+        slot.pause.expires_after(wait);
+        slot.pause.async_wait([this, &slot](boost::system::error_code ec) {
+            if (!ec) {
+                do_accept(slot);
+            }
+        });
     }
+    
+public:
+    // 텍스트 프로토콜 한 줄을 해석해서 처리 (수신 버퍼 위에서 바로 해석, 할당 없음)
+    // 프로토콜 명령이 아니면 false 를 돌려주고, 호출한 쪽에서 일반 채팅으로 처리한다
+    bool check_message(const shared_ptr<ChatSession>& session, string_view message) {
+        string_view command;
+        TextParams params;
+        if (!split_text_command(message, command, params)) {
+            return false;
+        }
 
-    shared_ptr<ChatUser> get_user(int user_id) {
-        auto it = users_.find(user_id);
-        if (it != users_.end()) {
-            return it->second;
+        CommandType type = lookup_text_command(command);
+        if (type == CommandType::unknown) {
+            return false;
         }
-        return nullptr;
-    }
 
-    void remove_user(int user_id) {
-        users_.erase(user_id);
+        ChatCommand parsed;
+        if (!build_text_command(type, params, parsed)) {
+            CHAT_LOG_WARN << "Invalid parameters for " << command;
+            return true;
+        }
+        handle_command(session, parsed);
+        return true;
     }
 
-private:
-    void do_accept() {
-        acceptor_.async_accept(
-            [this](boost::system::error_code ec, tcp::socket socket) {
-                if (!ec) {
-                    cout << "New connection from " << socket.remote_endpoint() << endl;
-
-                    auto session = make_shared<ChatSession>(move(socket), *this);
-                    session->start(session,);  // ChatSession에서 room_id와 user_id를 받아 방에 입장
-                }
-                do_accept();
-            });
-    }
-    
-    void check_message(string message) {
-        size_t delimiter_pos = message.find('?');
-        if (delimiter_pos == string::npos) {
-            cerr << "Invalid message format: " << message << endl;
+    // 텍스트 / 바이너리 공용 명령 처리 (세션 strand에서 호출)
+    void handle_command(const shared_ptr<ChatSession>& session, const ChatCommand& command) {
+        if (command.type != CommandType::ping && command.type != CommandType::pong) {
+            session->mark_active();
+        }
+        if (!session->room() && !usable_before_join(command.type)) {
+            CHAT_LOG_WARN << "Command " << static_cast<int>(command.type) << " before the handshake";
+            session->close();
             return;
         }
 
-        string command = message.substr(0, delimiter_pos);
-        string params = message.substr(delimiter_pos + 1);
+        switch (command.type) {
+        case CommandType::hello:
+            session->negotiate_compression(config_.compression ? command.codecs : 0, config_.compression_min_size);
+            session->join_room(command.room_id, command.user_id);
+            break;
 
-        unordered_map<string, string> param_map;
-        size_t start = 0, end;
-        while ((end = params.find('/', start)) != string::npos) {
-            string pair = params.substr(start, end - start);
-            size_t sep = pair.find(':');
-            if (sep != string::npos) {
-                param_map[pair.substr(0, sep)] = pair.substr(sep + 1);
+        case CommandType::resume: {
+            ResumeToken token;
+            int bound = session->authenticated_user_id();
+            if (session->room() || !resume_tokens_.verify(command.token, token) || (bound != 0 && bound != token.user_id)) {
+                CHAT_LOG_WARN << "Rejected resume token";
+                server_metrics().resume_failures.add();
+                session->close();
+                break;
             }
-            start = end + 1;
+            CHAT_LOG_DEBUG << "User " << token.user_id << " resumed in room " << token.room_id;
+            server_metrics().resumed_sessions.add();
+            if (token.authenticated) {
+                session->bind_user(token.user_id);
+            }
+            session->negotiate_compression(config_.compression ? command.codecs : 0, config_.compression_min_size);
+            session->join_room(token.room_id, token.user_id, false);
+            break;
         }
 
-        if (start < params.size()) {
-            string pair = params.substr(start);
-            size_t sep = pair.find(':');
-            if (sep != string::npos) {
-                param_map[pair.substr(0, sep)] = pair.substr(sep + 1);
+        case CommandType::create_user:
+            CHAT_LOG_DEBUG << "Creating user with id: " << command.id << " and password: " << redacted(command.password);
+            session->begin_auth();
+            auth_.create_user(string(command.id), string(command.password), [session](AuthResult result) {
+                session->on_auth_result(result, encode_auth_result(session->is_binary(), result));
+            });
+            break;
+
+        case CommandType::login_user:
+            CHAT_LOG_DEBUG << "Logging in user with id: " << command.id << " and password: " << redacted(command.password);
+            session->begin_auth();
+            auth_.login(string(command.id), string(command.password), [session](AuthResult result) {
+                session->on_auth_result(result, encode_auth_result(session->is_binary(), result));
+            });
+            break;
+
+        case CommandType::create_room:
+            CHAT_LOG_DEBUG << "Creating room with title: " << command.title;
+            break;
+
+        case CommandType::join_room:
+            CHAT_LOG_DEBUG << "Joining room with id: " << command.room_id;
+            break;
+
+        case CommandType::send_text: {
+            CHAT_LOG_DEBUG << "User " << session->user_id() << " is sending " << command.text.size() << " bytes in room " << command.room_id;
+            // 들어가 있는 방에, 입장한 user_id 로만 보낼 수 있다
+            if (!acts_in_room(session, command)) {
+                CHAT_LOG_WARN << "User " << command.user_id << " is not in room " << command.room_id;
+                break;
+            }
+            auto room = session->room();
+            if (!session->admit(room.get())) {
+                break;
             }
+            publish_text(room, session->room_id(), session->user_id(), make_shared_message(string(command.text)));
+            break;
         }
 
-        // Command 처리
-        if (command.empty()) {
-            cerr << "Empty command received." << endl;
-            return;
-        }
+        case CommandType::exit_room:
+            CHAT_LOG_DEBUG << "User " << command.user_id << " is exiting room " << command.room_id;
+            break;
+
+        case CommandType::fetch_history: {
+            if (!session->admit(nullptr, config_.limits.history_cost)) {
+                break;
+            }
+            int limit = clamp(command.limit, 1, HISTORY_PAGE_MAX);
+            sqlite3_int64 before_id = command.before_id > 0 ? command.before_id : INT64_MAX;
 
-        // Case-based handling
-        switch (command[0]) { // Use the first character for switch cases
-        case 'c': // Covers create_user, create_room, invite_user
-            if (command == "create_user") {
-                string id = param_map["id"];
-                string password = param_map["password"];
-                cout << "Creating user with id: " << id << " and password: " << password << endl;
+            // 열려 있는 방은 캐시부터, 아니면 조회 풀에서 DB를 읽는다 (어느 쪽이든 세션 strand 에서 읽지 않는다)
+            auto room = session->room_id() == command.room_id ? session->room() : nullptr;
+            if (!room) {
+                room = find_room(command.room_id);
             }
-            else if (command == "create_room" || command == "invite_user") {
-                string title = param_map["title"];
-                cout << "Creating room or inviting with title: " << title << endl;
+            if (room) {
+                room->fetch_history(session, before_id, limit);
+            }
+            else {
+                int room_id = command.room_id;
+                history_.load(room_id, before_id, limit, [session, room_id](vector<StoredTalk> talks) {
+                    session->deliver(encode_history_page(session->is_binary(), room_id, talks), CommandType::history_result);
+                });
             }
             break;
+        }
 
+        case CommandType::search_text: {
+            if (!session->admit(nullptr, config_.limits.search_cost)) {
+                break;
+            }
+            int room_id = command.room_id;
+            int offset = clamp(command.offset, 0, SEARCH_OFFSET_MAX);
+            int limit = clamp(command.limit, 1, SEARCH_PAGE_MAX);
+            search_.search(room_id, string(command.text), offset, limit, [session, room_id, offset](SearchResult result) {
+                session->deliver(encode_search_page(session->is_binary(), room_id, offset, result.talks), CommandType::search_result);
+            });
+            break;
+        }
 
-
-        case 'l': // Covers login_user  
-            if (command == "login_user") {
-                string id = param_map["id"];
-                string password = param_map["password"];
-                cout << "Logging in user with id: " << id << " and password: " << password << endl;
+        // 읽음 표시는 그 유저의 것이므로 핸드셰이크에 적은 user_id 가 아니라 로그인한 user_id 일 때만 (deliver_inbox 와 같다)
+        case CommandType::mark_read:
+            if (session->user_id() != 0 && session->authenticated_user_id() == session->user_id() && session->admit(nullptr)) {
+                receipts_.mark_read(session->user_id(), command.room_id, command.last_read_id);
             }
             break;
 
-        case 'j': // Covers join_room
-            if (command == "join_room") {
-                int room_id = stoi(param_map["room_id"]);
-                cout << "Joining room with id: " << room_id << endl;
+        case CommandType::unread_summary: {
+            if (!session->admit(nullptr, config_.limits.history_cost)) {
+                break;
+            }
+            if (session->user_id() == 0 || session->authenticated_user_id() != session->user_id()) {
+                session->deliver(encode_unread(session->is_binary(), {}), CommandType::unread_result);
+                break;
             }
+            receipts_.unread_summary(session->user_id(), [session](vector<UnreadRoom> rooms) {
+                session->deliver(encode_unread(session->is_binary(), rooms), CommandType::unread_result);
+            });
             break;
+        }
 
-        case 's': // Covers send_text
-            if (command == "send_text") {
-                int room_id = stoi(param_map["room_id"]);
-                int user_id = stoi(param_map["user_id"]);
-                string text = param_map["text"];
-                cout << "User " << user_id << " is sending message: " << text << " in room " << room_id << endl;
+        case CommandType::kick_user: {
+            CHAT_LOG_INFO << "User " << command.user_id << " is kicking user " << command.target_user_id << " from room " << command.room_id;
+            if (!acts_in_room(session, command)) {
+                CHAT_LOG_WARN << "User " << command.user_id << " is not in room " << command.room_id;
+                break;
             }
+            auto target = find_room_session(command.room_id, command.target_user_id);
+            if (!target) {
+                CHAT_LOG_WARN << "User " << command.target_user_id << " is not in room " << command.room_id;
+                break;
+            }
+            // 연결을 끊으면 대상 세션이 스스로 방에서 나가고 색인에서도 빠진다
+            session->room()->broadcast("User " + to_string(command.target_user_id) + " has been kicked.");
+            target->close();
             break;
+        }
 
-        case 'e': // Covers exit_room
-            if (command == "exit_room") {
-                int room_id = stoi(param_map["room_id"]);
-                int user_id = stoi(param_map["user_id"]);
-                cout << "User " << user_id << " is exiting room " << room_id << endl;
+        case CommandType::grant_host: {
+            CHAT_LOG_INFO << "User " << command.user_id << " is granting host role to user " << command.target_user_id << " in room " << command.room_id;
+            if (!acts_in_room(session, command)) {
+                CHAT_LOG_WARN << "User " << command.user_id << " is not in room " << command.room_id;
+                break;
             }
+            if (!find_room_session(command.room_id, command.target_user_id)) {
+                CHAT_LOG_WARN << "User " << command.target_user_id << " is not in room " << command.room_id;
+                break;
+            }
+            session->room()->broadcast("User " + to_string(command.target_user_id) + " is now the host.");
             break;
+        }
 
-        case 'k': // Covers kick_user
-            if (command == "kick_user") {
-                int room_id = stoi(param_map["room_id"]);
-                int user_id = stoi(param_map["user_id"]);
-                int target_user_id = stoi(param_map["target_user_id"]);
-                cout << "User " << user_id << " is kicking user " << target_user_id << " from room " << room_id << endl;
+        case CommandType::invite_user: {
+            CHAT_LOG_DEBUG << "User " << session->user_id() << " is inviting user " << command.target_user_id << " to room " << command.room_id;
+            if (!session->admit(nullptr)) {
+                break;
             }
+            auto target = find_session(command.target_user_id);
+            if (!target) {
+                store_offline(command.target_user_id, CommandType::deliver_invite, session->user_id(), command.room_id, {});
+                break;
+            }
+            target->deliver(encode_invite(target->is_binary(), command.room_id, session->user_id()), CommandType::deliver_invite);
             break;
+        }
 
-        case 'g': // Covers grant_host
-            if (command == "grant_host") {
-                int room_id = stoi(param_map["room_id"]);
-                int user_id = stoi(param_map["user_id"]);
-                int target_user_id = stoi(param_map["target_user_id"]);
-                cout << "User " << user_id << " is granting host role to user " << target_user_id << " in room " << room_id << endl;
+        case CommandType::send_direct: {
+            if (!session->admit(nullptr)) {
+                break;
             }
+            auto target = find_session(command.target_user_id);
+            if (!target) {
+                store_offline(command.target_user_id, CommandType::deliver_direct, session->user_id(), 0, command.text);
+                break;
+            }
+            target->deliver(encode_direct(target->is_binary(), session->user_id(), command.text), CommandType::deliver_direct);
+            break;
+        }
+
+        case CommandType::ping:
+            session->enable_heartbeat();
+            session->deliver(heartbeat_message(session->is_binary(), CommandType::pong), CommandType::pong);
+            break;
+
+        case CommandType::pong:
+            // 받은 것만으로 heartbeat 는 채워졌다 (do_read 에서 기록)
+            session->enable_heartbeat();
             break;
 
         default:
-            cerr << "Unknown command: " << command << endl;
+            CHAT_LOG_WARN << "Unknown command: " << static_cast<int>(command.type);
             break;
         }
     }
 
+private:
+
    /* void check_message(string message) {
         size_t delimiter_pos = message.find('?');
         if (delimiter_pos == string::npos) {
@@ -492,41 +1896,489 @@ private:
     //    //sqlite
     //}
 
-    tcp::acceptor acceptor_;
+    boost::asio::io_context& io_context_;
+    ServerConfig config_;
+    MessageWriter message_writer_;
+    AuthService auth_;                // 해시 계산과 users 조회는 io 스레드 밖에서
+    SearchService search_;            // 전문 검색도 io 스레드 밖에서, 읽기 전용 연결로
+    HistoryService history_;          // 기록 조회도 방 / 세션 strand 밖에서
+    TalkArchiver archiver_;           // 오래된 달의 talks 를 보관 파일로 옮기는 스레드
+    ReadReceipts receipts_;           // 읽음 표시와 안 읽은 수, 기록은 모아서 따로 스레드에서
+    TimingWheel<ChatSession> session_timers_;
+    vector<unique_ptr<Listener>> listeners_;
+    SharedRateLimiter accept_rate_;   // 모든 listener 가 같이 쓴다
+    atomic<bool> draining_{ false };
+    boost::asio::steady_timer drain_timer_;
+    chrono::steady_clock::time_point drain_deadline_;
+    bool drain_closing_ = false;      // drain_timer_ 핸들러에서만
+    ResumeTokens resume_tokens_;
+    unique_ptr<ClusterBus> cluster_;  // 클러스터 모드가 아니면 nullptr
+
+    // 여러 io 스레드에서 접근하므로 잠금으로 보호
+    // rooms_ 는 입장/퇴장 때만, sessions_ 는 조회가 대부분이라 shared_mutex 사용
+    // 계정 정보는 auth_ 의 캐시가 따로 관리한다
+    mutex rooms_mutex_;
+    shared_mutex users_mutex_;  // sessions_, room_sessions_ 보호
     unordered_map<int, shared_ptr<ChatRoom>> rooms_; // room_id별 ChatRoom 관리
-    unordered_map<int, shared_ptr<ChatUser>> users_; // user_id별 ChatUser 관리
-    unordered_map<int, shared_ptr<ChatSession>> sessions_; // user_id별 ChatUser 관리
+    unordered_map<int, shared_ptr<ChatSession>> sessions_; // user_id별 접속 중인 ChatSession
+    unordered_map<uint64_t, shared_ptr<ChatSession>> room_sessions_; // (room_id, user_id)별 ChatSession
 };
 
-class ChatUser {
-public:
-    int get_userID() { return user_id_; }
-    string get_address() { return endpoint_ + ":" + to_string(port_); }
-    string get_name() { return name_; }
-    //void set_login(bool stat) {is_logined_ = stat;}
-    //bool get_login() { return is_logined_; }
-private:
-    int user_id_;
-    string endpoint_;
-    int port_;
-    string name_;
-    //bool is_logined_;
-};
+// ChatSession, ChatServer 정의 이후에 구현해야 하는 멤버 함수들
+
+// 압축은 압축을 협상한 멤버가 처음 나왔을 때 한 번만 하고, 같은 버퍼를 나머지 멤버들도 보낸다
+void ChatRoom::deliver_all(const SharedMessage& payload) {
+    ScopedLatency timing(server_metrics().broadcast_fanout);
+    SharedMessage compressed;
+    bool compress_tried = false;
+    for (auto& member : members_) {
+        if (!compress_tried && member->compresses(payload->size())) {
+            compress_tried = true;
+            server_metrics().compressions.add();
+            compressed = compress_message(*payload);
+        }
+        member->deliver_shared(payload, compressed);
+    }
+    messages_in_.fetch_add(1, memory_order_relaxed);
+    messages_out_.fetch_add(members_.size(), memory_order_relaxed);
+}
+
+void ChatRoom::replay_history(const shared_ptr<ChatSession>& session) {
+    for (size_t i = 0; i < history_.size(); ++i) {
+        session->deliver(history_[(history_head_ + i) % history_.size()].text);
+    }
+}
+
+// 들어온 본인에게는 입장 완료를 바로 알리고, 다른 멤버들에게는 모아서 알린다
+void ChatRoom::announce_join(const shared_ptr<ChatSession>& session) {
+    static const SharedMessage JOINED = make_static_message(string(JOIN_NOTICE));
+    session->deliver(JOINED);
+    note_presence(session->user_id(), true);
+}
+
+void ChatRoom::announce_leave(const shared_ptr<ChatSession>& session) {
+    note_presence(session->user_id(), false);
+}
+
+// 텍스트 / 바이너리 멤버가 섞여 있으므로 형식마다 한 번씩만 만든다
+void ChatRoom::flush_presence() {
+    presence_pending_ = false;
+    if (presence_joins_ > 0 || presence_leaves_ > 0) {
+        ScopedLatency timing(server_metrics().broadcast_fanout);
+        SharedMessage text;
+        SharedMessage binary;
+        SharedMessage compressed;
+        bool compress_tried = false;
+        for (auto& member : members_) {
+            SharedMessage& payload = member->is_binary() ? binary : text;
+            if (!payload) {
+                payload = encode_presence(member->is_binary(), room_id_, presence_joins_, presence_leaves_, presence_joined_, presence_left_);
+            }
+            if (!compress_tried && member->compresses(payload->size())) {
+                compress_tried = true;
+                server_metrics().compressions.add();
+                compressed = compress_message(*payload);
+            }
+            member->deliver_shared(payload, compressed, CommandType::deliver_presence);
+        }
+        server_metrics().presence_flushes.add();
+        messages_in_.fetch_add(1, memory_order_relaxed);
+        messages_out_.fetch_add(members_.size(), memory_order_relaxed);
+    }
+    presence_joins_ = 0;
+    presence_leaves_ = 0;
+    presence_joined_.clear();
+    presence_left_.clear();
+}
+
+void ChatRoom::fetch_history(shared_ptr<ChatSession> session, sqlite3_int64 before_id, int limit) {
+    auto self = shared_from_this();
+    boost::asio::dispatch(strand_, [this, self, session, before_id, limit]() {
+        with_history([this, session, before_id, limit]() {
+            // 캐시는 이 방의 가장 최근 메시지들이 빈틈 없이 이어진 구간이다
+            vector<StoredTalk> page;
+            size_t wanted = static_cast<size_t>(limit);
+            for (size_t i = history_.size(); i-- > 0 && page.size() < wanted;) {
+                const StoredTalk& talk = history_[(history_head_ + i) % history_.size()];
+                if (talk.id < before_id) {
+                    page.push_back(talk);
+                }
+            }
+            if (page.size() >= wanted) {
+                session->deliver(encode_history_page(session->is_binary(), room_id_, page), CommandType::history_result);
+                return;
+            }
+
+            // 캐시보다 오래된 구간은 조회 풀에서 읽어서 그 스레드에서 보낸다 (세션의 deliver 는 어느 스레드에서든)
+            sqlite3_int64 older_than = page.empty() ? before_id : page.back().id;
+            int missing = static_cast<int>(wanted - page.size());
+            int room_id = room_id_;
+            history_service_.load(room_id, older_than, missing,
+                [session, room_id, page = move(page)](vector<StoredTalk> older) mutable {
+                    page.insert(page.end(), make_move_iterator(older.begin()), make_move_iterator(older.end()));
+                    session->deliver(encode_history_page(session->is_binary(), room_id, page), CommandType::history_result);
+                });
+        });
+    });
+}
+
+void ChatSession::leave_room() {
+    if (room_) {
+        server_.unregister_session(self_, room_id_, user_id_);
+        room_->leave(self_);
+        server_.remove_empty_room(room_id_); // 사용자가 나간 후 방을 확인하여 제거
+        room_.reset();
+    }
+    self_.reset();
+}
+
+void ChatSession::start(shared_ptr<ChatSession> self, shared_ptr<ChatUser> user) {
+    self_ = self;
+    user_ = user;
+
+    TimingWheel<ChatSession>& timers = server_.session_timers();
+    accepted_tick_ = last_receive_tick_ = last_active_tick_ = timers.now();
+    timers.schedule(self, accepted_tick_ + timers.ticks(HANDSHAKE_TIMEOUT));
+    do_read();
+}
+
+void ChatSession::drain() {
+    auto self = shared_from_this();
+    boost::asio::dispatch(socket_.get_executor(), [this, self]() {
+        if (closed_ || draining_ || !room_) {
+            return;
+        }
+        draining_ = true;
+        bool authenticated = authenticated_user_id_ != 0 && authenticated_user_id_ == user_id_;
+        enqueue(OutboundMessage{ server_.resume_message(is_binary(), user_id_, room_id_, authenticated), CommandType::resume_token });
+    });
+}
+
+void ChatSession::mark_active() {
+    last_active_tick_ = server_.session_timers().now();
+}
+
+bool ChatSession::admit(ChatRoom* room, double cost) {
+    bool user_ok = rate_limit_.try_acquire(received_at_, cost);
+    if (user_ok && (!room || room->admit(received_at_, cost))) {
+        rate_limited_ = 0;
+        return true;
+    }
+    (user_ok ? server_metrics().room_rate_limited : server_metrics().user_rate_limited).add();
+    ++rate_limited_;
+    if (rate_limited_ == 1) {
+        CHAT_LOG_DEBUG << "Rate limited user " << user_id_ << " in room " << room_id_ << (user_ok ? " (room)" : " (user)");
+    }
+    // 방 버킷은 다른 세션들이 채운 것이므로 방이 붐빈다고 끊지는 않는다
+    if (!user_ok && limits_.abuse_disconnect > 0 && rate_limited_ >= limits_.abuse_disconnect) {
+        CHAT_LOG_WARN << "Disconnecting user " << user_id_ << " for exceeding the rate limit";
+        server_metrics().abuse_disconnects.add();
+        do_close();
+    }
+    return false;
+}
+
+// 세션마다 예약은 항상 하나만 걸려 있고, 깨어날 때마다 다음 마감을 다시 계산해서 건다
+void ChatSession::check_deadlines() {
+    if (closed_) {
+        return;
+    }
+    TimingWheel<ChatSession>& timers = server_.session_timers();
+    uint64_t now = timers.now();
+
+    if (!room_) {
+        uint64_t handshake_deadline = accepted_tick_ + timers.ticks(HANDSHAKE_TIMEOUT);
+        if (now >= handshake_deadline) {
+            CHAT_LOG_DEBUG << "Closing connection that sent no handshake";
+            server_metrics().handshake_timeouts.add();
+            do_close();
+            return;
+        }
+        timers.schedule(shared_from_this(), handshake_deadline);
+        return;
+    }
+
+    // 켜져 있을 때만, 화면을 열어 두고 읽기만 하는 클라이언트도 heartbeat 에는 답하므로 기본은 끈다
+    uint64_t idle_deadline = UINT64_MAX;
+    if (server_.idle_timeout().count() > 0) {
+        idle_deadline = last_active_tick_ + timers.ticks(server_.idle_timeout());
+        if (now >= idle_deadline) {
+            CHAT_LOG_DEBUG << "Closing idle session of user " << user_id_;
+            server_metrics().idle_timeouts.add();
+            do_close();
+            return;
+        }
+    }
+
+    // 예전 room_id,user_id 텍스트 클라이언트는 ping? 을 채팅 줄로 보여 주고 답하지도 않으므로
+    // heartbeat 를 보인 세션이 아니면 ping 은 보내지 않고 끊어진 연결은 SO_KEEPALIVE 에 맡긴다
+    // 나중에 ping / pong 을 보내면 다음 확인부터 heartbeat 를 건다
+    uint64_t ping_at = last_receive_tick_ + timers.ticks(HEARTBEAT_INTERVAL);
+    if (!heartbeat_) {
+        timers.schedule(shared_from_this(), min(idle_deadline, max(ping_at, now + timers.ticks(HEARTBEAT_INTERVAL))));
+        return;
+    }
+    uint64_t dead_at = ping_at + timers.ticks(HEARTBEAT_TIMEOUT);
+    if (now >= dead_at) {
+        CHAT_LOG_DEBUG << "Closing unresponsive session of user " << user_id_;
+        server_metrics().heartbeat_timeouts.add();
+        do_close();
+        return;
+    }
+    if (now >= ping_at && !ping_outstanding_) {
+        ping_outstanding_ = true;
+        enqueue(OutboundMessage{ heartbeat_message(is_binary(), CommandType::ping), CommandType::ping });
+    }
+    timers.schedule(shared_from_this(), min(idle_deadline, ping_outstanding_ ? dead_at : ping_at));
+}
+
+void ChatSession::join_room(int room_id, int user_id, bool replay) {
+    if (room_) {
+        return;
+    }
+    if (server_.requires_auth() && (user_id == 0 || user_id != authenticated_user_id_)) {
+        CHAT_LOG_WARN << "Refusing to join as user " << user_id << " (logged in as " << authenticated_user_id_ << ")";
+        server_metrics().unauthenticated_joins.add();
+        do_close();
+        return;
+    }
+    room_id_ = room_id;
+    user_id_ = user_id;
+
+    // ChatServer를 통해 적절한 방 찾기
+    room_ = server_.get_or_create_room(room_id_);
+    room_->join(shared_from_this(), replay);
+    server_.register_session(shared_from_this(), room_id_, user_id_);
+    server_.deliver_inbox(shared_from_this());
+}
+
+void ChatSession::on_auth_result(const AuthResult& result, SharedMessage reply) {
+    auto self = shared_from_this();
+    // 인증 풀이 가득 차면 호출한 쪽 (세션 strand) 에서 바로 부르므로 dispatch 가 아닌 post 로 읽기 루프 밖에서
+    boost::asio::post(socket_.get_executor(), [this, self, result, reply = move(reply)]() {
+        --auth_pending_;
+        bool newly_authenticated = result.status == AuthStatus::ok && result.user_id != 0 && result.user_id != authenticated_user_id_;
+        if (newly_authenticated) {
+            authenticated_user_id_ = result.user_id;
+        }
+        enqueue(OutboundMessage{ reply, CommandType::auth_result });
+        // 입장한 뒤에 로그인했으면 그때 inbox 를 보낸다
+        if (newly_authenticated && room_ && user_id_ == authenticated_user_id_) {
+            server_.deliver_inbox(self);
+        }
+        if (!waiting_auth_ || auth_pending_ > 0) {
+            return;
+        }
+        // 멈춰 두었던 읽기를 이어 간다, 그동안 닫혔으면 읽기가 없으니 여기서 정리
+        waiting_auth_ = false;
+        if (closed_) {
+            leave_room();
+            return;
+        }
+        if (!process_frames()) {
+            do_close();
+            leave_room();
+            return;
+        }
+        if (!waiting_auth_) {
+            do_read();
+        }
+    });
+}
+
+void ChatSession::do_read() {
+    auto self = shared_from_this();
+    size_t writable;
+    char* target = buffer_.prepare(writable);
+    socket_.async_read_some(boost::asio::buffer(target, writable), make_custom_alloc_handler(read_memory_,
+        [this, self](boost::system::error_code ec, size_t length) {
+            if (!ec) {
+                buffer_.commit(length);
+                last_receive_tick_ = server_.session_timers().now();
+                received_at_ = TokenBucket::Clock::now();
+                ping_outstanding_ = false;
+                if (process_frames()) {
+                    if (!waiting_auth_) {
+                        do_read();
+                    }
+                    return;
+                }
+            }
+            else if (!room_) {
+                CHAT_LOG_WARN << "Error reading initial data: " << ec.message();
+            }
+            do_close();
+            leave_room();
+        }));
+}
+
+bool ChatSession::process_frames() {
+    // 첫 바이트로 텍스트 / 바이너리 프로토콜을 구분
+    if (protocol_ == Protocol::negotiating) {
+        if (buffer_.size() == 0) {
+            return true;
+        }
+        if (static_cast<uint8_t>(buffer_.data()[0]) == BINARY_PROTOCOL_MAGIC) {
+            protocol_ = Protocol::binary;
+            heartbeat_ = true;  // 바이너리 클라이언트는 처음부터 ping / pong 을 안다
+            buffer_.consume(1);
+        }
+        else {
+            protocol_ = Protocol::text;
+        }
+    }
+    return protocol_ == Protocol::binary ? process_binary_frames() : process_text_lines();
+}
+
+bool ChatSession::process_text_lines() {
+    auto self = shared_from_this();
+    // 한 번에 여러 줄이 들어왔으면 모두 처리, 줄은 수신 버퍼를 가리키는 view
+    while (!closed_ && !must_wait_for_auth()) {
+        string_view data = buffer_.data();
+        size_t newline = data.find('\n');
+        if (newline == string_view::npos) {
+            break;
+        }
+        string_view line = data.substr(0, newline);
+        server_metrics().messages_received.add();
+
+        if (!room_) {
+            // 재접속 토큰 / 로그인 / 가입 명령이면 처리하고, 아니면 room_id와 user_id 파싱
+            if (!server_.check_message(self, line)) {
+                parse_initial_data(line);
+                join_room(room_id_, user_id_);
+            }
+        }
+        // 프로토콜 명령이 아닌 줄은 지금까지처럼 방 전체에 보내는 채팅
+        else if (!server_.check_message(self, line)) {
+            mark_active();
+            if (admit(room_.get())) {
+                server_.publish_text(room_, room_id_, user_id_, make_shared_message(string(line)));
+            }
+        }
+        buffer_.consume(newline + 1);
+    }
+
+    // 버퍼가 가득 찼는데 줄이 끝나지 않았으면 최대 프레임 크기를 넘은 것
+    if (!waiting_auth_ && buffer_.full()) {
+        CHAT_LOG_WARN << "Line exceeds max frame size (" << buffer_.capacity() << " bytes)";
+        return false;
+    }
+    return true;
+}
+
+bool ChatSession::process_binary_frames() {
+    auto self = shared_from_this();
+    size_t max_payload = min(buffer_.capacity() - BINARY_HEADER_SIZE, BINARY_MAX_PAYLOAD);
+    while (!closed_ && !must_wait_for_auth()) {
+        string_view data = buffer_.data();
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+
+        CommandType type;
+        size_t payload_size;
+        if (!decode_frame_header(bytes, data.size(), type, payload_size)) {
+            break;
+        }
+        if (payload_size > max_payload) {
+            CHAT_LOG_WARN << "Binary frame exceeds max frame size (" << payload_size << " bytes)";
+            return false;
+        }
+        if (data.size() < BINARY_HEADER_SIZE + payload_size) {
+            break;
+        }
+
+        server_metrics().messages_received.add();
+        ChatCommand command;
+        if (!decode_binary_command(type, bytes + BINARY_HEADER_SIZE, payload_size, command)
+            || (!room_ && !usable_before_join(type))) {
+            CHAT_LOG_WARN << "Invalid binary frame (opcode " << static_cast<int>(type) << ")";
+            return false;
+        }
+        server_.handle_command(self, command);
+        buffer_.consume(BINARY_HEADER_SIZE + payload_size);
+    }
+    return true;
+}
 
 
-int main() {
+// 사용법: chat_server_server [설정 파일]
+//         chat_server_server [io 스레드 수] [최대 프레임 크기] [클러스터 설정 파일 | -] [관리용 포트]  (이전 형식)
+// 설정 파일 형식과 기본값은 chat_config.h, 스레드 수가 0이면 코어 수만큼 실행
+// 클러스터 설정 파일을 주면 그 파일의 자기 노드 client_port 에서 수신 대기 (형식은 chat_cluster.h)
+// SIGINT / SIGTERM 을 받으면 drain 한 뒤 종료한다
+//   무중단 재시작: 새 프로세스를 같은 포트로 먼저 띄우고 (SO_REUSEPORT) 이전 프로세스에 SIGTERM
+//   채팅 / 관리용 / 클러스터 포트 모두 SO_REUSEPORT 로 열고, 이전 프로세스는 drain 을 시작할 때 셋 다 닫는다
+//   설정이나 포트를 열지 못해 시작하지 못하면 1 로 끝난다
+//   클라이언트는 받은 재접속 토큰으로 새 프로세스에 다시 들어간다
+int main(int argc, char* argv[]) {
     try {
-        boost::asio::io_context io_context;
+        ServerConfig config;
+        unsigned first_arg = 0;
+        if (argc > 1 && !parse_int(string_view(argv[1]), first_arg)) {
+            config = load_server_config(argv[1]);
+        }
+        else {
+            if (argc > 1) config.threads = static_cast<unsigned>(stoul(argv[1]));
+            if (argc > 2) config.max_frame_size = static_cast<size_t>(stoul(argv[2]));
+            if (argc > 3 && string_view(argv[3]) != "-") config.cluster = argv[3];
+            if (argc > 4) config.admin_port = static_cast<uint16_t>(stoul(argv[4]));
+        }
+        if (config.threads == 0) {
+            config.threads = max(1u, thread::hardware_concurrency());
+        }
+        if (config.auth_threads == 0) {
+            config.auth_threads = max(1u, thread::hardware_concurrency() / 2);
+        }
+        unsigned thread_count = config.threads;
+
+        ClusterConfig cluster = config.cluster.empty() ? ClusterConfig() : load_cluster_config(config.cluster);
+        if (cluster.enabled()) {
+            config.port = cluster.find(cluster.self_id)->client_port;
+            CHAT_LOG_INFO << "Cluster node " << cluster.self_id << " of " << cluster.nodes.size();
+        }
 
-        tcp::endpoint endpoint(tcp::v4(), 12345); // 포트 12345에서 수신 대기
-        ChatServer server(io_context, endpoint);
+        boost::asio::io_context io_context(static_cast<int>(thread_count));
+        ChatServer server(io_context, config, move(cluster));
 
-        cout << "Chat server is running on port 12345..." << endl;
+        CHAT_LOG_INFO << "Chat server is running on port " << config.port << " with " << thread_count << " io threads and "
+            << server.listener_count() << " listeners (" << IO_BACKEND << ")...";
 
+        unique_ptr<AdminServer> admin;
+        if (config.admin_port != 0) {
+            admin = make_unique<AdminServer>(io_context, tcp::endpoint(tcp::v4(), config.admin_port),
+                [&server]() { return server.render_metrics(); });
+            CHAT_LOG_INFO << "Metrics are served on port " << config.admin_port;
+        }
+
+        boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
+        signals.async_wait([&server, &admin, &io_context](boost::system::error_code ec, int signal_number) {
+            if (ec) {
+                return;
+            }
+            CHAT_LOG_INFO << "Received signal " << signal_number;
+            if (admin) {
+                admin->close();
+            }
+            server.drain([&io_context]() { io_context.stop(); });
+        });
+
+        // 하나의 io_context를 여러 스레드가 함께 돌린다 (방/세션 단위 직렬화는 strand가 담당)
+        vector<thread> workers;
+        for (unsigned i = 1; i < thread_count; ++i) {
+            workers.emplace_back([&io_context]() { io_context.run(); });
+        }
         io_context.run();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        if (server.draining()) {
+            server.finish_drain();
+            CHAT_LOG_INFO << "Drained";
+        }
     }
     catch (const exception& e) {
-        cerr << "Error: " << e.what() << endl;
+        CHAT_LOG_ERROR << "Error: " << e.what();
+        return 1;
     }
 
     return 0;
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// 해시 타이밍 휠
+// 세션마다 steady_timer 를 두지 않고 서버 전체가 타이머 하나로 tick 마다 슬롯 하나를 훑는다
+// 예약은 슬롯 vector 에 push 하나, 슬롯 수보다 먼 마감은 그 슬롯에 남아 있다가 바퀴를 다시 돌 때 확인한다
+// 대상은 weak_ptr 로 들고 있어서 먼저 사라진 세션은 그냥 건너뛴다
+//
+// Target 은 void on_deadline() 을 가져야 한다 (휠의 strand 에서 불리므로 자기 strand 로 넘겨서 처리)
+template <typename Target>
+class TimingWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TimingWheel(boost::asio::io_context& io_context, Clock::duration tick, size_t slots)
+        : timer_(boost::asio::make_strand(io_context)), tick_(tick), slots_(slots) {
+    }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    void start() {
+        started_ = Clock::now();
+        schedule_tick();
+    }
+
+    // 시작한 뒤 지난 tick 수, 어느 스레드에서든 읽을 수 있다
+    uint64_t now() const {
+        return now_.load(std::memory_order_relaxed);
+    }
+
+    // duration 을 tick 수로 올림
+    uint64_t ticks(Clock::duration duration) const {
+        return static_cast<uint64_t>((duration + tick_ - Clock::duration(1)) / tick_);
+    }
+
+    // 어느 스레드에서든 호출 가능, 이미 지난 마감은 다음 tick 에 부른다
+    void schedule(const std::shared_ptr<Target>& target, uint64_t deadline) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // now_ 는 잠금 안에서만 바뀌므로 지금 훑고 있는 슬롯에 넣어서 한 바퀴를 놓치는 일은 없다
+        deadline = std::max(deadline, now_.load(std::memory_order_relaxed) + 1);
+        slots_[deadline % slots_.size()].push_back(Entry{ target, deadline });
+        ++pending_;
+    }
+
+    size_t pending() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pending_;
+    }
+
+private:
+    struct Entry {
+        std::weak_ptr<Target> target;
+        uint64_t deadline;
+    };
+
+    // 시작 시각 기준으로 다음 tick 을 잡으므로 늦게 깨어나도 밀리지 않고 바로 따라잡는다
+    void schedule_tick() {
+        timer_.expires_at(started_ + tick_ * static_cast<Clock::rep>(now() + 1));
+        timer_.async_wait([this](boost::system::error_code ec) {
+            if (ec) {
+                return;
+            }
+            advance();
+            schedule_tick();
+        });
+    }
+
+    void advance() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            uint64_t tick = now_.load(std::memory_order_relaxed) + 1;
+            now_.store(tick, std::memory_order_relaxed);
+
+            std::vector<Entry>& slot = slots_[tick % slots_.size()];
+            auto due = std::partition(slot.begin(), slot.end(), [tick](const Entry& entry) {
+                return entry.deadline > tick;
+            });
+            for (auto it = due; it != slot.end(); ++it) {
+                if (auto target = it->target.lock()) {
+                    ready_.push_back(std::move(target));
+                }
+            }
+            pending_ -= static_cast<size_t>(slot.end() - due);
+            slot.erase(due, slot.end());
+        }
+        // 잠금 밖에서 불러야 on_deadline 안에서 다시 schedule 할 수 있다
+        for (auto& target : ready_) {
+            target->on_deadline();
+        }
+        ready_.clear();
+    }
+
+    boost::asio::steady_timer timer_;
+    const Clock::duration tick_;
+    Clock::time_point started_;
+    std::atomic<uint64_t> now_{ 0 };
+
+    mutable std::mutex mutex_;
+    std::vector<std::vector<Entry>> slots_;
+    size_t pending_ = 0;
+    std::vector<std::shared_ptr<Target>> ready_;  // 휠 strand 에서만 사용
+};
@@ -0,0 +1,90 @@
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "chat_auth.h"
+#include "chat_check.h"
+
+using namespace std;
+
+// chat_auth.h 의 해시를 공개된 테스트 벡터 (FIPS 180-2, RFC 4231, RFC 7914 등) 와 비교한다
+
+static string digest_hex(const Sha256::Digest& digest) {
+    return to_hex(digest.data(), digest.size());
+}
+
+static string sha256_hex(string_view data) {
+    Sha256 hasher;
+    hasher.update(data);
+    return digest_hex(hasher.finish());
+}
+
+static string pbkdf2_hex(string_view password, string_view salt, uint32_t iterations, size_t size) {
+    string out(size, '\0');
+    pbkdf2_hmac_sha256(password, reinterpret_cast<const uint8_t*>(salt.data()), salt.size(), iterations,
+        reinterpret_cast<uint8_t*>(&out[0]), out.size());
+    return to_hex(reinterpret_cast<const uint8_t*>(out.data()), out.size());
+}
+
+void test_sha256() {
+    // FIPS 180-2 부록 B
+    CHECK(sha256_hex("") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    CHECK(sha256_hex("abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    CHECK(sha256_hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")
+        == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+    // 블록 경계에 걸치게 나눠 넣어도 한 번에 넣은 것과 같아야 한다
+    string million(1000000, 'a');
+    Sha256 pieces;
+    for (size_t pos = 0, step = 1; pos < million.size(); pos += step, step = step % 97 + 1) {
+        pieces.update(string_view(million).substr(pos, step));
+    }
+    CHECK(digest_hex(pieces.finish()) == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    CHECK(sha256_hex(million) == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+    // 패딩이 다음 블록으로 넘어가는 길이 (55, 56, 64 바이트)
+    CHECK(sha256_hex(string(55, 'a')) == "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318");
+    CHECK(sha256_hex(string(56, 'a')) == "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a");
+    CHECK(sha256_hex(string(64, 'a')) == "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb");
+}
+
+void test_hmac_sha256() {
+    // RFC 4231 4.2, 4.3, 4.7 (블록보다 긴 키), 4.8
+    CHECK(digest_hex(hmac_sha256(string(20, '\x0b'), "Hi There"))
+        == "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7");
+    CHECK(digest_hex(hmac_sha256("Jefe", "what do ya want for nothing?"))
+        == "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+    CHECK(digest_hex(hmac_sha256(string(131, '\xaa'), "Test Using Larger Than Block-Size Key - Hash Key First"))
+        == "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54");
+    CHECK(digest_hex(hmac_sha256(string(131, '\xaa'),
+        "This is a test using a larger than block-size key and a larger than block-size data. "
+        "The key needs to be hashed before being used by the HMAC algorithm."))
+        == "9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2");
+}
+
+void test_pbkdf2_hmac_sha256() {
+    // RFC 7914 11
+    CHECK(pbkdf2_hex("passwd", "salt", 1, 64)
+        == "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"
+           "49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783");
+    CHECK(pbkdf2_hex("Password", "NaCl", 80000, 64)
+        == "4ddcd8f60b98be21830cee5ef22701f9641a4418d04c0414aeff08876b34ab56"
+           "a1d425a1225833549adb841b51c9b3176a272bdebba1d078478f62b397f33c8d");
+
+    // RFC 6070 의 입력을 SHA-256 으로 바꾼 널리 쓰이는 벡터
+    CHECK(pbkdf2_hex("password", "salt", 1, 32) == "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b");
+    CHECK(pbkdf2_hex("password", "salt", 2, 32) == "ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43");
+    CHECK(pbkdf2_hex("password", "salt", 4096, 32) == "c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a");
+    CHECK(pbkdf2_hex("passwordPASSWORDpassword", "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096, 40)
+        == "348c89dbcbd32b2f32d814b8116e84cf2b17347ebc1800181c4e2a1fb8dd53e1c635518c7dac47e9");
+    CHECK(pbkdf2_hex(string_view("pass\0word", 9), string_view("sa\0lt", 5), 4096, 16) == "89b69d0516f829893c696226650a8687");
+
+    // 저장 형식 왕복, 반복 횟수가 설정보다 적으면 다시 해시하라고 알려 준다
+    bool needs_rehash = false;
+    string stored = hash_password("secret", 1000);
+    CHECK(verify_password("secret", stored, needs_rehash));
+    CHECK(needs_rehash);
+    CHECK(!verify_password("secreT", stored, needs_rehash));
+    CHECK(verify_password("plain", "plain", needs_rehash));
+    CHECK(needs_rehash);
+}
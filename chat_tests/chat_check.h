@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdio>
+
+// 검사 프로그램들이 같이 쓰는 CHECK 매크로와 통계
+// 실패한 검사를 모두 출력하고, main 은 failures 가 0 이 아니면 1 로 끝난다
+
+inline int failures = 0;
+inline int checks = 0;
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+inline void check(bool passed, const char* expression, const char* file, int line) {
+    ++checks;
+    if (!passed) {
+        ++failures;
+        printf("FAILED %s:%d: %s\n", file, line, expression);
+    }
+}
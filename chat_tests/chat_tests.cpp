@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "chat_check.h"
+#include "chat_compress.h"
+
+using namespace std;
+
+// 서버 헤더의 순수 함수 검사 (네트워크 / DB 없이 실행)
+// LZ4 는 왕복과 사전 사용을 확인하고, 해시 검사는 chat_auth_tests.cpp 에 있다
+// 실패한 검사를 모두 출력하고, 하나라도 실패하면 1 로 끝난다
+
+void test_sha256();
+void test_hmac_sha256();
+void test_pbkdf2_hmac_sha256();
+
+static bool lz4_round_trip(const string& raw) {
+    string block;
+    lz4_compress_with_dictionary(raw, block);
+    string restored;
+    return lz4_decompress_with_dictionary(block, raw.size(), restored) && restored == raw;
+}
+
+static void test_lz4() {
+    // 매치를 찾지 않는 짧은 입력, 겹치는 매치, 15 이상 길이, 64KiB 보다 먼 거리
+    mt19937 random(12345);
+    string noise(200000, '\0');
+    for (char& c : noise) {
+        c = static_cast<char>(random());
+    }
+    string text;
+    while (text.size() < 200000) {
+        text += "message #" + to_string(text.size() % 977) + " from user " + to_string(random() % 50) + "\n";
+    }
+    CHECK(lz4_round_trip(""));
+    CHECK(lz4_round_trip("a"));
+    CHECK(lz4_round_trip("hello world!"));
+    CHECK(lz4_round_trip("hello world!!"));
+    CHECK(lz4_round_trip(string(1000, 'x')));
+    CHECK(lz4_round_trip(string(15 + 4 + 255 + 100, 'y')));
+    CHECK(lz4_round_trip(noise));
+    CHECK(lz4_round_trip(text));
+    CHECK(lz4_round_trip(noise.substr(0, 70000) + noise.substr(0, 70000)));
+
+    // 사전에 있는 문구는 짧은 메시지여도 줄어야 하고, 한국어 문구도 마찬가지
+    string joined(JOIN_NOTICE);
+    SharedMessage compressed = compress_message(joined);
+    CHECK(compressed != nullptr);
+    string restored;
+    CHECK(compressed && compressed->size() < joined.size() / 2);
+    CHECK(compressed && decompress_message(*compressed, restored) && restored == joined);
+
+    string korean = "\xEC\x95\x88\xEB\x85\x95\xED\x95\x98\xEC\x84\xB8\xEC\x9A\x94\x20"  // 안녕하세요
+        "\xEA\xB0\x90\xEC\x82\xAC\xED\x95\xA9\xEB\x8B\x88\xEB\x8B\xA4\x20";              // 감사합니다
+    compressed = compress_message(korean);
+    CHECK(compressed && compressed->size() < korean.size() / 2);
+    CHECK(compressed && decompress_message(*compressed, restored) && restored == korean);
+
+    // 줄지 않으면 압축하지 않는다
+    CHECK(compress_message(noise.substr(0, 64)) == nullptr);
+    CHECK(compress_message("") == nullptr);
+
+    // 잘린 block, 크기가 다른 block, 한도를 넘는 크기는 거절한다
+    string block;
+    lz4_compress_with_dictionary(text.substr(0, 5000), block);
+    CHECK(!lz4_decompress_with_dictionary(string_view(block).substr(0, block.size() - 1), 5000, restored));
+    CHECK(!lz4_decompress_with_dictionary(block, 4999, restored));
+    CHECK(!lz4_decompress_with_dictionary(block, 5001, restored));
+    string oversized;
+    BinaryWriter(oversized).write_varint(MAX_DECOMPRESSED_SIZE + 1);
+    CHECK(!decompress_message(oversized, restored));
+    CHECK(!lz4_decompress_with_dictionary(string("\x00\xff\xff", 3), 0, restored));
+}
+
+int main() {
+    test_sha256();
+    test_hmac_sha256();
+    test_pbkdf2_hmac_sha256();
+    test_lz4();
+
+    if (failures > 0) {
+        printf("%d of %d checks failed\n", failures, checks);
+        return 1;
+    }
+    printf("All %d checks passed\n", checks);
+    return 0;
+}